@@ -45,6 +45,8 @@ public:
     explicit operator bool() const { return pos < nodes->size() && (*nodes)[pos]; }
     bool Bottom() const { return !Left() && !Right(); }
 	bool Top() const { return pos == 0; }
+    //stable position in the tree, for identifying nodes
+    size_t Index() const { return pos; }
 	size_t Depth() const
 	{
 		auto iter = *this;
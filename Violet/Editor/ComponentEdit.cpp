@@ -120,7 +120,7 @@ void PositionEditor::add(Object selected)
 
 RenderEditor::RenderEditor(Render& render)
 	: ComponentEditor("rendering", render), render(render)
-	, currentPicker(AssetPicker::None)
+	, occluder("occluder", LB_WIDTH), currentPicker(AssetPicker::None)
 {}
 
 void RenderEditor::DrawPicker(Object selected, Persist& persist)
@@ -140,8 +140,10 @@ void RenderEditor::DrawPicker(Object selected, Persist& persist)
 
 		if (old != tup)
 		{
+			bool occludes = render.IsOccluder(selected);
 			render.Remove(selected);
 			render.Create(selected, tup);
+			render.Occluder(selected, occludes);
 			render.Save(selected, persist);
 		}
 	}
@@ -185,6 +187,13 @@ bool RenderEditor::edit(Object selected)
 	else
 		UI::DrawText("not mobile", l.PutSpace({ LB_WIDTH, UI::LINEH }));
 
+	bool occludes = render.IsOccluder(selected);
+	occluder.Draw(occludes);
+	if (occludes != render.IsOccluder(selected))
+	{
+		render.Occluder(selected, occludes);
+		return true;
+	}
 	return false;
 }
 
@@ -195,7 +204,8 @@ void RenderEditor::add(Object selected)
 
 CollisionEditor::CollisionEditor(Collision& collision, Render& render)
 	: ComponentEditor("collision", collision), collision(collision), render(render)
-    , debug("debug view", LB_WIDTH)
+    , debug("debug view", LB_WIDTH/2), batched("simd", LB_WIDTH/2)
+    , broadPhase("", LB_WIDTH)
 {}
 
 void CollisionEditor::add(Object selected)
@@ -206,10 +216,27 @@ void CollisionEditor::add(Object selected)
 
 bool CollisionEditor::edit(Object)
 {
+    UI::CurLayout().PushNext(UI::Layout::Dir::Right);
     debug.Draw(collision.Debug());
+    batched.Draw(collision.BatchNarrowPhase());
+    UI::CurLayout().Pop();
     return false;
 }
 
+void CollisionEditor::DrawSettings(Persist& persist)
+{
+    //click to go to the next one
+    using Kind = Collision::BroadPhaseKind;
+    static const char* names[] = { "broad phase: tree", "broad phase: sweep", "broad phase: grid" };
+    int kind = static_cast<int>(collision.CurrentBroadPhase());
+    broadPhase.text = names[kind];
+    if (broadPhase.Draw())
+    {
+        collision.UseBroadPhase(static_cast<Kind>((kind + 1) % 3));
+        collision.SaveBroadPhase(persist);
+    }
+}
+
 RigidBodyEditor::RigidBodyEditor(RigidBody& rigidBody)
 	: ComponentEditor("rigid body", rigidBody), rigidBody(rigidBody)
     , paused("pause", LB_WIDTH/2), debug("debug view", LB_WIDTH/2)
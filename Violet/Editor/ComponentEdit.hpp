@@ -66,6 +66,7 @@ private:
 	Render& render;
 	UI::Button materialButton;
 	UI::Button meshButton;
+	UI::CheckBox occluder;
 
 	enum class AssetPicker
 	{
@@ -83,6 +84,8 @@ class CollisionEditor : public ComponentEditor
 {
 public:
 	CollisionEditor(Collision& collision, Render& render);
+    //settings for the whole scene
+    void DrawSettings(Persist& persist);
     
 private:
     void add(Object selected);
@@ -90,7 +93,8 @@ private:
     
 	Collision& collision;
     Render& render;
-    UI::CheckBox debug;
+    UI::CheckBox debug, batched;
+    UI::TextButton broadPhase;
 };
 
 class RigidBody;
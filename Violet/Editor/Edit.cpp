@@ -12,7 +12,7 @@ Edit::Edit(Render& r, RenderPasses& rp, Position& position,
 	ObjectName& objName, Collision& collision, RigidBody& rigidBody,
 	ComponentManager& mgr, Persist& persist)
 	: enabled(true)
-	, rp(rp), position(position), objName(objName), mgr(mgr), persist(persist)
+	, rp(rp), position(position), collision(collision), objName(objName), mgr(mgr), persist(persist)
 	, tool(r, position)
 	, focused(Object::none), selected(Object::none)
 	, viewPitch(0), viewYaw(0)
@@ -66,6 +66,38 @@ void Edit::Remove(Object obj)
 	objectSelect.items.erase(obj);
 }
 
+//The picker pass sees everything that's drawn, in front to back order, but is
+//read back asynchronously so it's a frame or two behind. Until it has an
+//answer for the pixel under the mouse, the mouse ray is cast on the CPU, which
+//only finds things that collide.
+Object Edit::Pick(const Events& e, Object camera)
+{
+	Eigen::Array2f posTex = e.mainView.Sc2Tex(e.MousePosSc()).array();
+	if ((posTex < Eigen::Array2f::Zero()).any()
+		|| (posTex > Eigen::Array2f(1, 1)).any())
+		return Object::invalid;
+
+	Vector2f posNdc = e.mainView.Sc2Ndc(e.MousePosSc());
+	Matrix4f viewProj = e.mainView.PerspMat() * position[camera]->ToMatrix();
+	Object arrow = tool.Pick(posNdc, viewProj);
+	if (arrow != Object::none)
+		return arrow;
+
+	Object picked = rp.Pick(e.MousePosSc());
+	if (picked != Object::invalid)
+		return picked;
+
+	//from the near plane to the far plane
+	Matrix4f unproject = viewProj.inverse();
+	Vector4f nearPt = unproject * Vector4f{ posNdc.x(), posNdc.y(), -1, 1 };
+	Vector4f farPt = unproject * Vector4f{ posNdc.x(), posNdc.y(), 1, 1 };
+	Vector3f origin = nearPt.head<3>() / nearPt.w();
+	Vector3f toFar = farPt.head<3>() / farPt.w() - origin;
+
+	collision.Raycast({ Ray{ origin, toFar.normalized(), toFar.norm() } }, pickHits);
+	return pickHits[0].obj;
+}
+
 void Edit::PhysTick(Object camera)
 {
 	Events& e = UI::FrameEvents();
@@ -77,7 +109,7 @@ void Edit::PhysTick(Object camera)
 		return;
 	}
 
-	Object picked = rp.Pick(e.MousePosSc());
+	Object picked = Pick(e, camera);
 	Object newSelect = selected;
 
 	if (e.MouseClick(GLFW_MOUSE_BUTTON_LEFT))
@@ -145,6 +177,8 @@ void Edit::PhysTick(Object camera)
 		l.PutSpace(UI::LINEH);
 	}
 
+	collEdit.DrawSettings(persist);
+
 	l.PushNext(UI::Layout::Dir::Right);
 
 	if (newObject.Draw())
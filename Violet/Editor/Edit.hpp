@@ -5,6 +5,7 @@
 #include "Core/Component.hpp"
 #include "ComponentEdit.hpp"
 #include "Tool.hpp"
+#include "Physics/Collision.hpp"
 
 #include <unordered_set>
 
@@ -36,9 +37,15 @@ private:
 	void Save(Object, Persist&) const;
 	void Remove(Object);
 
+	//the object under the mouse, Object::none if there isn't one, or
+	//Object::invalid if the mouse isn't over the 3D view
+	Object Pick(const Events& e, Object camera);
+	std::vector<RayHit> pickHits;
+
 	bool enabled;
 	RenderPasses& rp;
 	Position& position;
+	Collision& collision;
 	ObjectName& objName;
 	ComponentManager& mgr;
 	Persist& persist;
@@ -3,6 +3,7 @@
 #include "UI/Layout.hpp"
 #include "UI/PixelDraw.hpp"
 #include "UI/Text.hpp"
+#include "Rendering/GLState.hpp"
 #include "Window.hpp"
 
 MaterialEdit::MaterialEdit()
@@ -10,10 +11,9 @@ MaterialEdit::MaterialEdit()
 	, instances(1), vao("assets/blank", UnitBox)
 	, matName(WIDTH)
 {
-	//TODO: not so many Eigen::
-	InstData object{ Object::invalid,
-		Eigen::Affine3f{ Eigen::Translation3f{ 0, 1, 0 } }.matrix() };
-	instances.Assign(0, object);
+	Transform xfrm;
+	xfrm.pos = { 0, 1, 0 };
+	instances.Assign(0, InstData{ Object::invalid, xfrm });
 }
 
 void MaterialEdit::Edit(Material newMat, UI::AlignedBox2i newInitBox)
@@ -51,11 +51,11 @@ bool MaterialEdit::Draw(Persist& persist)
 		cam.Bind();
 
 		view.GlViewport();
-		glDisable(GL_DEPTH_TEST);
-		glEnable(GL_CULL_FACE);
+		GLState::Disable(GL_DEPTH_TEST);
+		GLState::Enable(GL_CULL_FACE);
 		vao.Draw();
-		glDisable(GL_CULL_FACE);
-		glEnable(GL_DEPTH_TEST);
+		GLState::Disable(GL_CULL_FACE);
+		GLState::Enable(GL_DEPTH_TEST);
 		UI::SetViewport();
 	});
 	l.PutSpace(20);
@@ -2,6 +2,7 @@
 #include "Assets.hpp"
 
 #include "Rendering/Render.hpp"
+#include "Rendering/GLState.hpp"
 #include "Window.hpp"
 
 using namespace Asset_detail;
@@ -22,11 +23,13 @@ Tex Asset_detail::ObjThumb(const std::string& path)
     
     cam["projection"] = view.PerspMat();
 
-	static InstData object{ Object::invalid,
-		Eigen::Affine3f{ Eigen::Translation3f{ 0, 3, 0 } }.matrix() };
 	static BufferObject<InstData, GL_ARRAY_BUFFER, GL_STATIC_DRAW> instances(1);
 	STATIC
-		instances.Assign(0, object);
+	{
+		Transform xfrm;
+		xfrm.pos = { 0, 3, 0 };
+		instances.Assign(0, InstData{ Object::invalid, xfrm });
+	}
 
 	//todo: more efficient to reuse the VAO
 	VAO vao{ shader, { path } };
@@ -47,11 +50,11 @@ Tex Asset_detail::ObjThumb(const std::string& path)
 	mat.Bind();
 
 	//Draw the correct sides of things
-	glEnable(GL_CULL_FACE);
-	glEnable(GL_DEPTH_TEST);
+	GLState::Enable(GL_CULL_FACE);
+	GLState::Enable(GL_DEPTH_TEST);
 	vao.Draw();
-	glDisable(GL_DEPTH_TEST);
-	glDisable(GL_CULL_FACE);
+	GLState::Disable(GL_DEPTH_TEST);
+	GLState::Disable(GL_CULL_FACE);
 
 	return ret;
 }
@@ -69,11 +72,14 @@ Tex Asset_detail::MatThumb(const Material& mat)
 	}
 
 	//look down the end of it
-	static InstData object{ Object::invalid, Eigen::Affine3f{
-		Eigen::Translation3f(0, 0, -2) * Eigen::Scaling(2.f) }.matrix() };
 	static BufferObject<InstData, GL_ARRAY_BUFFER, GL_STATIC_DRAW> instances(1);
 	STATIC
-		instances.Assign(0, object);
+	{
+		Transform xfrm;
+		xfrm.pos = { 0, 0, -2 };
+		xfrm.scale = 2;
+		instances.Assign(0, InstData{ Object::invalid, xfrm });
+	}
 
 	VAO vao{ mat.Shader(), { "assets/capsule.obj" } };
 	vao.BindInstanceData(mat.Shader(), instances);
@@ -17,6 +17,20 @@ std::vector<TriInd> arrowInds = {
     {4, 5, 6}
 };
 
+//the arrow length in NDC, as in tool_arrow.vert
+static const float ARROW_SIZE = .1f;
+
+static bool InTriangle(const Vector2f& p, const Vector2f& a, const Vector2f& b, const Vector2f& c)
+{
+    auto side = [&p](const Vector2f& from, const Vector2f& to)
+    {
+        Vector2f edge = to - from, rel = p - from;
+        return edge.x() * rel.y() - edge.y() * rel.x();
+    };
+    float ab = side(a, b), bc = side(b, c), ca = side(c, a);
+    return (ab >= 0 && bc >= 0 && ca >= 0) || (ab <= 0 && bc <= 0 && ca <= 0);
+}
+
 Tool::Tool(Render& r, Position& position)
 	: position(position), move(position[x] + position[y] + position[z])
 {
@@ -44,6 +58,33 @@ void Tool::SetTarget(magic_ptr<Transform> t)
 		move->pos = Vector3f::Zero(); //better, hide the tool
 }
 
+//The arrows are drawn flat on the screen, so they're hit tested in NDC by
+//redoing what the vertex shader does
+Object Tool::Pick(Vector2f posNdc, const Matrix4f& viewProj) const
+{
+    Matrix4f toScreen = viewProj * move->ToMatrix();
+    Vector4f center = toScreen.col(3);
+    if (center.w() <= 0)
+        return Object::none;
+    Vector2f mouse = (posNdc - center.head<2>() / center.w()) / ARROW_SIZE;
+
+    const Object arrows[] = { x, y, z };
+    for (int i = 0; i < 3; ++i)
+    {
+        Vector2f dir = (toScreen * Vector4f::Unit(i)).head<2>();
+        if (dir.isZero())
+            continue; //pointing right at the camera
+        dir.normalize();
+        Vector2f local{ mouse.dot(dir), mouse.dot(Vector2f{ -dir.y(), dir.x() }) };
+
+        for (const TriInd& tri : arrowInds)
+            if (InTriangle(local, arrowVerts[tri.a].head<2>(),
+                    arrowVerts[tri.b].head<2>(), arrowVerts[tri.c].head<2>()))
+                return arrows[i];
+    }
+    return Object::none;
+}
+
 void Tool::Update(Events& e, Object camera, Object focused)
 {
 	if (!e.MouseButton(GLFW_MOUSE_BUTTON_LEFT))
@@ -15,6 +15,8 @@ public:
     Tool(Render& r, Position& position);
 	void Update(Events& e, Object camera, Object focused);
 	void SetTarget(magic_ptr<Transform> target);
+	//the arrow under the mouse, or Object::none
+	Object Pick(Vector2f posNdc, const Matrix4f& viewProj) const;
     
 private:
 	Position& position;
@@ -2,135 +2,311 @@
 #define AABB_HPP
 
 //incremental AABB tree
+//Nodes live in a pool and are addressed by index, so the tree can be edited
+//without allocating. Edits are followed by tree rotations which keep the
+//surface area heuristic cost low, see Erin Catto, "Dynamic Bounding Volume
+//Hierarchies", GDC 2019.
 
-#include "Containers/variant.hpp"
+#include "Raycast.hpp"
+#include <cstdint>
+
+inline float Area(const AlignedBox3f& box)
+{
+    Vector3f dims = box.sizes();
+    return dims.x() * (dims.y() + dims.z()) + dims.y() * dims.z();
+}
 
 template<class T>
 class AABBTree
 {
 public:
+    using node_id = std::int32_t;
+    static const node_id null_node = -1;
     struct Node;
-    using iterator = Node*;
     struct query_iterator;
-    
-    iterator insert(AlignedBox3f box, T val);
-    void erase(iterator);
-    
+
+    AABBTree() : root(null_node), freeList(null_node), leaves(0) {}
+
+    node_id insert(AlignedBox3f box, T val);
+    void erase(node_id);
+    void clear();
+
+    const AlignedBox3f& box(node_id leaf) const { return nodes[leaf].box; }
+    const T& operator[](node_id leaf) const { return nodes[leaf].val; }
+
     //iterator must not outlive query
-    query_iterator query(const AlignedBox3f& query) const {return{ tree.get(), &query };}
+    query_iterator query(const AlignedBox3f& query) const {return{ this, root, &query };}
     query_iterator query_end() const { return{}; }
-    
+    //calls hit(val, lanes) for each leaf hit by some of the rays, with the
+    //lanes which hit it. The packet goes down the tree together, and drops
+    //rays which miss a node.
+    template<class Hit>
+    void raycast(const RayLanes& rays, Hit hit) const;
+
+    //Statistics
+    size_t size() const { return leaves; }
+    int height() const { return root == null_node ? 0 : nodes[root].height; }
+    //total area of the internal nodes, which is proportional to the expected
+    //number of nodes visited by a query
+    float cost() const;
+
 private:
-    using NodePtr = std::unique_ptr<Node>;
-    
-    void newNode(NodePtr node, NodePtr& root);
-    
-    NodePtr tree;
+    node_id allocate();
+    void release(node_id);
+    node_id bestSibling(const AlignedBox3f& box) const;
+    void refit(node_id);
+    void rotate(node_id);
+    void replaceChild(node_id parent, node_id oldChild, node_id newChild);
+    template<class Hit>
+    void raycast(node_id n, const RayLanes& rays, unsigned active, Hit& hit) const;
+
+    std::vector<Node> nodes;
+    node_id root;
+    node_id freeList; //threaded through Node::parent
+    size_t leaves;
 };
 
 template<class T>
 struct AABBTree<T>::Node
 {
     AlignedBox3f box;
-    Node* parent;
-    
-    using Ptr = std::unique_ptr<Node>;
-    using Children = std::pair<Ptr, Ptr>;
-    variant<Children, T> data;
-    
-    Node(AlignedBox3f box, Node* parent, Ptr l, Ptr r)
-        : box(box), parent(parent), data(Children{std::move(l), std::move(r)})
-    {
-        left()->parent = this;
-        right()->parent = this;
-    }
-    Node(AlignedBox3f box, Node* parent, T leaf)
-        : box(box), parent(parent), data(leaf)
-    {}
-    
-    bool leaf() const {return data.template is<T>();}
-    Ptr& left() {return data.template get<Children>().first;}
-    const Ptr& left() const {return data.template get<Children>().first;}
-    Ptr& right() {return data.template get<Children>().second;}
-    const Ptr& right() const {return data.template get<Children>().second;}
+    node_id parent;
+    node_id left, right;
+    int height; //0 for leaves
+    T val;
+
+    bool leaf() const {return left == null_node;}
 };
 
 template<class T>
 struct AABBTree<T>::query_iterator : public std::iterator<std::forward_iterator_tag, T>
 {
-    using Node = AABBTree::Node;
     using value_type = T;
-    
-    const Node* current;
+
+    const AABBTree* tree;
+    node_id current;
     const AlignedBox3f* query;
-    
-    query_iterator() : current(nullptr) {}
-    query_iterator(const Node* c, const AlignedBox3f* q) : current(c), query(q) {search();}
+
+    query_iterator() : tree(nullptr), current(null_node), query(nullptr) {}
+    query_iterator(const AABBTree* t, node_id c, const AlignedBox3f* q)
+        : tree(t), current(c), query(q)
+    {
+        if (current != null_node && !overlaps(current))
+            current = null_node;
+        search();
+    }
     BASIC_EQUALITY(query_iterator, current);
-    
+
     query_iterator& operator++();
-    query_iterator operator++(int) {auto ret = this; ++*this; return ret;}
-    const T& operator*() {return current->data.template get<T>(); }
+    query_iterator operator++(int) {auto ret = *this; ++*this; return ret;}
+    const T& operator*() {return node(current).val; }
     const T* operator->() {return &**this;}
-    
+
 private:
+    const Node& node(node_id n) const { return tree->nodes[n]; }
+    bool overlaps(node_id n) const { return !query->intersection(node(n).box).isEmpty(); }
     void backup();
     void search();
 };
 
 template<class T>
-auto AABBTree<T>::insert(AlignedBox3f box, T val) -> iterator
+auto AABBTree<T>::allocate() -> node_id
 {
-    NodePtr node = std::make_unique<Node>(box, nullptr, val);
-    iterator ret = node.get();
-    if (!tree)
-        tree = std::move(node);
-    else
-        newNode(std::move(node), tree);
+    if (freeList == null_node)
+    {
+        nodes.emplace_back();
+        return static_cast<node_id>(nodes.size() - 1);
+    }
+    node_id ret = freeList;
+    freeList = nodes[ret].parent;
     return ret;
 }
 
-inline float Area(const AlignedBox3f& box)
+template<class T>
+void AABBTree<T>::release(node_id n)
 {
-    Vector3f dims = box.sizes();
-    return dims.x() * (dims.y() + dims.z()) + dims.y() * dims.z();
+    nodes[n].parent = freeList;
+    nodes[n].height = -1;
+    freeList = n;
 }
 
 template<class T>
-void AABBTree<T>::newNode(NodePtr node, NodePtr& root)
+void AABBTree<T>::clear()
 {
-    if (!root->leaf())
+    nodes.clear();
+    root = freeList = null_node;
+    leaves = 0;
+}
+
+template<class T>
+auto AABBTree<T>::insert(AlignedBox3f box, T val) -> node_id
+{
+    node_id leaf = allocate();
+    Node& node = nodes[leaf];
+    node.box = box;
+    node.parent = node.left = node.right = null_node;
+    node.height = 0;
+    node.val = val;
+    ++leaves;
+
+    if (root == null_node)
+    {
+        root = leaf;
+        return leaf;
+    }
+
+    node_id sibling = bestSibling(box);
+    node_id oldParent = nodes[sibling].parent;
+    node_id newParent = allocate();
+
+    Node& parent = nodes[newParent];
+    parent.parent = oldParent;
+    parent.left = sibling;
+    parent.right = leaf;
+    nodes[sibling].parent = newParent;
+    nodes[leaf].parent = newParent;
+
+    if (oldParent == null_node)
+        root = newParent;
+    else
+        replaceChild(oldParent, sibling, newParent);
+
+    //refit the boxes
+    for (node_id it = newParent; it != null_node; it = nodes[it].parent)
     {
-        //3 possible arrangements:
-        float cur = Area(root->box) + Area(node->box);
-        float left = Area(root->left()->box.merged(node->box)) + Area(root->right()->box);
-        float right = Area(root->right()->box.merged(node->box)) + Area(root->left()->box);
-        
-        if (left < cur && left < right)
+        refit(it);
+        rotate(it);
+    }
+    return leaf;
+}
+
+//Greedy descent: go down whichever child makes the tree cheaper, and stop
+//when pairing with the current node is cheapest.
+template<class T>
+auto AABBTree<T>::bestSibling(const AlignedBox3f& box) const -> node_id
+{
+    node_id it = root;
+    while (!nodes[it].leaf())
+    {
+        const Node& node = nodes[it];
+        float area = Area(node.box);
+        float combinedArea = Area(node.box.merged(box));
+
+        //cost of making a new parent for this node and the new leaf
+        float here = 2.f * combinedArea;
+        //every ancestor of the new leaf grows by at least this much
+        float inherited = 2.f * (combinedArea - area);
+
+        auto descendCost = [&](node_id child)
         {
-            newNode(std::move(node), root->left());
-            root->box = root->left()->box.merged(root->right()->box);
-            return;
-        }
-        else if (right < cur && right < left)
+            const Node& c = nodes[child];
+            float merged = Area(c.box.merged(box));
+            return (c.leaf() ? merged : merged - Area(c.box)) + inherited;
+        };
+
+        float left = descendCost(node.left);
+        float right = descendCost(node.right);
+
+        if (here < left && here < right)
+            break;
+        it = left < right ? node.left : node.right;
+    }
+    return it;
+}
+
+template<class T>
+void AABBTree<T>::replaceChild(node_id parent, node_id oldChild, node_id newChild)
+{
+    if (nodes[parent].left == oldChild)
+        nodes[parent].left = newChild;
+    else
+        nodes[parent].right = newChild;
+}
+
+template<class T>
+void AABBTree<T>::refit(node_id n)
+{
+    Node& node = nodes[n];
+    node.box = nodes[node.left].box.merged(nodes[node.right].box);
+    node.height = 1 + std::max(nodes[node.left].height, nodes[node.right].height);
+}
+
+//Try swapping a child of n with a grandchild on the other side
+/*
+        n
+       / \
+      B   C
+     / \ / \
+    D  E F  G
+ */
+template<class T>
+void AABBTree<T>::rotate(node_id n)
+{
+    const Node& node = nodes[n];
+    if (node.height < 2)
+        return;
+
+    node_id B = node.left, C = node.right;
+
+    //which rotation, and what it would save
+    enum { None, BF, BG, CD, CE } best = None;
+    float bestDiff = 0.f;
+
+    auto consider = [&](decltype(best) rot, float diff)
+    {
+        if (diff < bestDiff)
         {
-            newNode(std::move(node), root->right());
-            root->box = root->left()->box.merged(root->right()->box);
-            return;
+            best = rot;
+            bestDiff = diff;
         }
-        //else fall through
+    };
+
+    if (!nodes[C].leaf())
+    {
+        float areaC = Area(nodes[C].box);
+        const Node& c = nodes[C];
+        consider(BF, Area(nodes[B].box.merged(nodes[c.right].box)) - areaC);
+        consider(BG, Area(nodes[B].box.merged(nodes[c.left].box)) - areaC);
+    }
+    if (!nodes[B].leaf())
+    {
+        float areaB = Area(nodes[B].box);
+        const Node& b = nodes[B];
+        consider(CD, Area(nodes[C].box.merged(nodes[b.right].box)) - areaB);
+        consider(CE, Area(nodes[C].box.merged(nodes[b.left].box)) - areaB);
+    }
+
+    //swap child 'outer' of n with grandchild 'inner' of 'mid'
+    auto swap = [&](node_id outer, node_id mid, node_id inner)
+    {
+        replaceChild(n, outer, inner);
+        replaceChild(mid, inner, outer);
+        nodes[inner].parent = n;
+        nodes[outer].parent = mid;
+        refit(mid);
+        refit(n);
+    };
+
+    switch (best)
+    {
+    case None: break;
+    case BF: swap(B, C, nodes[C].left); break;
+    case BG: swap(B, C, nodes[C].right); break;
+    case CD: swap(C, B, nodes[B].left); break;
+    case CE: swap(C, B, nodes[B].right); break;
     }
-    
-    NodePtr newRoot = std::make_unique<Node>(root->box.merged(node->box), root->parent, std::move(node), std::move(root));
-    root = std::move(newRoot);
 }
 
 template<class T>
-void AABBTree<T>::erase(iterator it)
+void AABBTree<T>::erase(node_id leaf)
 {
-    if (!it->parent) //only node
+    --leaves;
+    node_id parent = nodes[leaf].parent;
+    release(leaf);
+
+    if (parent == null_node) //only node
     {
-        tree.reset();
+        root = null_node;
         return;
     }
     /* Do this:
@@ -139,21 +315,59 @@ void AABBTree<T>::erase(iterator it)
             / \   |
      it -> X   O -+
      */
-    
-    //who owns the parent?
-    NodePtr& parentPtr = !it->parent->parent ? tree :
-        it->parent == it->parent->parent->left().get() ? it->parent->parent->left()
-        : it->parent->parent->right();
-    
-    //detach other child
-    NodePtr otherPtr = std::move(it == it->parent->left().get() ? it->parent->right() : it->parent->left());
-    it = otherPtr.get();
-    it->parent = it->parent->parent;
-    parentPtr = std::move(otherPtr); //replace parent
-    
+    node_id grandParent = nodes[parent].parent;
+    node_id sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+    release(parent);
+
+    nodes[sibling].parent = grandParent;
+    if (grandParent == null_node)
+    {
+        root = sibling;
+        return;
+    }
+    replaceChild(grandParent, parent, sibling);
+
     //refit the boxes
-    for(it = it->parent; it; it = it->parent)
-        it->box = it->left()->box.merged(it->right()->box);
+    for (node_id it = grandParent; it != null_node; it = nodes[it].parent)
+    {
+        refit(it);
+        rotate(it);
+    }
+}
+
+template<class T>
+float AABBTree<T>::cost() const
+{
+    float ret = 0.f;
+    for (const Node& node : nodes)
+        if (node.height > 0)
+            ret += Area(node.box);
+    return ret;
+}
+
+template<class T>
+template<class Hit>
+void AABBTree<T>::raycast(const RayLanes& rays, Hit hit) const
+{
+    if (root != null_node)
+        raycast(root, rays, rays.active, hit);
+}
+
+template<class T>
+template<class Hit>
+void AABBTree<T>::raycast(node_id n, const RayLanes& rays, unsigned active, Hit& hit) const
+{
+    const Node& node = nodes[n];
+    unsigned lanes = RayCast(rays, node.box) & active;
+    if (!lanes)
+        return;
+    if (node.leaf())
+    {
+        hit(node.val, lanes);
+        return;
+    }
+    raycast(node.left, rays, lanes, hit);
+    raycast(node.right, rays, lanes, hit);
 }
 
 //preorder traversal of the portion of the tree that overlaps the query, stopping on leaf nodes
@@ -171,21 +385,21 @@ void AABBTree<T>::query_iterator::backup()
     //ascend until there's a sibling we can switch to
     while (true)
     {
-        if (!current->parent)
+        node_id parent = node(current).parent;
+        if (parent == null_node)
         {
             //done
-            current = nullptr;
+            current = null_node;
             return;
         }
-        else if (current == current->parent->left().get()
-                 && !query->intersection(current->parent->right()->box).isEmpty())
+        else if (current == node(parent).left && overlaps(node(parent).right))
         {
             //switch to the right child
-            current = current->parent->right().get();
+            current = node(parent).right;
             return;
         }
         else //keep backing up
-            current = current->parent;
+            current = parent;
     }
 }
 
@@ -193,12 +407,12 @@ template<class T>
 void AABBTree<T>::query_iterator::search()
 {
     //descend as far as possible, to the left first
-    while (current && !current->leaf())
+    while (current != null_node && !node(current).leaf())
     {
-        if (!query->intersection(current->left()->box).isEmpty())
-            current = current->left().get();
-        else if (!query->intersection(current->right()->box).isEmpty())
-            current = current->right().get();
+        if (overlaps(node(current).left))
+            current = node(current).left;
+        else if (overlaps(node(current).right))
+            current = node(current).right;
         else //stuck, try the next subtree
             backup();
     }
@@ -0,0 +1,137 @@
+#include "stdafx.h"
+#include "CollideBatch.hpp"
+
+#include <algorithm>
+
+OBBLanes::OBBLanes()
+{
+    //keep unused lanes from being garbage (or denormal)
+    std::fill(&axes[0][0], &axes[0][0] + 9 * width, 0.f);
+    std::fill(&origin[0][0], &origin[0][0] + 3 * width, 0.f);
+    std::fill(&extent[0][0], &extent[0][0] + 3 * width, 0.f);
+}
+
+void OBBLanes::Set(int lane, const OBB& obb)
+{
+    for (int i = 0; i < 9; ++i)
+        axes[i][lane] = obb.axes.data()[i];
+    for (int i = 0; i < 3; ++i)
+    {
+        origin[i][lane] = obb.origin[i];
+        extent[i][lane] = obb.extent[i];
+    }
+}
+
+TriangleLanes::TriangleLanes()
+{
+    std::fill(&verts[0][0], &verts[0][0] + 9 * width, 0.f);
+}
+
+void TriangleLanes::Set(int lane, const Triangle& tri)
+{
+    for (int i = 0; i < 9; ++i)
+        verts[i][lane] = tri.data()[i];
+}
+
+static const unsigned allLanes = (1u << SimdFloat::width) - 1;
+
+//Same as the scalar version, see Real Time Collision Detection p 102
+unsigned ConservativeOBBvsOBB(const OBBLanes& l, const OBBLanes& r)
+{
+    SimdFloat la[9], ra[9];
+    for (int i = 0; i < 9; ++i)
+    {
+        la[i] = SimdFloat::Load(l.axes[i]);
+        ra[i] = SimdFloat::Load(r.axes[i]);
+    }
+
+    SimdFloat le[3], re[3], t[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        le[i] = SimdFloat::Load(l.extent[i]);
+        re[i] = SimdFloat::Load(r.extent[i]);
+        t[i] = SimdFloat::Load(r.origin[i]) - SimdFloat::Load(l.origin[i]);
+    }
+
+    //rot = l.axes^T * r.axes, dist = l.axes^T * t
+    SimdFloat rot[3][3], absRot[3][3], dist[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        const SimdFloat* lcol = la + i * 3;
+        dist[i] = lcol[0] * t[0] + lcol[1] * t[1] + lcol[2] * t[2];
+        for (int j = 0; j < 3; ++j)
+        {
+            const SimdFloat* rcol = ra + j * 3;
+            rot[i][j] = lcol[0] * rcol[0] + lcol[1] * rcol[1] + lcol[2] * rcol[2];
+            absRot[i][j] = Abs(rot[i][j]);
+        }
+    }
+
+    //l's axes
+    SimdMask separated = le[0] + absRot[0][0] * re[0] + absRot[0][1] * re[1] + absRot[0][2] * re[2]
+        < Abs(dist[0]);
+    for (int i = 1; i < 3; ++i)
+        separated = separated | (le[i] + absRot[i][0] * re[0] + absRot[i][1] * re[1] + absRot[i][2] * re[2]
+            < Abs(dist[i]));
+
+    //r's axes
+    for (int j = 0; j < 3; ++j)
+    {
+        SimdFloat dist1 = rot[0][j] * dist[0] + rot[1][j] * dist[1] + rot[2][j] * dist[2];
+        separated = separated | (absRot[0][j] * le[0] + absRot[1][j] * le[1] + absRot[2][j] * le[2] + re[j]
+            < Abs(dist1));
+    }
+
+    return ~separated.Bits() & allLanes;
+}
+
+//straddles: whether 'tri' has vertices on both sides of the plane of 'plane'
+//nonDegenerate: whether 'plane' has a normal at all
+static void PlaneTest(const SimdFloat* plane, const SimdFloat* tri,
+                      SimdMask& straddles, SimdMask& nonDegenerate)
+{
+    SimdFloat e1[3], e2[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        e1[i] = plane[3 + i] - plane[i];
+        e2[i] = plane[6 + i] - plane[i];
+    }
+    SimdFloat n[3] = {
+        e1[1] * e2[2] - e1[2] * e2[1],
+        e1[2] * e2[0] - e1[0] * e2[2],
+        e1[0] * e2[1] - e1[1] * e2[0],
+    };
+
+    //same threshold as isZero()
+    SimdFloat eps = 1e-5f;
+    nonDegenerate = (Abs(n[0]) > eps) | (Abs(n[1]) > eps) | (Abs(n[2]) > eps);
+
+    SimdMask side[3];
+    for (int v = 0; v < 3; ++v)
+    {
+        const SimdFloat* vert = tri + v * 3;
+        SimdFloat d = n[0] * (vert[0] - plane[0]) + n[1] * (vert[1] - plane[1]) + n[2] * (vert[2] - plane[2]);
+        side[v] = d > SimdFloat(0.f);
+    }
+    straddles = AndNot(side[0] | side[1] | side[2], side[0] & side[1] & side[2]);
+}
+
+unsigned TrianglePlanesOverlap(const TriangleLanes& l, const TriangleLanes& r)
+{
+    SimdFloat lv[9], rv[9];
+    for (int i = 0; i < 9; ++i)
+    {
+        lv[i] = SimdFloat::Load(l.verts[i]);
+        rv[i] = SimdFloat::Load(r.verts[i]);
+    }
+
+    SimdMask lStraddles, lPlane, rStraddles, rPlane;
+    PlaneTest(lv, rv, lStraddles, lPlane);
+    PlaneTest(rv, lv, rStraddles, rPlane);
+
+    //a degenerate triangle's plane isn't tested, like in ContactPoint,
+    //but at least one must be a proper triangle
+    unsigned lPass = ~AndNot(lPlane, lStraddles).Bits();
+    unsigned rPass = ~AndNot(rPlane, rStraddles).Bits();
+    return lPass & rPass & (lPlane | rPlane).Bits() & allLanes;
+}
@@ -0,0 +1,38 @@
+#ifndef COLLIDE_BATCH_HPP
+#define COLLIDE_BATCH_HPP
+
+#include "Shapes.hpp"
+#include "Utils/Simd.hpp"
+
+//Batch versions of tests in Collide.hpp, which check one pair per SIMD lane.
+//The shapes are stored structure-of-arrays; only the low 'count' bits of the
+//results are meaningful if fewer than 'width' lanes were Set.
+
+struct OBBLanes
+{
+    static const int width = SimdFloat::width;
+    OBBLanes();
+    void Set(int lane, const OBB& obb);
+
+    SimdAlign float axes[9][width]; //column major
+    SimdAlign float origin[3][width];
+    SimdAlign float extent[3][width];
+};
+
+struct TriangleLanes
+{
+    static const int width = SimdFloat::width;
+    TriangleLanes();
+    void Set(int lane, const Triangle& tri);
+
+    SimdAlign float verts[9][width]; //column major
+};
+
+//bit i is set if ConservativeOBBvsOBB is true for lane i
+unsigned ConservativeOBBvsOBB(const OBBLanes& l, const OBBLanes& r);
+
+//bit i is clear if ContactPoint is certainly false for lane i, because one
+//triangle is entirely on one side of the other's plane
+unsigned TrianglePlanesOverlap(const TriangleLanes& l, const TriangleLanes& r);
+
+#endif
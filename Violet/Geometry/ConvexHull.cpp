@@ -0,0 +1,428 @@
+#include "stdafx.h"
+#include "ConvexHull.hpp"
+#include "Gjk.hpp"
+#include "Mesh.hpp"
+#include "Core/Resource.hpp"
+#include "File/BlobFile.hpp"
+#include "File/Filesystem.hpp"
+#include "Utils/Profiling.hpp"
+
+#include "Position.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+#include <iostream>
+
+//shapes this close count as touching, so resting contacts don't flicker
+static const float CONTACT_SLOP = .01f;
+//how thick flat things are
+static const float ZERO_SIZE = .001f;
+//points closer than this (relative to the mesh size) to a face are on it
+static const float HULL_EPSILON = 1e-5f;
+
+//contacts on b's points, and ones found by EPA
+static const std::uint32_t OTHER_FEATURE = 1u << 30;
+static const std::uint32_t DEEPEST_FEATURE = 1u << 31;
+
+struct HullFace
+{
+    int v[3];
+    Vector3f normal;
+    float offset;
+    std::vector<int> outside; //points in front of it
+    bool dead;
+};
+
+//Quickhull: start with a tetrahedron, and repeatedly add the farthest point
+//outside each face, replacing the faces it can see.
+static Mesh Quickhull(const Mesh& mesh)
+{
+    std::vector<Vector3f> cloud;
+    cloud.reserve(mesh.size() * 3);
+    AlignedBox3f box;
+    for (const auto& tri : mesh)
+        for (int i = 0; i < 3; ++i)
+        {
+            cloud.push_back(tri.col(i));
+            box.extend(tri.col(i));
+        }
+    if (cloud.empty())
+        return{};
+    float eps = HULL_EPSILON * std::max(box.diagonal().norm(), ZERO_SIZE);
+
+    //the starting tetrahedron: the farthest pair of extreme points, then the
+    //point farthest from their line, then the one farthest from that plane
+    int i0 = 0, i1 = 0;
+    for (int ax = 0; ax < 3; ++ax)
+    {
+        auto minmax = std::minmax_element(cloud.begin(), cloud.end(),
+            [ax](const Vector3f& l, const Vector3f& r) { return l[ax] < r[ax]; });
+        int lo = static_cast<int>(minmax.first - cloud.begin());
+        int hi = static_cast<int>(minmax.second - cloud.begin());
+        if ((cloud[hi] - cloud[lo]).squaredNorm() > (cloud[i1] - cloud[i0]).squaredNorm())
+            i0 = lo, i1 = hi;
+    }
+    Vector3f line = cloud[i1] - cloud[i0];
+    int i2 = i0;
+    float bestLine = 0;
+    for (int i = 0; i < static_cast<int>(cloud.size()); ++i)
+    {
+        float dist = line.cross(cloud[i] - cloud[i0]).squaredNorm();
+        if (dist > bestLine)
+            bestLine = dist, i2 = i;
+    }
+    Vector3f planeNormal = line.cross(cloud[i2] - cloud[i0]);
+    int i3 = i0;
+    float best = 0;
+    for (int i = 0; i < static_cast<int>(cloud.size()); ++i)
+    {
+        float dist = std::abs(planeNormal.dot(cloud[i] - cloud[i0]));
+        if (dist > best)
+            best = dist, i3 = i;
+    }
+
+    //flat meshes are extruded a bit, once per missing dimension
+    float lineDist = std::sqrt(bestLine) / line.norm(), planeDist = best / planeNormal.norm();
+    if (line.norm() <= eps || lineDist <= eps || planeDist <= eps)
+    {
+        Vector3f dir = planeNormal.normalized();
+        if (line.norm() <= eps)
+            dir = Vector3f::UnitX();
+        else if (lineDist <= eps)
+            dir = line.unitOrthogonal();
+        Mesh thick = mesh;
+        for (const auto& tri : mesh)
+            thick.push_back(tri.colwise() + dir * ZERO_SIZE);
+        return Quickhull(thick);
+    }
+
+    std::vector<HullFace> faces;
+    //each directed edge of a live face, to find its neighbours
+    std::unordered_map<std::uint64_t, std::size_t> edges;
+    auto edge = [](int a, int b) { return std::uint64_t(a) << 32 | std::uint32_t(b); };
+    auto addFace = [&](int a, int b, int c)
+    {
+        HullFace f{ { a, b, c }, Vector3f::Zero(), 0.f, {}, false };
+        f.normal = (cloud[b] - cloud[a]).cross(cloud[c] - cloud[a]).normalized();
+        f.offset = f.normal.dot(cloud[a]);
+        for (int k = 0; k < 3; ++k)
+            edges[edge(f.v[k], f.v[(k + 1) % 3])] = faces.size();
+        faces.push_back(std::move(f));
+    };
+    auto height = [&](const HullFace& f, int i) { return f.normal.dot(cloud[i]) - f.offset; };
+
+    //wind the tetrahedron outward
+    if ((cloud[i1] - cloud[i0]).cross(cloud[i2] - cloud[i0]).dot(cloud[i3] - cloud[i0]) > 0.f)
+        std::swap(i1, i2);
+    addFace(i0, i1, i2);
+    addFace(i0, i3, i1);
+    addFace(i0, i2, i3);
+    addFace(i1, i3, i2);
+
+    auto assign = [&](int pt, std::size_t firstFace)
+    {
+        for (std::size_t f = firstFace; f < faces.size(); ++f)
+            if (height(faces[f], pt) > eps)
+            {
+                faces[f].outside.push_back(pt);
+                return;
+            }
+    };
+    for (int i = 0; i < static_cast<int>(cloud.size()); ++i)
+        assign(i, 0);
+
+    std::vector<std::pair<int, int>> horizon;
+    std::vector<int> orphans;
+    std::vector<std::size_t> visible;
+    auto kill = [&](HullFace& f)
+    {
+        f.dead = true;
+        for (int k = 0; k < 3; ++k)
+            edges.erase(edge(f.v[k], f.v[(k + 1) % 3]));
+        orphans.insert(orphans.end(), f.outside.begin(), f.outside.end());
+        f.outside.clear();
+        f.outside.shrink_to_fit();
+    };
+    //new faces are added to the end, so this visits them too
+    for (std::size_t current = 0; current < faces.size(); ++current)
+    {
+        if (faces[current].dead || faces[current].outside.empty())
+            continue;
+
+        const HullFace& face = faces[current];
+        int eye = *std::max_element(face.outside.begin(), face.outside.end(),
+            [&](int l, int r) { return height(face, l) < height(face, r); });
+
+        //remove the faces the eye can see, walking out from this one so the
+        //hole stays in one piece, and keep the edges around it
+        horizon.clear();
+        orphans.clear();
+        visible.assign(1, current);
+        kill(faces[current]);
+        while (!visible.empty())
+        {
+            HullFace& f = faces[visible.back()];
+            visible.pop_back();
+            for (int k = 0; k < 3; ++k)
+            {
+                int a = f.v[k], b = f.v[(k + 1) % 3];
+                auto across = edges.find(edge(b, a));
+                if (across == edges.end()) //already removed
+                    continue;
+                //no slop here: keeping a face the eye is barely above folds
+                //the hull inward, and leaves points outside it
+                if (height(faces[across->second], eye) > 0.f)
+                {
+                    visible.push_back(across->second);
+                    kill(faces[across->second]);
+                }
+                else
+                    horizon.emplace_back(a, b);
+            }
+        }
+
+        std::size_t firstNew = faces.size();
+        for (const auto& e : horizon)
+            addFace(e.first, e.second, eye);
+        for (int pt : orphans)
+            if (pt != eye)
+                assign(pt, firstNew);
+    }
+
+    Mesh ret;
+    for (const auto& f : faces)
+        if (!f.dead)
+            ret.push_back((Triangle() << cloud[f.v[0]], cloud[f.v[1]], cloud[f.v[2]]).finished());
+    return ret;
+}
+
+struct ConvexHull::Resource : public ::Resource<ConvexHull::Resource>
+{
+    std::vector<Vector3f> points;
+    Planes faces;
+    OBB bound;
+    Resource(std::string file);
+    void Build(const Mesh& mesh);
+    void LoadCache(std::string cacheFile);
+    void SaveCache(std::string cacheFile);
+};
+
+ConvexHull::Resource::Resource(std::string file)
+    : ResourceTy(file)
+    , bound(AlignedBox3f{})
+{
+    //quickhull is slow on big meshes, so keep the result next to the file
+    std::string cacheFile = file + ".hull";
+    if (CacheIsFresh(file, cacheFile))
+    {
+        try
+        {
+            LoadCache(cacheFile);
+            return;
+        }
+        catch (BlobFileException ex)
+        {
+            std::cerr << ex.what() << '\n';
+            points.clear();
+            faces.clear();
+            //fall through
+        }
+    }
+
+    Build(LoadMesh(file));
+    SaveCache(cacheFile);
+}
+
+void ConvexHull::Resource::Build(const Mesh& mesh)
+{
+    auto p = Profile("build hull");
+
+    Mesh hull = Quickhull(mesh);
+    bound = OBB{ hull.begin(), hull.end() };
+
+    for (const auto& tri : hull)
+    {
+        for (int i = 0; i < 3; ++i)
+            points.push_back(tri.col(i));
+
+        //coplanar triangles share a face
+        Vector3f normal = TriNormal(tri).normalized();
+        Vector4f plane;
+        plane << normal, normal.dot(tri.col(0));
+        auto same = std::find_if(faces.begin(), faces.end(), [&](const Vector4f& f)
+        {
+            return (f - plane).cwiseAbs().maxCoeff() < HULL_EPSILON;
+        });
+        if (same == faces.end())
+            faces.push_back(plane);
+    }
+
+    std::sort(points.begin(), points.end(), [](const Vector3f& l, const Vector3f& r)
+    {
+        return std::lexicographical_compare(l.data(), l.data() + 3, r.data(), r.data() + 3);
+    });
+    points.erase(std::unique(points.begin(), points.end()), points.end());
+}
+
+void ConvexHull::Resource::LoadCache(std::string cacheFile)
+{
+    BlobInFile cache(cacheFile, { 'h','u','l','l' }, 1);
+
+    points = cache.ReadVector<Vector3f>();
+    faces = cache.ReadVector<Vector4f, Eigen::aligned_allocator<Vector4f>>();
+    bound.axes = cache.Read<Matrix3f>();
+    bound.origin = cache.Read<Vector3f>();
+    bound.extent = cache.Read<Vector3f>();
+}
+
+void ConvexHull::Resource::SaveCache(std::string cacheFile)
+{
+    BlobOutFile cache(cacheFile, { 'h','u','l','l' }, 1);
+
+    cache.Write(points);
+    cache.Write(faces);
+    cache.Write(bound.axes);
+    cache.Write(bound.origin);
+    cache.Write(bound.extent);
+}
+
+ConvexHull::ConvexHull(std::string file)
+    : resource(Resource::FindOrMake(file))
+{}
+
+std::string ConvexHull::Name() const
+{
+    return resource->Key();
+}
+
+const std::vector<Vector3f>& ConvexHull::Points() const
+{
+    return resource->points;
+}
+
+const ConvexHull::Planes& ConvexHull::Faces() const
+{
+    return resource->faces;
+}
+
+const OBB& ConvexHull::BoundingOBB() const
+{
+    return resource->bound;
+}
+
+bool ConvexHull::Contains(const Vector3f& p, float slop) const
+{
+    for (const Vector4f& f : resource->faces)
+        if (f.head<3>().dot(p) - f.w() > slop)
+            return false;
+    return true;
+}
+
+Vector3f Support(const ConvexHull& hull, const Vector3f& dir)
+{
+    const auto& points = hull.Points();
+    return *std::max_element(points.begin(), points.end(),
+        [&](const Vector3f& l, const Vector3f& r) { return l.dot(dir) < r.dot(dir); });
+}
+
+//Contacts go on the points of either shape which are inside the other, and
+//near the deepest point toward it. If there are none it's edge on edge, so
+//use the deepest points from EPA.
+static float Window(const Penetration& pen)
+{
+    return std::max(pen.depth, 0.f) + 2.f * CONTACT_SLOP;
+}
+
+template<class InB>
+static void AddHullPoints(const ConvexHull& a, const Penetration& pen, InB inB,
+    std::vector<ShapeContact>& out)
+{
+    Vector3f toB = -pen.normal;
+    float reach = Support(a, toB).dot(toB) - Window(pen);
+    const auto& points = a.Points();
+    for (std::uint32_t i = 0; i < points.size(); ++i)
+        if (points[i].dot(toB) >= reach && inB(points[i]))
+            out.push_back({ points[i], pen.normal, i });
+}
+
+template<class PointOfB>
+static void AddOtherPoints(const ConvexHull& a, const Penetration& pen, std::uint32_t count,
+    PointOfB pointOfB, std::vector<ShapeContact>& out)
+{
+    float reach = -std::numeric_limits<float>::max();
+    for (std::uint32_t i = 0; i < count; ++i)
+        reach = std::max(reach, pointOfB(i).dot(pen.normal));
+    reach -= Window(pen);
+    for (std::uint32_t i = 0; i < count; ++i)
+    {
+        Vector3f p = pointOfB(i);
+        if (p.dot(pen.normal) >= reach && a.Contains(p, CONTACT_SLOP))
+            out.push_back({ p, pen.normal, OTHER_FEATURE | i });
+    }
+}
+
+static void AddDeepest(const Penetration& pen, std::size_t start, std::vector<ShapeContact>& out)
+{
+    if (out.size() == start)
+        out.push_back({ (pen.pointA + pen.pointB) / 2.f, pen.normal, DEEPEST_FEATURE });
+}
+
+void Collide(const ConvexHull& a, const ConvexHull& b, const Transform& bPos,
+    std::vector<ShapeContact>& out)
+{
+    Penetration pen;
+    if (!Penetrate(a, Moved<ConvexHull>{ b, bPos }, CONTACT_SLOP, pen))
+        return;
+
+    auto start = out.size();
+    Transform toB = Inverse(bPos);
+    float bSlop = CONTACT_SLOP / bPos.scale;
+    AddHullPoints(a, pen, [&](const Vector3f& p) { return b.Contains(toB * p, bSlop); }, out);
+    AddOtherPoints(a, pen, static_cast<std::uint32_t>(b.Points().size()),
+        [&](std::uint32_t i) { return bPos * b.Points()[i]; }, out);
+    AddDeepest(pen, start, out);
+}
+
+void Collide(const ConvexHull& a, const Primitive& b, std::vector<ShapeContact>& out)
+{
+    Penetration pen;
+    if (!Penetrate(a, b, CONTACT_SLOP, pen))
+        return;
+
+    auto start = out.size();
+    AddHullPoints(a, pen, [&](const Vector3f& p) { return b.Contains(p, CONTACT_SLOP); }, out);
+    if (b.kind == Primitive::Kind::Box)
+    {
+        auto corners = b.Corners();
+        AddOtherPoints(a, pen, 8, [&](std::uint32_t i) { return corners[i]; }, out);
+    }
+    AddDeepest(pen, start, out);
+}
+
+void Collide(const ConvexHull& a, const Triangle& b, std::vector<ShapeContact>& out)
+{
+    Penetration pen;
+    if (!Penetrate(a, b, CONTACT_SLOP, pen))
+        return;
+
+    //points below the triangle's surface, and over the triangle
+    Vector3f triNormal = TriNormal(b);
+    Vector3f up = triNormal.normalized();
+    if (up.dot(pen.normal) < 0.f)
+        up = -up;
+    auto overTri = [&](const Vector3f& p)
+    {
+        if (up.dot(p - b.col(0)) > CONTACT_SLOP)
+            return false;
+        for (int i = 0; i < 3; ++i)
+            if (triNormal.cross(b.col((i + 1) % 3) - b.col(i)).dot(p - b.col(i)) < 0.f)
+                return false;
+        return true;
+    };
+
+    auto start = out.size();
+    AddHullPoints(a, pen, overTri, out);
+    AddOtherPoints(a, pen, 3, [&](std::uint32_t i) { return Vector3f(b.col(i)); }, out);
+    AddDeepest(pen, start, out);
+}
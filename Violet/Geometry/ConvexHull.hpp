@@ -0,0 +1,42 @@
+#ifndef CONVEX_HULL_HPP
+#define CONVEX_HULL_HPP
+
+#include "Shapes.hpp"
+#include "Primitives.hpp"
+
+struct ResourcePersistTag;
+
+//The convex hull of a mesh, built once per file. Convex shapes can use GJK
+//instead of testing triangles.
+class ConvexHull
+{
+    struct Resource;
+public:
+    ConvexHull(std::string file);
+    std::string Name() const;
+
+    const std::vector<Vector3f>& Points() const;
+    //outward normal in xyz, offset in w
+    using Planes = std::vector<Vector4f, Eigen::aligned_allocator<Vector4f>>;
+    const Planes& Faces() const;
+    const OBB& BoundingOBB() const;
+
+    bool Contains(const Vector3f& p, float slop = 0) const;
+
+    using PersistCategory = ResourcePersistTag;
+
+private:
+    std::shared_ptr<Resource> resource;
+};
+
+//the point of the hull farthest along dir
+Vector3f Support(const ConvexHull& hull, const Vector3f& dir);
+
+//These append contacts in a's space if the shapes are touching. The normal
+//points from b to a.
+void Collide(const ConvexHull& a, const ConvexHull& b, const Transform& bPos,
+    std::vector<ShapeContact>& out);
+void Collide(const ConvexHull& a, const Primitive& b, std::vector<ShapeContact>& out);
+void Collide(const ConvexHull& a, const Triangle& b, std::vector<ShapeContact>& out);
+
+#endif
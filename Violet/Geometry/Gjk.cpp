@@ -0,0 +1,377 @@
+#include "stdafx.h"
+#include "Gjk.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+
+using namespace Gjk_detail;
+
+static const int MAX_ITERATIONS = 64;
+//how close the support has to get to the current estimate
+static const float TOLERANCE = 1e-4f;
+//lengths below this are zero
+static const float EPSILON = 1e-6f;
+
+//up to four support points, with the weights of the point closest to the
+//origin
+struct Simplex
+{
+    SupportPoint p[4];
+    float weight[4];
+    int size;
+};
+
+//weights of the closest point to the origin. Ericson, Real-Time Collision Detection
+static void SegmentWeights(const Vector3f& a, const Vector3f& b, float* w)
+{
+    Vector3f ab = b - a;
+    float len2 = ab.squaredNorm();
+    float t = len2 < EPSILON*EPSILON ? 0.f : std::min(std::max(-a.dot(ab) / len2, 0.f), 1.f);
+    w[0] = 1.f - t;
+    w[1] = t;
+}
+
+static void TriangleWeights(const Vector3f& a, const Vector3f& b, const Vector3f& c, float* w)
+{
+    Vector3f ab = b - a, ac = c - a;
+    float d1 = -ab.dot(a), d2 = -ac.dot(a);
+    w[0] = w[1] = w[2] = 0.f;
+    if (d1 <= 0.f && d2 <= 0.f)
+    {
+        w[0] = 1.f;
+        return;
+    }
+    float d3 = -ab.dot(b), d4 = -ac.dot(b);
+    if (d3 >= 0.f && d4 <= d3)
+    {
+        w[1] = 1.f;
+        return;
+    }
+    float vc = d1*d4 - d3*d2;
+    if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f)
+    {
+        w[1] = d1 / (d1 - d3);
+        w[0] = 1.f - w[1];
+        return;
+    }
+    float d5 = -ab.dot(c), d6 = -ac.dot(c);
+    if (d6 >= 0.f && d5 <= d6)
+    {
+        w[2] = 1.f;
+        return;
+    }
+    float vb = d5*d2 - d1*d6;
+    if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f)
+    {
+        w[2] = d2 / (d2 - d6);
+        w[0] = 1.f - w[2];
+        return;
+    }
+    float va = d3*d6 - d5*d4;
+    if (va <= 0.f && d4 - d3 >= 0.f && d5 - d6 >= 0.f)
+    {
+        w[2] = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        w[1] = 1.f - w[2];
+        return;
+    }
+    float denom = va + vb + vc;
+    if (!(denom > 0.f)) //degenerate, fall back to an edge
+    {
+        SegmentWeights(a, b, w);
+        return;
+    }
+    w[1] = vb / denom;
+    w[2] = vc / denom;
+    w[0] = 1.f - w[1] - w[2];
+}
+
+//false if the origin is inside
+static bool TetrahedronWeights(Simplex& s)
+{
+    //three points of each face, then the one opposite it
+    static const int faces[4][4] = { { 0, 1, 2, 3 }, { 0, 3, 1, 2 }, { 0, 2, 3, 1 }, { 1, 3, 2, 0 } };
+
+    float best = std::numeric_limits<float>::max();
+    float bestWeight[4];
+    for (const auto& f : faces)
+    {
+        const Vector3f& a = s.p[f[0]].w, &b = s.p[f[1]].w, &c = s.p[f[2]].w, &d = s.p[f[3]].w;
+        Vector3f n = (b - a).cross(c - a);
+        //the origin is on the same side as the opposite point
+        if (n.dot(-a) * n.dot(d - a) > 0.f)
+            continue;
+
+        float w[3];
+        TriangleWeights(a, b, c, w);
+        float dist = (w[0] * a + w[1] * b + w[2] * c).squaredNorm();
+        if (dist < best)
+        {
+            best = dist;
+            for (int i = 0; i < 3; ++i)
+                bestWeight[f[i]] = w[i];
+            bestWeight[f[3]] = 0.f;
+        }
+    }
+    if (best == std::numeric_limits<float>::max())
+        return false;
+    std::copy(bestWeight, bestWeight + 4, s.weight);
+    return true;
+}
+
+//the closest point to the origin, dropping points that don't contribute to it
+static Vector3f Reduce(Simplex& s)
+{
+    switch (s.size)
+    {
+    case 1: s.weight[0] = 1.f; break;
+    case 2: SegmentWeights(s.p[0].w, s.p[1].w, s.weight); break;
+    case 3: TriangleWeights(s.p[0].w, s.p[1].w, s.p[2].w, s.weight); break;
+    default:
+        if (!TetrahedronWeights(s))
+            return Vector3f::Zero();
+    }
+
+    Vector3f v = Vector3f::Zero();
+    int kept = 0;
+    for (int i = 0; i < s.size; ++i)
+    {
+        if (s.weight[i] <= 0.f)
+            continue;
+        s.p[kept] = s.p[i];
+        s.weight[kept] = s.weight[i];
+        v += s.weight[kept] * s.p[kept].w;
+        ++kept;
+    }
+    s.size = kept;
+    return v;
+}
+
+//true if the shapes are apart, with v the closest point of their Minkowski
+//difference. Otherwise s ends up around the origin.
+static bool Gjk(const SupportFn& support, float margin, Simplex& s, Vector3f& v)
+{
+    s.p[0] = support(Vector3f::UnitX());
+    s.weight[0] = 1.f;
+    s.size = 1;
+    v = s.p[0].w;
+
+    for (int i = 0; i < MAX_ITERATIONS; ++i)
+    {
+        float vv = v.squaredNorm();
+        if (vv < EPSILON*EPSILON)
+            return false;
+
+        SupportPoint p = support(-v);
+        float vp = v.dot(p.w);
+        //there's a separating plane with more than margin on either side
+        if (vp > 0.f && vp*vp > vv * margin*margin)
+            return true;
+        //no more progress
+        if (vv - vp <= TOLERANCE * vv)
+            return true;
+
+        s.p[s.size++] = p;
+        v = Reduce(s);
+        if (s.size == 4)
+            return false;
+    }
+    return true;
+}
+
+//add points until the simplex is a tetrahedron
+static bool BlowUp(const SupportFn& support, Simplex& s)
+{
+    static const Vector3f axes[6] = {
+        Vector3f::UnitX(), -Vector3f::UnitX(),
+        Vector3f::UnitY(), -Vector3f::UnitY(),
+        Vector3f::UnitZ(), -Vector3f::UnitZ() };
+
+    if (s.size == 1)
+        for (const auto& ax : axes)
+        {
+            SupportPoint p = support(ax);
+            if ((p.w - s.p[0].w).squaredNorm() > EPSILON*EPSILON)
+            {
+                s.p[s.size++] = p;
+                break;
+            }
+        }
+
+    if (s.size == 2)
+    {
+        Vector3f d = (s.p[1].w - s.p[0].w).normalized();
+        Vector3f e = d.unitOrthogonal(), f = d.cross(e);
+        for (const Vector3f& dir : { e, f, Vector3f(-e), Vector3f(-f) })
+        {
+            SupportPoint p = support(dir);
+            if (d.cross(p.w - s.p[0].w).squaredNorm() > EPSILON*EPSILON)
+            {
+                s.p[s.size++] = p;
+                break;
+            }
+        }
+    }
+
+    if (s.size == 3)
+    {
+        Vector3f n = (s.p[1].w - s.p[0].w).cross(s.p[2].w - s.p[0].w).normalized();
+        SupportPoint p = support(n);
+        if (std::abs(n.dot(p.w - s.p[0].w)) <= EPSILON)
+            p = support(-n);
+        if (std::abs(n.dot(p.w - s.p[0].w)) > EPSILON)
+            s.p[s.size++] = p;
+    }
+
+    return s.size == 4;
+}
+
+struct Face
+{
+    int v[3];
+    Vector3f normal; //outward
+    float dist;
+    bool dead;
+};
+
+//expand the polytope toward the surface of the Minkowski difference nearest
+//the origin
+static bool Epa(const SupportFn& support, const Simplex& s, Penetration& out)
+{
+    std::vector<SupportPoint> verts(s.p, s.p + 4);
+    std::vector<Face> faces;
+    //each directed edge of a live face, to find its neighbours
+    std::unordered_map<std::uint64_t, std::size_t> edges;
+    auto edge = [](int a, int b) { return std::uint64_t(a) << 32 | std::uint32_t(b); };
+    std::vector<std::pair<int, int>> horizon;
+    std::vector<std::size_t> visible;
+
+    auto addFace = [&](int a, int b, int c)
+    {
+        Face f{ { a, b, c }, Vector3f::Zero(), std::numeric_limits<float>::max(), false };
+        Vector3f n = (verts[b].w - verts[a].w).cross(verts[c].w - verts[a].w);
+        float len = n.norm();
+        if (len > EPSILON*EPSILON) //degenerate faces are never closest
+        {
+            f.normal = n / len;
+            f.dist = f.normal.dot(verts[a].w);
+        }
+        for (int k = 0; k < 3; ++k)
+            edges[edge(f.v[k], f.v[(k + 1) % 3])] = faces.size();
+        faces.push_back(f);
+    };
+    auto kill = [&](Face& f)
+    {
+        f.dead = true;
+        for (int k = 0; k < 3; ++k)
+            edges.erase(edge(f.v[k], f.v[(k + 1) % 3]));
+    };
+    //degenerate faces have no side, so take them out whenever the hole reaches them
+    auto sees = [&](const Face& f, const Vector3f& w)
+    {
+        return f.dist == std::numeric_limits<float>::max()
+            || f.normal.dot(w - verts[f.v[0]].w) > 0.f;
+    };
+
+    //wind the tetrahedron outward
+    if ((verts[1].w - verts[0].w).cross(verts[2].w - verts[0].w).dot(verts[3].w - verts[0].w) > 0.f)
+        std::swap(verts[1], verts[2]);
+    addFace(0, 1, 2);
+    addFace(0, 3, 1);
+    addFace(0, 2, 3);
+    addFace(1, 3, 2);
+
+    const Face* closest = nullptr;
+    for (int i = 0;; ++i)
+    {
+        closest = nullptr;
+        std::size_t closestIdx = 0;
+        for (std::size_t f = 0; f < faces.size(); ++f)
+        {
+            if (!faces[f].dead && (!closest || faces[f].dist < closest->dist))
+            {
+                closest = &faces[f];
+                closestIdx = f;
+            }
+        }
+        if (!closest || closest->dist == std::numeric_limits<float>::max())
+            return false;
+        if (i == MAX_ITERATIONS)
+            break;
+
+        SupportPoint p = support(closest->normal);
+        if (closest->normal.dot(p.w) - closest->dist <= TOLERANCE)
+            break;
+
+        //remove the faces the new point can see, walking out from the
+        //closest one so the hole stays in one piece, and keep the edges
+        //around it
+        int idx = static_cast<int>(verts.size());
+        verts.push_back(p);
+        horizon.clear();
+        visible.assign(1, closestIdx);
+        kill(faces[closestIdx]);
+        while (!visible.empty())
+        {
+            const Face& f = faces[visible.back()];
+            visible.pop_back();
+            for (int k = 0; k < 3; ++k)
+            {
+                int a = f.v[k], b = f.v[(k + 1) % 3];
+                auto across = edges.find(edge(b, a));
+                if (across == edges.end()) //already removed
+                    continue;
+                if (sees(faces[across->second], p.w))
+                {
+                    visible.push_back(across->second);
+                    kill(faces[across->second]);
+                }
+                else
+                    horizon.emplace_back(a, b);
+            }
+        }
+        for (const auto& e : horizon)
+            addFace(e.first, e.second, idx);
+    }
+
+    //where the origin projects onto the face
+    const SupportPoint &a = verts[closest->v[0]], &b = verts[closest->v[1]], &c = verts[closest->v[2]];
+    Vector3f v0 = b.w - a.w, v1 = c.w - a.w, v2 = closest->normal * closest->dist - a.w;
+    float d00 = v0.dot(v0), d01 = v0.dot(v1), d11 = v1.dot(v1);
+    float d20 = v2.dot(v0), d21 = v2.dot(v1);
+    float denom = d00*d11 - d01*d01;
+    float wb = (d11*d20 - d01*d21) / denom, wc = (d00*d21 - d01*d20) / denom;
+    float wa = 1.f - wb - wc;
+
+    out.pointA = wa * a.a + wb * b.a + wc * c.a;
+    out.pointB = wa * a.b + wb * b.b + wc * c.b;
+    out.normal = -closest->normal;
+    out.depth = closest->dist;
+    return true;
+}
+
+bool Gjk_detail::Penetrate(const SupportFn& support, float margin, Penetration& out)
+{
+    Simplex s;
+    Vector3f v;
+    if (Gjk(support, margin, s, v))
+    {
+        float dist = v.norm();
+        if (dist > margin)
+            return false;
+        out.normal = v / dist;
+        out.depth = -dist;
+        out.pointA = out.pointB = Vector3f::Zero();
+        for (int i = 0; i < s.size; ++i)
+        {
+            out.pointA += s.weight[i] * s.p[i].a;
+            out.pointB += s.weight[i] * s.p[i].b;
+        }
+        return true;
+    }
+
+    //the Minkowski difference is flat, so they barely touch
+    if (!BlowUp(support, s))
+        return false;
+    return Epa(support, s, out);
+}
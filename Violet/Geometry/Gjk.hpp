@@ -0,0 +1,63 @@
+#ifndef GJK_HPP
+#define GJK_HPP
+
+#include "Shapes.hpp"
+#include <functional>
+
+struct Transform;
+
+//GJK and EPA work on any convex shape with a support function,
+//  Vector3f Support(const Shape&, const Vector3f& dir)
+//which gives the point of the shape farthest along dir.
+
+struct Penetration
+{
+    //the normal points from b to a. depth is negative if they're apart.
+    Vector3f normal, pointA, pointB;
+    float depth;
+};
+
+namespace Gjk_detail
+{
+    struct SupportPoint
+    {
+        Vector3f w, a, b; //w = a - b
+    };
+    using SupportFn = std::function<SupportPoint(const Vector3f&)>;
+
+    bool Penetrate(const SupportFn& support, float margin, Penetration& out);
+}
+
+inline Vector3f Support(const Triangle& tri, const Vector3f& dir)
+{
+    Triangle::Index i;
+    (tri.transpose() * dir).maxCoeff(&i);
+    return tri.col(i);
+}
+
+//a shape moved by a transform, so it doesn't have to be copied
+template<class Shape>
+struct Moved
+{
+    const Shape& shape;
+    const Transform& xfrm;
+};
+
+template<class Shape>
+Vector3f Support(const Moved<Shape>& m, const Vector3f& dir)
+{
+    return m.xfrm * Support(m.shape, m.xfrm.rot.conjugate() * dir);
+}
+
+//false if the shapes are more than margin apart
+template<class A, class B>
+bool Penetrate(const A& a, const B& b, float margin, Penetration& out)
+{
+    return Gjk_detail::Penetrate([&](const Vector3f& dir)
+    {
+        Vector3f pa = Support(a, dir), pb = Support(b, -dir);
+        return Gjk_detail::SupportPoint{ pa - pb, pa, pb };
+    }, margin, out);
+}
+
+#endif
@@ -0,0 +1,208 @@
+#include "stdafx.h"
+#include "Heightfield.hpp"
+#include "Raycast.hpp"
+#include "Core/Resource.hpp"
+#include "Utils/Profiling.hpp"
+
+#include "stb/stb_image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+//how far up each level of brightness is
+static const float HEIGHT_STEP = .1f;
+
+struct Heightfield::Resource : public ::Resource<Heightfield::Resource>
+{
+    int width, depth;
+    std::vector<float> heights;
+
+    //level 0 has the lowest and highest point of each cell, and each level
+    //after covers 2x2 blocks of the one before, down to one block
+    struct Mip
+    {
+        int width, depth;
+        std::vector<LineSegment> range;
+    };
+    std::vector<Mip> mips;
+
+    Resource(std::string file);
+    void Visit(int level, int x, int y, const Eigen::AlignedBox2i& cells,
+               const AlignedBox3f& box, std::vector<Vector2i>& out) const;
+    float RayVisit(const Heightfield& field, int level, int x, int y,
+                   const Ray& ray, float best, Vector3f& normal) const;
+};
+
+Heightfield::Resource::Resource(std::string file)
+    : ResourceTy(file)
+{
+    auto p = Profile("heightfield load");
+
+    const int grey = 1;
+    int components;
+    std::unique_ptr<unsigned char, decltype(&::stbi_image_free)> data
+        (stbi_load(file.c_str(), &width, &depth, &components, grey), &::stbi_image_free);
+
+    if (!data)
+        throw std::runtime_error("Could not open heightfield '" + file + "', " + stbi_failure_reason());
+    if (width < 2 || depth < 2)
+        throw std::runtime_error("Heightfield '" + file + "' is too small");
+
+    heights.reserve(width * depth);
+    for (int i = 0; i < width * depth; ++i)
+        heights.push_back(data.get()[i] * HEIGHT_STEP);
+
+    Mip cells{ width - 1, depth - 1, {} };
+    for (int y = 0; y < cells.depth; ++y)
+        for (int x = 0; x < cells.width; ++x)
+        {
+            float corners[] = { heights[y * width + x], heights[y * width + x + 1],
+                heights[(y + 1) * width + x], heights[(y + 1) * width + x + 1] };
+            auto minmax = std::minmax_element(std::begin(corners), std::end(corners));
+            cells.range.emplace_back(*minmax.first, *minmax.second);
+        }
+    mips.push_back(std::move(cells));
+
+    while (mips.back().width > 1 || mips.back().depth > 1)
+    {
+        const Mip& prev = mips.back();
+        Mip next{ (prev.width + 1) / 2, (prev.depth + 1) / 2, {} };
+        for (int y = 0; y < next.depth; ++y)
+            for (int x = 0; x < next.width; ++x)
+            {
+                LineSegment range{ std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+                for (int cy = y * 2; cy < std::min(y * 2 + 2, prev.depth); ++cy)
+                    for (int cx = x * 2; cx < std::min(x * 2 + 2, prev.width); ++cx)
+                    {
+                        const LineSegment& child = prev.range[cy * prev.width + cx];
+                        range.first = std::min(range.first, child.first);
+                        range.second = std::max(range.second, child.second);
+                    }
+                next.range.push_back(range);
+            }
+        mips.push_back(std::move(next));
+    }
+}
+
+void Heightfield::Resource::Visit(int level, int x, int y, const Eigen::AlignedBox2i& cells,
+                                  const AlignedBox3f& box, std::vector<Vector2i>& out) const
+{
+    //the cells this block covers
+    Eigen::AlignedBox2i block{ Vector2i{ x, y } * (1 << level), Vector2i{ x + 1, y + 1 } * (1 << level) - Vector2i{ 1, 1 } };
+    if (block.intersection(cells).isEmpty())
+        return;
+
+    const Mip& mip = mips[level];
+    const LineSegment& range = mip.range[y * mip.width + x];
+    if (range.second < box.min().z() || range.first > box.max().z())
+        return;
+
+    if (level == 0)
+    {
+        out.push_back({ x, y });
+        return;
+    }
+
+    const Mip& child = mips[level - 1];
+    for (int cy = y * 2; cy < std::min(y * 2 + 2, child.depth); ++cy)
+        for (int cx = x * 2; cx < std::min(x * 2 + 2, child.width); ++cx)
+            Visit(level - 1, cx, cy, cells, box, out);
+}
+
+float Heightfield::Resource::RayVisit(const Heightfield& field, int level, int x, int y,
+                                      const Ray& ray, float best, Vector3f& normal) const
+{
+    const Mip& mip = mips[level];
+    const LineSegment& range = mip.range[y * mip.width + x];
+    //the block's last cell ends one past it
+    Vector2f lo{ float(x << level), float(y << level) };
+    Vector2f hi{ float(std::min((x + 1) << level, width - 1)), float(std::min((y + 1) << level, depth - 1)) };
+    AlignedBox3f block{ Vector3f{ lo.x(), lo.y(), range.first }, Vector3f{ hi.x(), hi.y(), range.second } };
+
+    Ray shorter = ray;
+    shorter.length = std::min(ray.length, best);
+    if (::RayCast(shorter, block) > shorter.length)
+        return best;
+
+    if (level == 0)
+    {
+        Vector3f n;
+        for (int tri = 0; tri < 2; ++tri)
+        {
+            float t = ::RayCast(shorter, field.CellTriangle(x, y, tri), n);
+            if (t < best)
+                best = t, normal = n;
+        }
+        return best;
+    }
+
+    const Mip& child = mips[level - 1];
+    for (int cy = y * 2; cy < std::min(y * 2 + 2, child.depth); ++cy)
+        for (int cx = x * 2; cx < std::min(x * 2 + 2, child.width); ++cx)
+            best = RayVisit(field, level - 1, cx, cy, ray, best, normal);
+    return best;
+}
+
+Heightfield::Heightfield(std::string file)
+    : resource(Resource::FindOrMake(file))
+{}
+
+std::string Heightfield::Name() const
+{
+    return resource->Key();
+}
+
+int Heightfield::Width() const
+{
+    return resource->width;
+}
+
+int Heightfield::Depth() const
+{
+    return resource->depth;
+}
+
+float Heightfield::Height(int x, int y) const
+{
+    return resource->heights[y * resource->width + x];
+}
+
+Triangle Heightfield::CellTriangle(int x, int y, int tri) const
+{
+    Vector3f corner{ float(x), float(y), Height(x, y) };
+    Vector3f opposite{ float(x + 1), float(y + 1), Height(x + 1, y + 1) };
+    //counterclockwise from above
+    if (tri == 0)
+        return (Triangle() << corner, Vector3f{ float(x + 1), float(y), Height(x + 1, y) }, opposite).finished();
+    else
+        return (Triangle() << corner, opposite, Vector3f{ float(x), float(y + 1), Height(x, y + 1) }).finished();
+}
+
+AlignedBox3f Heightfield::Bound() const
+{
+    const LineSegment& range = resource->mips.back().range[0];
+    return{ Vector3f{ 0, 0, range.first },
+        Vector3f{ float(Width() - 1), float(Depth() - 1), range.second } };
+}
+
+void Heightfield::Overlapping(const AlignedBox3f& box, std::vector<Vector2i>& out) const
+{
+    out.clear();
+    //clamp first so far away boxes don't overflow
+    Vector2f limit{ float(Width()), float(Depth()) };
+    Vector2f lo = box.min().head<2>().cwiseMax(-1.f).cwiseMin(limit);
+    Vector2f hi = box.max().head<2>().cwiseMax(-1.f).cwiseMin(limit);
+    Eigen::AlignedBox2i cells{
+        Vector2i{ int(std::floor(lo.x())), int(std::floor(lo.y())) }.cwiseMax(0),
+        Vector2i{ int(std::floor(hi.x())), int(std::floor(hi.y())) }.cwiseMin(Vector2i{ Width() - 2, Depth() - 2 }) };
+    if (cells.isEmpty())
+        return;
+    resource->Visit(static_cast<int>(resource->mips.size()) - 1, 0, 0, cells, box, out);
+}
+
+float Heightfield::RayCast(const Ray& ray, Vector3f& normal) const
+{
+    return resource->RayVisit(*this, static_cast<int>(resource->mips.size()) - 1, 0, 0,
+        ray, std::numeric_limits<float>::infinity(), normal);
+}
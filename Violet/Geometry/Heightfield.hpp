@@ -0,0 +1,39 @@
+#ifndef HEIGHTFIELD_HPP
+#define HEIGHTFIELD_HPP
+
+#include "Shapes.hpp"
+
+struct ResourcePersistTag;
+struct Ray;
+
+//Terrain as a grid of heights, loaded from an image. Samples are one unit
+//apart along x and y, and each level of brightness is a tenth of a unit up.
+//The triangles are implicit, two per cell.
+class Heightfield
+{
+    struct Resource;
+public:
+    Heightfield(std::string file);
+    std::string Name() const;
+
+    //samples along x and y. There's one less cell each way.
+    int Width() const;
+    int Depth() const;
+    float Height(int x, int y) const;
+    //triangle 0 or 1 of the cell with corner (x, y)
+    Triangle CellTriangle(int x, int y, int tri) const;
+
+    AlignedBox3f Bound() const;
+    //cells whose heights might overlap the box, using the min/max mips to
+    //skip the rest
+    void Overlapping(const AlignedBox3f& box, std::vector<Vector2i>& out) const;
+    //distance to the first hit along the ray, or infinity, walking the mips
+    float RayCast(const Ray& ray, Vector3f& normal) const;
+
+    using PersistCategory = ResourcePersistTag;
+
+private:
+    std::shared_ptr<Resource> resource;
+};
+
+#endif
@@ -0,0 +1,563 @@
+#include "stdafx.h"
+#include "Primitives.hpp"
+
+#include "Position.hpp"
+
+#include <algorithm>
+#include <limits>
+
+//shapes this close count as touching, so resting contacts don't flicker
+static const float CONTACT_SLOP = .01f;
+//squared distances below this are zero
+static const float EPSILON = 1e-10f;
+//contacts of one pair closer than this are the same contact
+static const float SAME_CONTACT = .05f;
+
+Primitive::Primitive(Kind kind, const Vector3f& size)
+    : kind(kind), size(size), center(Vector3f::Zero()), rot(Quaternionf::Identity())
+{}
+
+Vector3f Primitive::CoreA() const
+{
+    if (kind == Kind::Capsule)
+        return center - rot * Vector3f{ 0, 0, size.y() };
+    return center;
+}
+
+Vector3f Primitive::CoreB() const
+{
+    if (kind == Kind::Capsule)
+        return center + rot * Vector3f{ 0, 0, size.y() };
+    return center;
+}
+
+OBB Primitive::BoundingOBB() const
+{
+    Vector3f extent;
+    if (kind == Kind::Sphere)
+        extent = Vector3f::Constant(size.x());
+    else if (kind == Kind::Capsule)
+        extent = { size.x(), size.x(), size.x() + size.y() };
+    else
+        extent = size;
+
+    OBB ret{ AlignedBox3f{ -extent, extent } };
+    ret.axes = rot.matrix();
+    ret.origin = center;
+    return ret;
+}
+
+Primitive operator*(const Transform& xfrm, Primitive prim)
+{
+    prim.center = xfrm * prim.center;
+    prim.rot = xfrm.rot * prim.rot;
+    prim.size *= xfrm.scale;
+    return prim;
+}
+
+//Closest points
+
+static float Clamp01(float f)
+{
+    return std::min(std::max(f, 0.f), 1.f);
+}
+
+static Vector3f ClosestOnSegment(const Vector3f& p, const Vector3f& a, const Vector3f& b)
+{
+    Vector3f ab = b - a;
+    float len = ab.squaredNorm();
+    if (len < EPSILON)
+        return a;
+    return a + ab * Clamp01((p - a).dot(ab) / len);
+}
+
+//Ericson, Real-Time Collision Detection 5.1.9
+static void ClosestSegmentSegment(const Vector3f& p1, const Vector3f& q1,
+    const Vector3f& p2, const Vector3f& q2, Vector3f& c1, Vector3f& c2)
+{
+    Vector3f d1 = q1 - p1, d2 = q2 - p2, r = p1 - p2;
+    float a = d1.squaredNorm(), e = d2.squaredNorm(), f = d2.dot(r);
+    float s, t;
+
+    if (a < EPSILON && e < EPSILON)
+        s = t = 0.f;
+    else if (a < EPSILON)
+    {
+        s = 0.f;
+        t = Clamp01(f / e);
+    }
+    else
+    {
+        float c = d1.dot(r);
+        if (e < EPSILON)
+        {
+            t = 0.f;
+            s = Clamp01(-c / a);
+        }
+        else
+        {
+            float b = d1.dot(d2);
+            float denom = a*e - b*b;
+            s = denom > 0.f ? Clamp01((b*f - c*e) / denom) : 0.f;
+            t = (b*s + f) / e;
+            if (t < 0.f)
+            {
+                t = 0.f;
+                s = Clamp01(-c / a);
+            }
+            else if (t > 1.f)
+            {
+                t = 1.f;
+                s = Clamp01((b - c) / a);
+            }
+        }
+    }
+
+    c1 = p1 + d1*s;
+    c2 = p2 + d2*t;
+}
+
+//Ericson 5.1.5
+static Vector3f ClosestOnTriangle(const Vector3f& p, const Triangle& t)
+{
+    Vector3f a = t.col(0), b = t.col(1), c = t.col(2);
+    Vector3f ab = b - a, ac = c - a;
+
+    Vector3f ap = p - a;
+    float d1 = ab.dot(ap), d2 = ac.dot(ap);
+    if (d1 <= 0.f && d2 <= 0.f)
+        return a;
+
+    Vector3f bp = p - b;
+    float d3 = ab.dot(bp), d4 = ac.dot(bp);
+    if (d3 >= 0.f && d4 <= d3)
+        return b;
+
+    float vc = d1*d4 - d3*d2;
+    if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f)
+        return a + ab * (d1 / (d1 - d3));
+
+    Vector3f cp = p - c;
+    float d5 = ab.dot(cp), d6 = ac.dot(cp);
+    if (d6 >= 0.f && d5 <= d6)
+        return c;
+
+    float vb = d5*d2 - d1*d6;
+    if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f)
+        return a + ac * (d2 / (d2 - d6));
+
+    float va = d3*d6 - d5*d4;
+    if (va <= 0.f && d4 - d3 >= 0.f && d5 - d6 >= 0.f)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    float sum = va + vb + vc;
+    if (sum <= 0.f) //degenerate
+        return a;
+    return a + ab * (vb / sum) + ac * (vc / sum);
+}
+
+static void ClosestSegmentTriangle(const Vector3f& p, const Vector3f& q, const Triangle& tri,
+    Vector3f& onSeg, Vector3f& onTri)
+{
+    //does it go through?
+    Vector3f n = TriNormal(tri);
+    float dp = n.dot(p - tri.col(0)), dq = n.dot(q - tri.col(0));
+    if (dp * dq < 0.f)
+    {
+        Vector3f x = p + (q - p) * (dp / (dp - dq));
+        if ((ClosestOnTriangle(x, tri) - x).squaredNorm() < EPSILON)
+        {
+            onSeg = onTri = x;
+            return;
+        }
+    }
+
+    float best = std::numeric_limits<float>::max();
+    auto consider = [&](const Vector3f& s, const Vector3f& t)
+    {
+        float dist = (s - t).squaredNorm();
+        if (dist < best)
+        {
+            best = dist;
+            onSeg = s;
+            onTri = t;
+        }
+    };
+
+    consider(p, ClosestOnTriangle(p, tri));
+    consider(q, ClosestOnTriangle(q, tri));
+    for (int i = 0; i < 3; ++i)
+    {
+        Vector3f s, t;
+        ClosestSegmentSegment(p, q, tri.col(i), tri.col((i + 1) % 3), s, t);
+        consider(s, t);
+    }
+}
+
+//in the box's space
+static Vector3f BoxLocal(const Primitive& box, const Vector3f& p)
+{
+    return box.rot.conjugate() * (p - box.center);
+}
+
+static Vector3f ClosestOnBox(const Vector3f& p, const Primitive& box)
+{
+    Vector3f local = BoxLocal(box, p).cwiseMax(-box.size).cwiseMin(box.size);
+    return box.center + box.rot * local;
+}
+
+static bool InBox(const Vector3f& p, const Primitive& box)
+{
+    return (BoxLocal(box, p).cwiseAbs() - box.size).maxCoeff() <= CONTACT_SLOP;
+}
+
+//The squared distance to the box along the segment is a quadratic between
+//the places the segment crosses the box's face planes, so the closest point
+//is the best of each piece's minimum. Where the segment goes through the
+//box, the point nearest the center is used.
+static void ClosestSegmentBox(const Vector3f& p, const Vector3f& q, const Primitive& box,
+    Vector3f& onSeg, Vector3f& onBox)
+{
+    Vector3f lp = BoxLocal(box, p), d = BoxLocal(box, q) - lp;
+
+    float cuts[8];
+    int numCuts = 0;
+    cuts[numCuts++] = 0.f;
+    for (int i = 0; i < 3; ++i)
+    {
+        if (d[i] * d[i] < EPSILON)
+            continue;
+        for (float plane : { -box.size[i], box.size[i] })
+        {
+            float t = (plane - lp[i]) / d[i];
+            if (t > 0.f && t < 1.f)
+                cuts[numCuts++] = t;
+        }
+    }
+    cuts[numCuts++] = 1.f;
+    std::sort(cuts, cuts + numCuts);
+
+    float len = d.squaredNorm();
+    float center = len < EPSILON ? 0.f : Clamp01(-lp.dot(d) / len);
+    float best = std::numeric_limits<float>::max();
+    for (int c = 0; c + 1 < numCuts; ++c)
+    {
+        //which faces it's outside of is the same over the whole piece
+        float t0 = cuts[c], t1 = cuts[c + 1], mid = (t0 + t1) / 2.f;
+        float a = 0.f, b = 0.f;
+        bool inside = true;
+        for (int i = 0; i < 3; ++i)
+        {
+            float x = lp[i] + mid * d[i];
+            if (x > box.size[i] || x < -box.size[i])
+            {
+                float off = lp[i] - (x > 0.f ? box.size[i] : -box.size[i]);
+                a += d[i] * d[i];
+                b += off * d[i];
+                inside = false;
+            }
+        }
+        float t = a < EPSILON ? center : -b / a;
+        t = std::min(std::max(t, t0), t1);
+        if (inside)
+        {
+            onSeg = onBox = p + (q - p) * t;
+            return;
+        }
+
+        Vector3f s = p + (q - p) * t, onB = ClosestOnBox(s, box);
+        float dist = (s - onB).squaredNorm();
+        if (dist < best)
+        {
+            best = dist;
+            onSeg = s;
+            onBox = onB;
+        }
+    }
+}
+
+std::array<Vector3f, 8> Primitive::Corners() const
+{
+    std::array<Vector3f, 8> ret;
+    for (int i = 0; i < 8; ++i)
+    {
+        Vector3f sign{ i & 1 ? 1.f : -1.f, i & 2 ? 1.f : -1.f, i & 4 ? 1.f : -1.f };
+        ret[i] = center + rot * size.cwiseProduct(sign);
+    }
+    return ret;
+}
+
+bool Primitive::Contains(const Vector3f& p, float slop) const
+{
+    if (kind == Kind::Box)
+        return (BoxLocal(*this, p).cwiseAbs() - size).maxCoeff() <= slop;
+    float r = Radius() + slop;
+    return (ClosestOnSegment(p, CoreA(), CoreB()) - p).squaredNorm() <= r*r;
+}
+
+Vector3f Support(const Primitive& prim, const Vector3f& dir)
+{
+    if (prim.kind == Primitive::Kind::Box)
+    {
+        Vector3f local = prim.rot.conjugate() * dir;
+        Vector3f sign{ local.x() < 0 ? -1.f : 1.f, local.y() < 0 ? -1.f : 1.f, local.z() < 0 ? -1.f : 1.f };
+        return prim.center + prim.rot * prim.size.cwiseProduct(sign);
+    }
+    Vector3f a = prim.CoreA(), b = prim.CoreB();
+    Vector3f core = a.dot(dir) > b.dot(dir) ? a : b;
+    float len = dir.norm();
+    if (len * len < EPSILON)
+        return core;
+    return core + dir * (prim.Radius() / len);
+}
+
+static LineSegment ProjectBox(const Primitive& box, const Vector3f& ax)
+{
+    Matrix3f axes = box.rot.matrix();
+    float c = box.center.dot(ax);
+    float r = (axes.transpose() * ax).cwiseAbs().dot(box.size);
+    return{ c - r, c + r };
+}
+
+static LineSegment ProjectTri(const Triangle& t, const Vector3f& ax)
+{
+    Vector3f proj = t.transpose() * ax;
+    return{ proj.minCoeff(), proj.maxCoeff() };
+}
+
+//Separating axis test which also finds the axis of least overlap, pointing
+//from b to a
+template<class ProjA, class ProjB>
+static bool LeastOverlap(const Vector3f* axes, int count, ProjA projA, ProjB projB, Vector3f& normal)
+{
+    float best = std::numeric_limits<float>::max();
+    for (int i = 0; i < count; ++i)
+    {
+        if (axes[i].squaredNorm() < EPSILON)
+            continue; //parallel edges
+        Vector3f ax = axes[i].normalized();
+        LineSegment a = projA(ax), b = projB(ax);
+        float overlap = std::min(a.second, b.second) - std::max(a.first, b.first);
+        if (overlap < -CONTACT_SLOP)
+            return false;
+        if (overlap < best)
+        {
+            best = overlap;
+            normal = a.first + a.second > b.first + b.second ? ax : Vector3f{ -ax };
+        }
+    }
+    return true;
+}
+
+//Pair tests. Spheres and capsules are both "round", a sphere swept along a
+//(possibly empty) segment.
+
+static void AddRound(const Vector3f& onA, float ra, const Vector3f& onB, float rb,
+    const Vector3f& fallbackNormal, std::uint32_t feature, std::vector<ShapeContact>& out)
+{
+    Vector3f d = onA - onB;
+    float dist = d.norm();
+    if (dist > ra + rb + CONTACT_SLOP)
+        return;
+    Vector3f normal = dist * dist > EPSILON ? Vector3f{ d / dist } : fallbackNormal;
+    //halfway between the surfaces
+    out.push_back({ ((onA - normal*ra) + (onB + normal*rb)) / 2.f, normal, feature });
+}
+
+//AddRound, unless the pair already has a contact (after 'start') about there
+static void AddRoundEnd(const Vector3f& onA, float ra, const Vector3f& onB, float rb,
+    const Vector3f& fallbackNormal, std::uint32_t feature, std::size_t start,
+    std::vector<ShapeContact>& out)
+{
+    std::size_t end = out.size();
+    AddRound(onA, ra, onB, rb, fallbackNormal, feature, out);
+    if (out.size() == end)
+        return;
+    for (std::size_t i = start; i < end; ++i)
+    {
+        if ((out[i].point - out.back().point).squaredNorm() < SAME_CONTACT * SAME_CONTACT)
+        {
+            out.pop_back();
+            return;
+        }
+    }
+}
+
+static void RoundVsRound(const Primitive& a, const Primitive& b, std::vector<ShapeContact>& out)
+{
+    Vector3f a0 = a.CoreA(), a1 = a.CoreB(), b0 = b.CoreA(), b1 = b.CoreB();
+    Vector3f up = Vector3f::UnitZ();
+    std::size_t start = out.size();
+
+    Vector3f onA, onB;
+    ClosestSegmentSegment(a0, a1, b0, b1, onA, onB);
+    AddRound(onA, a.Radius(), onB, b.Radius(), up, 0, out);
+
+    //capsules lying along each other touch at the ends too
+    if (a.kind == Primitive::Kind::Capsule)
+    {
+        AddRoundEnd(a0, a.Radius(), ClosestOnSegment(a0, b0, b1), b.Radius(), up, 1, start, out);
+        AddRoundEnd(a1, a.Radius(), ClosestOnSegment(a1, b0, b1), b.Radius(), up, 2, start, out);
+    }
+    if (b.kind == Primitive::Kind::Capsule)
+    {
+        AddRoundEnd(ClosestOnSegment(b0, a0, a1), a.Radius(), b0, b.Radius(), up, 3, start, out);
+        AddRoundEnd(ClosestOnSegment(b1, a0, a1), a.Radius(), b1, b.Radius(), up, 4, start, out);
+    }
+}
+
+//the box face the point is closest to getting out of
+static Vector3f BoxFaceNormal(const Primitive& box, const Vector3f& p)
+{
+    Vector3f local = BoxLocal(box, p);
+    Vector3f::Index axis;
+    (box.size - local.cwiseAbs()).minCoeff(&axis);
+    Vector3f normal = Vector3f::Zero();
+    normal[axis] = local[axis] < 0.f ? -1.f : 1.f;
+    return box.rot * normal;
+}
+
+static void RoundVsBox(const Primitive& a, const Primitive& b, std::vector<ShapeContact>& out)
+{
+    Vector3f a0 = a.CoreA(), a1 = a.CoreB();
+    Vector3f onA, onB;
+    std::size_t start = out.size();
+    ClosestSegmentBox(a0, a1, b, onA, onB);
+    AddRound(onA, a.Radius(), onB, 0.f, BoxFaceNormal(b, onA), 0, out);
+
+    if (a.kind == Primitive::Kind::Capsule)
+    {
+        AddRoundEnd(a0, a.Radius(), ClosestOnBox(a0, b), 0.f, BoxFaceNormal(b, a0), 1, start, out);
+        AddRoundEnd(a1, a.Radius(), ClosestOnBox(a1, b), 0.f, BoxFaceNormal(b, a1), 2, start, out);
+    }
+}
+
+static void BoxVsBox(const Primitive& a, const Primitive& b, std::vector<ShapeContact>& out)
+{
+    Matrix3f aAxes = a.rot.matrix(), bAxes = b.rot.matrix();
+    Vector3f axes[15];
+    for (int i = 0; i < 3; ++i)
+    {
+        axes[i] = aAxes.col(i);
+        axes[3 + i] = bAxes.col(i);
+        for (int j = 0; j < 3; ++j)
+            axes[6 + i * 3 + j] = aAxes.col(i).cross(bAxes.col(j));
+    }
+
+    Vector3f normal;
+    if (!LeastOverlap(axes, 15,
+        [&](const Vector3f& ax) { return ProjectBox(a, ax); },
+        [&](const Vector3f& ax) { return ProjectBox(b, ax); }, normal))
+        return;
+
+    //corners poking into the other box
+    auto start = out.size();
+    auto aCorners = a.Corners(), bCorners = b.Corners();
+    for (std::uint32_t i = 0; i < 8; ++i)
+    {
+        if (InBox(aCorners[i], b))
+            out.push_back({ aCorners[i], normal, i });
+        if (InBox(bCorners[i], a))
+            out.push_back({ bCorners[i], normal, 8 + i });
+    }
+
+    //edge on edge
+    if (out.size() == start)
+    {
+        Vector3f onA = ClosestOnBox(b.center, a);
+        Vector3f onB = ClosestOnBox(onA, b);
+        out.push_back({ (ClosestOnBox(onB, a) + onB) / 2.f, normal, 16 });
+    }
+}
+
+void Collide(const Primitive& a, const Primitive& b, std::vector<ShapeContact>& out)
+{
+    using Kind = Primitive::Kind;
+    if (a.kind != Kind::Box && b.kind != Kind::Box)
+        RoundVsRound(a, b, out);
+    else if (a.kind != Kind::Box)
+        RoundVsBox(a, b, out);
+    else if (b.kind != Kind::Box)
+    {
+        auto start = out.size();
+        RoundVsBox(b, a, out);
+        for (auto c = out.begin() + start; c != out.end(); ++c)
+            c->normal = -c->normal;
+    }
+    else
+        BoxVsBox(a, b, out);
+}
+
+static void RoundVsTriangle(const Primitive& a, const Triangle& tri, std::vector<ShapeContact>& out)
+{
+    Vector3f a0 = a.CoreA(), a1 = a.CoreB();
+    Vector3f triNormal = TriNormal(tri).normalized();
+    if (triNormal.dot((a0 + a1) / 2.f - tri.col(0)) < 0.f)
+        triNormal = -triNormal;
+
+    Vector3f onA, onB;
+    ClosestSegmentTriangle(a0, a1, tri, onA, onB);
+    AddRound(onA, a.Radius(), onB, 0.f, triNormal, 0, out);
+
+    if (a.kind == Primitive::Kind::Capsule)
+    {
+        AddRound(a0, a.Radius(), ClosestOnTriangle(a0, tri), 0.f, triNormal, 1, out);
+        AddRound(a1, a.Radius(), ClosestOnTriangle(a1, tri), 0.f, triNormal, 2, out);
+    }
+}
+
+static void BoxVsTriangle(const Primitive& a, const Triangle& tri, std::vector<ShapeContact>& out)
+{
+    Matrix3f boxAxes = a.rot.matrix();
+    Vector3f triNormal = TriNormal(tri);
+    Vector3f axes[13];
+    axes[0] = triNormal;
+    for (int i = 0; i < 3; ++i)
+    {
+        axes[1 + i] = boxAxes.col(i);
+        for (int j = 0; j < 3; ++j)
+            axes[4 + i * 3 + j] = boxAxes.col(i).cross(tri.col((j + 1) % 3) - tri.col(j));
+    }
+
+    Vector3f normal;
+    if (!LeastOverlap(axes, 13,
+        [&](const Vector3f& ax) { return ProjectBox(a, ax); },
+        [&](const Vector3f& ax) { return ProjectTri(tri, ax); }, normal))
+        return;
+
+    auto start = out.size();
+
+    //corners below the triangle's surface, and over the triangle
+    triNormal.normalize();
+    if (triNormal.dot(a.center - tri.col(0)) < 0.f)
+        triNormal = -triNormal;
+    auto corners = a.Corners();
+    for (std::uint32_t i = 0; i < 8; ++i)
+    {
+        float height = triNormal.dot(corners[i] - tri.col(0));
+        Vector3f onPlane = corners[i] - triNormal * height;
+        if (height <= CONTACT_SLOP && (ClosestOnTriangle(onPlane, tri) - onPlane).squaredNorm() < EPSILON)
+            out.push_back({ corners[i], normal, i });
+    }
+
+    //triangle corners in the box
+    for (std::uint32_t i = 0; i < 3; ++i)
+        if (InBox(tri.col(i), a))
+            out.push_back({ tri.col(i), normal, 8 + i });
+
+    //edge on edge
+    if (out.size() == start)
+    {
+        Vector3f onTri = ClosestOnTriangle(a.center, tri);
+        Vector3f onBox = ClosestOnBox(onTri, a);
+        out.push_back({ (ClosestOnTriangle(onBox, tri) + onBox) / 2.f, normal, 16 });
+    }
+}
+
+void Collide(const Primitive& a, const Triangle& b, std::vector<ShapeContact>& out)
+{
+    if (a.kind == Primitive::Kind::Box)
+        BoxVsTriangle(a, b, out);
+    else
+        RoundVsTriangle(a, b, out);
+}
@@ -0,0 +1,60 @@
+#ifndef PRIMITIVES_HPP
+#define PRIMITIVES_HPP
+
+#include "Shapes.hpp"
+#include <cstdint>
+
+struct BinaryPersistTag;
+
+//Simple convex shapes with closed form collision tests
+struct Primitive
+{
+    enum class Kind : std::int32_t
+    {
+        Sphere,
+        Capsule, //a sphere swept along z
+        Box,
+    };
+
+    //sphere: radius in x. capsule: radius in x, and half the length of the
+    //swept segment in y. box: half extents.
+    Primitive(Kind kind = Kind::Sphere, const Vector3f& size = Vector3f{ .5f, 0, 0 });
+
+    Kind kind;
+    Vector3f size;
+    Vector3f center;
+    Quaternionf rot;
+
+    //the segment swept by the sphere of a sphere or capsule
+    Vector3f CoreA() const;
+    Vector3f CoreB() const;
+    float Radius() const { return size.x(); }
+
+    //the eight corners of a box
+    std::array<Vector3f, 8> Corners() const;
+    bool Contains(const Vector3f& p, float slop = 0) const;
+
+    OBB BoundingOBB() const;
+    AlignedBox3f Bound() const { return BoundingOBB().Bound(); }
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    using PersistCategory = BinaryPersistTag;
+};
+
+Primitive operator*(const Transform& xfrm, Primitive prim);
+//the point of the shape farthest along dir
+Vector3f Support(const Primitive& prim, const Vector3f& dir);
+
+//A contact between two convex shapes. The normal points from the second
+//shape to the first, and the feature tells contacts on the same pair apart.
+struct ShapeContact
+{
+    Vector3f point, normal;
+    std::uint32_t feature;
+};
+
+//These append contacts if the shapes are touching
+void Collide(const Primitive& a, const Primitive& b, std::vector<ShapeContact>& out);
+void Collide(const Primitive& a, const Triangle& b, std::vector<ShapeContact>& out);
+
+#endif
@@ -0,0 +1,213 @@
+#include "stdafx.h"
+#include "Raycast.hpp"
+#include "Primitives.hpp"
+
+#include "Position.hpp"
+
+#include <algorithm>
+#include <limits>
+
+static const float MISS = std::numeric_limits<float>::infinity();
+//keeps 1/dir finite
+static const float MIN_DIR = 1e-20f;
+
+static float SafeInverse(float d)
+{
+    return 1.f / (std::abs(d) < MIN_DIR ? std::copysign(MIN_DIR, d) : d);
+}
+
+Ray operator*(const Transform& xfrm, Ray ray)
+{
+    ray.origin = xfrm * ray.origin;
+    ray.dir = xfrm.rot * ray.dir;
+    ray.length *= xfrm.scale;
+    return ray;
+}
+
+Vector3f RayEnd(const Ray& ray)
+{
+    Vector3f end = ray.origin;
+    for (int i = 0; i < 3; ++i)
+        if (ray.dir[i] != 0.f)
+            end[i] += ray.dir[i] * ray.length;
+    return end;
+}
+
+//slab test, with the axis the ray enters through
+static float RayBox(const Vector3f& origin, const Vector3f& dir, float length,
+    const Vector3f& min, const Vector3f& max, int& axis)
+{
+    float tmin = 0.f, tmax = length;
+    axis = -1;
+    for (int i = 0; i < 3; ++i)
+    {
+        float inv = SafeInverse(dir[i]);
+        float t1 = (min[i] - origin[i]) * inv, t2 = (max[i] - origin[i]) * inv;
+        if (t1 > t2)
+            std::swap(t1, t2);
+        if (t1 > tmin)
+        {
+            tmin = t1;
+            axis = i;
+        }
+        tmax = std::min(tmax, t2);
+        if (tmin > tmax)
+            return MISS;
+    }
+    return tmin;
+}
+
+float RayCast(const Ray& ray, const AlignedBox3f& box)
+{
+    int axis;
+    return RayBox(ray.origin, ray.dir, ray.length, box.min(), box.max(), axis);
+}
+
+float RayCast(const Ray& ray, const OBB& obb)
+{
+    int axis;
+    Vector3f origin = obb.axes.transpose() * (ray.origin - obb.origin);
+    Vector3f dir = obb.axes.transpose() * ray.dir;
+    return RayBox(origin, dir, ray.length, -obb.extent, obb.extent, axis);
+}
+
+//Moller-Trumbore, from either side
+float RayCast(const Ray& ray, const Triangle& tri, Vector3f& normal)
+{
+    Vector3f e1 = tri.col(1) - tri.col(0), e2 = tri.col(2) - tri.col(0);
+    Vector3f p = ray.dir.cross(e2);
+    float det = e1.dot(p);
+    if (std::abs(det) < 1e-12f)
+        return MISS;
+
+    float inv = 1.f / det;
+    Vector3f s = ray.origin - tri.col(0);
+    float u = s.dot(p) * inv;
+    if (u < 0.f || u > 1.f)
+        return MISS;
+    Vector3f q = s.cross(e1);
+    float v = ray.dir.dot(q) * inv;
+    if (v < 0.f || u + v > 1.f)
+        return MISS;
+    float t = e2.dot(q) * inv;
+    if (t < 0.f || t > ray.length)
+        return MISS;
+
+    normal = e1.cross(e2).normalized();
+    if (normal.dot(ray.dir) > 0.f)
+        normal = -normal;
+    return t;
+}
+
+static float RaySphere(const Ray& ray, const Vector3f& center, float radius, Vector3f& normal)
+{
+    Vector3f oc = ray.origin - center;
+    float b = oc.dot(ray.dir);
+    float c = oc.squaredNorm() - radius*radius;
+    float h = b*b - c;
+    if (h < 0.f)
+        return MISS;
+    float t = -b - std::sqrt(h);
+    if (t < 0.f || t > ray.length)
+        return MISS;
+    normal = (oc + ray.dir * t) / radius;
+    return t;
+}
+
+//the side of the cylinder around the core, see Inigo Quilez's intersectors
+static float RayCylinder(const Ray& ray, const Vector3f& a, const Vector3f& b, float radius,
+    Vector3f& normal)
+{
+    Vector3f ba = b - a, oa = ray.origin - a;
+    float baba = ba.squaredNorm(), bard = ba.dot(ray.dir), baoa = ba.dot(oa);
+    float k2 = baba - bard*bard;
+    if (k2 < 1e-12f) //parallel to the core, so only the caps matter
+        return MISS;
+    float k1 = baba * oa.dot(ray.dir) - baoa * bard;
+    float k0 = baba * oa.squaredNorm() - baoa*baoa - radius*radius*baba;
+    float h = k1*k1 - k2*k0;
+    if (h < 0.f)
+        return MISS;
+    float t = (-k1 - std::sqrt(h)) / k2;
+    float y = baoa + t * bard;
+    if (t < 0.f || t > ray.length || y < 0.f || y > baba)
+        return MISS;
+    normal = (oa + t * ray.dir - ba * (y / baba)) / radius;
+    return t;
+}
+
+float RayCast(const Ray& ray, const Primitive& prim, Vector3f& normal)
+{
+    if (prim.Contains(ray.origin))
+    {
+        normal = -ray.dir;
+        return 0.f;
+    }
+
+    if (prim.kind == Primitive::Kind::Box)
+    {
+        int axis;
+        Quaternionf toLocal = prim.rot.conjugate();
+        Vector3f origin = toLocal * (ray.origin - prim.center), dir = toLocal * ray.dir;
+        float t = RayBox(origin, dir, ray.length, -prim.size, prim.size, axis);
+        if (t != MISS)
+        {
+            Vector3f local = Vector3f::Zero();
+            if (axis < 0)
+                local = -dir;
+            else
+                local[axis] = dir[axis] > 0.f ? -1.f : 1.f;
+            normal = prim.rot * local;
+        }
+        return t;
+    }
+
+    Vector3f n;
+    float best = RaySphere(ray, prim.CoreA(), prim.Radius(), normal);
+    if (prim.kind == Primitive::Kind::Capsule)
+    {
+        float t = RaySphere(ray, prim.CoreB(), prim.Radius(), n);
+        if (t < best)
+            best = t, normal = n;
+        t = RayCylinder(ray, prim.CoreA(), prim.CoreB(), prim.Radius(), n);
+        if (t < best)
+            best = t, normal = n;
+    }
+    return best;
+}
+
+RayLanes::RayLanes()
+    : active(0)
+{
+    //keep unused lanes from being garbage (or denormal)
+    std::fill(&origin[0][0], &origin[0][0] + 3 * width, 0.f);
+    std::fill(&invDir[0][0], &invDir[0][0] + 3 * width, 1.f);
+    std::fill(length, length + width, 0.f);
+}
+
+void RayLanes::Set(int lane, const Ray& ray)
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        origin[i][lane] = ray.origin[i];
+        invDir[i][lane] = SafeInverse(ray.dir[i]);
+    }
+    length[lane] = ray.length;
+    active |= 1u << lane;
+    bound.extend(ray.origin);
+    bound.extend(RayEnd(ray));
+}
+
+unsigned RayCast(const RayLanes& rays, const AlignedBox3f& box)
+{
+    SimdFloat tmin = 0.f, tmax = SimdFloat::Load(rays.length);
+    for (int i = 0; i < 3; ++i)
+    {
+        SimdFloat origin = SimdFloat::Load(rays.origin[i]), inv = SimdFloat::Load(rays.invDir[i]);
+        SimdFloat t1 = (SimdFloat(box.min()[i]) - origin) * inv;
+        SimdFloat t2 = (SimdFloat(box.max()[i]) - origin) * inv;
+        tmin = Max(tmin, Min(t1, t2));
+        tmax = Min(tmax, Max(t1, t2));
+    }
+    return ~(tmin > tmax).Bits() & rays.active;
+}
@@ -0,0 +1,48 @@
+#ifndef RAYCAST_HPP
+#define RAYCAST_HPP
+
+#include "Shapes.hpp"
+#include "Utils/Simd.hpp"
+
+struct Primitive;
+struct Transform;
+
+//The segment from origin to origin + dir * length. dir is normalized, and
+//length can be infinite.
+struct Ray
+{
+    Vector3f origin, dir;
+    float length;
+};
+
+Ray operator*(const Transform& xfrm, Ray ray);
+//origin + dir * length, but without NaNs for infinite rays: those stay put on
+//the axes they don't move along
+Vector3f RayEnd(const Ray& ray);
+
+//These give the distance along the ray to the first hit, or infinity if there
+//isn't one within its length. Shapes are solid, so rays starting inside hit
+//at 0. Normals face the ray.
+float RayCast(const Ray& ray, const AlignedBox3f& box);
+float RayCast(const Ray& ray, const OBB& obb);
+float RayCast(const Ray& ray, const Triangle& tri, Vector3f& normal);
+float RayCast(const Ray& ray, const Primitive& prim, Vector3f& normal);
+
+//A packet of rays, one per SIMD lane, to walk trees together
+struct RayLanes
+{
+    static const int width = SimdFloat::width;
+    RayLanes();
+    void Set(int lane, const Ray& ray);
+
+    SimdAlign float origin[3][width];
+    SimdAlign float invDir[3][width];
+    SimdAlign float length[width];
+    unsigned active; //bit i is set if lane i has a ray
+    AlignedBox3f bound; //of all the rays
+};
+
+//bit i is set if ray i hits the box
+unsigned RayCast(const RayLanes& rays, const AlignedBox3f& box);
+
+#endif
@@ -104,7 +104,7 @@ Matrix3f InertiaTensor(const OBB& obb, Vector3f centerOfMass)
 OBB operator*(const Transform& xfrm, OBB obb)
 {
     obb.axes = xfrm.rot.matrix() * obb.axes;
-    obb.origin = xfrm.pos + xfrm.rot.matrix() * obb.origin;
+    obb.origin = xfrm * obb.origin;
     obb.extent *= xfrm.scale;
     return obb;
 }
@@ -5,6 +5,7 @@
 #include "Editor/Edit.hpp"
 #include "Core/Time.hpp"
 #include "Rendering/RenderPasses.hpp"
+#include "Rendering/GLState.hpp"
 #include "File/Persist.hpp"
 #include "UI/PixelDraw.hpp"
 #include "Editor/Console.hpp"
@@ -29,6 +30,16 @@ try
 	std::srand(static_cast<unsigned int>(std::time(nullptr)));
 	Profile::CalibrateProfiling();
 
+#ifdef BROADPHASE_BENCHMARK
+    BroadPhaseBenchmark();
+    Profile::Print();
+    return EXIT_SUCCESS;
+#endif
+
+#ifdef OCCLUSION_CHECK
+    return OcclusionCheck() ? EXIT_SUCCESS : EXIT_FAILURE;
+#endif
+
     auto initProf = Profile("init");
     
 	ComponentManager mgr;
@@ -45,9 +56,16 @@ try
 	Collision collision(position, passes);
 	RigidBody rigidBody(position, collision, passes);
 
+#ifdef ALLOCATION_CHECK
+#ifndef COUNT_ALLOCATIONS
+#error "The allocation check needs COUNT_ALLOCATIONS to count anything"
+#endif
+    return RigidBodyAllocationCheck(position, collision, rigidBody) ? EXIT_SUCCESS : EXIT_FAILURE;
+#endif
+
 	Edit edit(r, passes, position, objName, collision, rigidBody, mgr, persist);
 
-    Scripting script(mgr);
+    Scripting script(mgr, collision);
     Console console(script, persist);
 
 	mgr.Register(&position);
@@ -101,6 +119,7 @@ try
     t.MainLoop(physTick, renderTick);
     
 	Profile::Print();
+	GLState::PrintCounts();
 
     return EXIT_SUCCESS;
 }
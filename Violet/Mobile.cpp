@@ -3,11 +3,11 @@
 
 #include "Eigen/Core"
 
-Matrix4f Mobile::interp(const Transform& before, const Transform& loc, float alpha)
+Transform Mobile::interp(const Transform& before, const Transform& loc, float alpha)
 {
-	return (
-		Eigen::Translation3f((1 - alpha)*before.pos + alpha*loc.pos)
-		* before.rot.slerp(alpha, loc.rot)
-		* Eigen::Scaling((1 - alpha)*before.scale + alpha*loc.scale)
-		).matrix();
+	Transform ret;
+	ret.pos = (1 - alpha)*before.pos + alpha*loc.pos;
+	ret.rot = before.rot.slerp(alpha, loc.rot);
+	ret.scale = (1 - alpha)*before.scale + alpha*loc.scale;
+	return ret;
 }
\ No newline at end of file
@@ -1,7 +1,7 @@
 #ifndef MOBILE_HPP
 #define MOBILE_HPP
 
-#include "Containers/l_map.hpp"
+#include <unordered_map>
 #include "Position.hpp"
 
 class Mobile
@@ -9,34 +9,30 @@ class Mobile
 public:
 	Mobile(Position& p) : position(p) {}
 
+	//instances can be in any order, and can change order between updates
 	template<typename iter>
 	void Update(float alpha, iter begin, iter end)
 	{
-		auto dat = data.begin();
-		for (;begin != end; ++begin, ++dat)
+		for (;begin != end; ++begin)
 		{
 			auto newXfrm = position.Get(begin->obj);
-			if (dat == data.end() || begin->obj != dat->first) //wrong object
-			{
-				auto it = data.find(begin->obj);
-				if (it == data.end()) //just added
-					dat = data.try_emplace(dat, begin->obj, newXfrm).first;
-				else //just removed
-				{
-					dat = data.erase(dat);
-					continue;
-				}
-			}
-			begin->mat = interp(dat->second, newXfrm, alpha);
-			dat->second = newXfrm;
+			auto it = data.find(begin->obj);
+			if (it == data.end()) //just added, start where it is
+				it = data.emplace(begin->obj, newXfrm).first;
+			auto& before = it->second;
+			*begin = interp(before, newXfrm, alpha);
+			before = newXfrm;
 		}
 	}
 
+	void Remove(Object obj) { data.erase(obj); }
+
 private:
-	static Matrix4f interp(const Transform& before, const Transform& loc, float alpha);
+	static Transform interp(const Transform& before, const Transform& loc, float alpha);
 
 	Position& position;
-	l_map<Object, Transform, std::less<Object>, Eigen::aligned_allocator<std::pair<Object, Transform>>> data;
+	std::unordered_map<Object, Transform, std::hash<Object>, std::equal_to<Object>,
+		Eigen::aligned_allocator<std::pair<const Object, Transform>>> data;
 };
 
 #endif
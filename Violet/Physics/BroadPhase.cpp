@@ -0,0 +1,492 @@
+#include "stdafx.h"
+#include "BroadPhase.hpp"
+
+#include "Utils/Profiling.hpp"
+
+#include <algorithm>
+#include <random>
+#include <iostream>
+#include <cmath>
+
+AlignedBox3f BroadPhase::Loosen(const AlignedBox3f& box) const
+{
+    Vector3f size = box.sizes() * margin;
+    return{ box.min() - size, box.max() + size };
+}
+
+void BroadPhase::UpdatePairs()
+{
+    if (carried)
+        carried = false;
+    else
+    {
+        beginOverlap.clear();
+        endOverlap.clear();
+    }
+    FindPairs();
+}
+
+void BroadPhase::CarryOver(const BroadPhase& old)
+{
+    beginOverlap.clear();
+    endOverlap.clear();
+    for (const auto& pair : pairs)
+        if (!old.pairs.count(pair))
+            beginOverlap.push_back(pair);
+    for (const auto& pair : old.pairs)
+        if (!pairs.count(pair))
+            endOverlap.push_back(pair);
+    carried = true;
+}
+
+void BroadPhase::AddPair(Object a, Object b)
+{
+    ObjectPair pair{ std::min(a, b), std::max(a, b) };
+    if (pairs.insert(pair).second)
+    {
+        beginOverlap.push_back(pair);
+        partners[a].push_back(b);
+        partners[b].push_back(a);
+    }
+}
+
+void BroadPhase::RemovePair(Object a, Object b)
+{
+    ObjectPair pair{ std::min(a, b), std::max(a, b) };
+    if (pairs.erase(pair))
+    {
+        endOverlap.push_back(pair);
+        auto& ofA = partners[a];
+        ofA.erase(std::find(ofA.begin(), ofA.end(), b));
+        auto& ofB = partners[b];
+        ofB.erase(std::find(ofB.begin(), ofB.end(), a));
+    }
+}
+
+void BroadPhase::RemovePairs(Object obj)
+{
+    moved.erase(std::remove(moved.begin(), moved.end(), obj), moved.end());
+
+    auto it = partners.find(obj);
+    if (it == partners.end())
+        return;
+    for (Object other : it->second)
+    {
+        pairs.erase(ObjectPair{ std::min(obj, other), std::max(obj, other) });
+        auto& ofOther = partners[other];
+        ofOther.erase(std::find(ofOther.begin(), ofOther.end(), obj));
+    }
+    partners.erase(it);
+}
+
+void BroadPhase::QueryRays(const RayLanes& rays, std::vector<std::pair<Object, unsigned>>& out) const
+{
+    std::vector<Object> inBound;
+    Query(rays.bound, inBound);
+    for (Object obj : inBound)
+        if (unsigned lanes = RayCast(rays, LooseBound(obj)))
+            out.emplace_back(obj, lanes);
+}
+
+void BroadPhase::FindMovedPairs()
+{
+    if (moved.empty())
+        return;
+    std::sort(moved.begin(), moved.end());
+    moved.erase(std::unique(moved.begin(), moved.end()), moved.end());
+
+    //pairs can only separate if one of them moved
+    for (Object obj : moved)
+    {
+        auto it = partners.find(obj);
+        if (it == partners.end())
+            continue;
+        separated.clear();
+        for (Object other : it->second)
+            if (LooseBound(obj).intersection(LooseBound(other)).isEmpty())
+                separated.push_back(other);
+        for (Object other : separated)
+            RemovePair(obj, other);
+    }
+
+    //and only those can start overlapping
+    for (Object obj : moved)
+    {
+        queryResult.clear();
+        Query(LooseBound(obj), queryResult);
+        for (Object other : queryResult)
+            if (other != obj)
+                AddPair(obj, other);
+    }
+    moved.clear();
+}
+
+//Tree
+
+void TreeBroadPhase::Insert(Object obj, const AlignedBox3f& bound)
+{
+    leaves.try_emplace(obj, tree.insert(Loosen(bound), obj));
+    moved.push_back(obj);
+}
+
+void TreeBroadPhase::Update(Object obj, const AlignedBox3f& bound)
+{
+    auto& leaf = leaves[obj];
+    if (!tree.box(leaf).contains(bound))
+    {
+        tree.erase(leaf);
+        leaf = tree.insert(Loosen(bound), obj);
+        moved.push_back(obj);
+    }
+}
+
+void TreeBroadPhase::Remove(Object obj)
+{
+    tree.erase(leaves[obj]);
+    leaves.erase(obj);
+    RemovePairs(obj);
+}
+
+const AlignedBox3f& TreeBroadPhase::LooseBound(Object obj) const
+{
+    return tree.box(leaves.at(obj));
+}
+
+void TreeBroadPhase::Query(const AlignedBox3f& box, std::vector<Object>& out) const
+{
+    for (auto it = tree.query(box); it != tree.query_end(); ++it)
+        out.push_back(*it);
+}
+
+void TreeBroadPhase::QueryRays(const RayLanes& rays, std::vector<std::pair<Object, unsigned>>& out) const
+{
+    tree.raycast(rays, [&](Object obj, unsigned lanes) { out.emplace_back(obj, lanes); });
+}
+
+void TreeBroadPhase::FindPairs()
+{
+    FindMovedPairs();
+}
+
+//Sweep and prune
+
+void SweepBroadPhase::Insert(Object obj, const AlignedBox3f& bound)
+{
+    std::uint32_t proxy;
+    if (freeProxies.empty())
+    {
+        proxy = static_cast<std::uint32_t>(proxies.size());
+        proxies.emplace_back();
+    }
+    else
+    {
+        proxy = freeProxies.back();
+        freeProxies.pop_back();
+    }
+
+    Proxy& p = proxies[proxy];
+    p.obj = obj;
+    p.loose = Loosen(bound);
+
+    //the next sort will move the endpoints into place
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        for (std::uint32_t isMax = 0; isMax < 2; ++isMax)
+        {
+            p.ends[axis][isMax] = static_cast<std::uint32_t>(axes[axis].size());
+            axes[axis].push_back({ 0.f, proxy, isMax });
+        }
+    }
+    SetEndpoints(proxy);
+    proxyOf[obj] = proxy;
+}
+
+void SweepBroadPhase::SetEndpoints(std::uint32_t proxy)
+{
+    const Proxy& p = proxies[proxy];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        axes[axis][p.ends[axis][0]].value = p.loose.min()[axis];
+        axes[axis][p.ends[axis][1]].value = p.loose.max()[axis];
+    }
+}
+
+void SweepBroadPhase::Update(Object obj, const AlignedBox3f& bound)
+{
+    std::uint32_t proxy = proxyOf.at(obj);
+    if (!proxies[proxy].loose.contains(bound))
+    {
+        proxies[proxy].loose = Loosen(bound);
+        SetEndpoints(proxy);
+    }
+}
+
+void SweepBroadPhase::Remove(Object obj)
+{
+    std::uint32_t proxy = proxyOf.at(obj);
+    const Proxy& p = proxies[proxy];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        //the proxy knows where its endpoints are, so only the ones after
+        //them need their indexes fixed
+        auto& a = axes[axis];
+        std::uint32_t min = p.ends[axis][0], max = p.ends[axis][1];
+        a.erase(a.begin() + max);
+        a.erase(a.begin() + min);
+        for (std::uint32_t i = min; i < a.size(); ++i)
+            proxies[a[i].proxy].ends[axis][a[i].isMax] = i;
+    }
+
+    freeProxies.push_back(proxy);
+    proxyOf.erase(obj);
+    RemovePairs(obj);
+}
+
+const AlignedBox3f& SweepBroadPhase::LooseBound(Object obj) const
+{
+    return proxies[proxyOf.at(obj)].loose;
+}
+
+void SweepBroadPhase::Query(const AlignedBox3f& box, std::vector<Object>& out) const
+{
+    for (const auto& p : proxyOf)
+        if (!proxies[p.second].loose.intersection(box).isEmpty())
+            out.push_back(p.first);
+}
+
+void SweepBroadPhase::Sort(int axis)
+{
+    auto& a = axes[axis];
+    for (std::uint32_t i = 1; i < a.size(); ++i)
+    {
+        Endpoint e = a[i];
+        std::uint32_t j = i;
+        for (; j > 0 && a[j - 1].value > e.value; --j)
+        {
+            const Endpoint& f = a[j - 1];
+            const Proxy& ep = proxies[e.proxy];
+            const Proxy& fp = proxies[f.proxy];
+
+            //a min passing a max to the left might start an overlap,
+            //the other way around ends one
+            if (!e.isMax && f.isMax)
+            {
+                if (!ep.loose.intersection(fp.loose).isEmpty())
+                    AddPair(ep.obj, fp.obj);
+            }
+            else if (e.isMax && !f.isMax)
+                RemovePair(ep.obj, fp.obj);
+
+            a[j] = f;
+            proxies[f.proxy].ends[axis][f.isMax] = j;
+        }
+        a[j] = e;
+        proxies[e.proxy].ends[axis][e.isMax] = j;
+    }
+}
+
+void SweepBroadPhase::FindPairs()
+{
+    for (int axis = 0; axis < 3; ++axis)
+        Sort(axis);
+}
+
+//Grid
+
+std::uint64_t GridBroadPhase::Key(std::int32_t x, std::int32_t y, std::int32_t z)
+{
+    //21 bits per axis, wrapping around
+    const std::uint64_t mask = (1 << 21) - 1;
+    return (std::uint64_t(x) & mask) << 42 | (std::uint64_t(y) & mask) << 21 | (std::uint64_t(z) & mask);
+}
+
+GridBroadPhase::CellRange GridBroadPhase::Cells(const AlignedBox3f& box) const
+{
+    CellRange ret;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        ret.min()[axis] = static_cast<std::int32_t>(std::floor(box.min()[axis] / cellSize));
+        ret.max()[axis] = static_cast<std::int32_t>(std::floor(box.max()[axis] / cellSize));
+    }
+    return ret;
+}
+
+template<class F>
+void GridBroadPhase::ForCells(const CellRange& range, F f) const
+{
+    for (std::int32_t x = range.min().x(); x <= range.max().x(); ++x)
+        for (std::int32_t y = range.min().y(); y <= range.max().y(); ++y)
+            for (std::int32_t z = range.min().z(); z <= range.max().z(); ++z)
+                f(Key(x, y, z));
+}
+
+void GridBroadPhase::Insert(Object obj, const AlignedBox3f& bound)
+{
+    Entry entry;
+    entry.loose = Loosen(bound);
+    entry.cells = Cells(entry.loose);
+    ForCells(entry.cells, [&](std::uint64_t key) { cells[key].push_back(obj); });
+    extent.extend(entry.loose);
+
+    entries.try_emplace(obj, entry);
+    moved.push_back(obj);
+}
+
+void GridBroadPhase::Update(Object obj, const AlignedBox3f& bound)
+{
+    Entry& entry = entries[obj];
+    if (entry.loose.contains(bound))
+        return;
+
+    entry.loose = Loosen(bound);
+    extent.extend(entry.loose);
+    CellRange newCells = Cells(entry.loose);
+    if (newCells.min() != entry.cells.min() || newCells.max() != entry.cells.max())
+    {
+        ForCells(entry.cells, [&](std::uint64_t key)
+        {
+            auto& cell = cells[key];
+            cell.erase(std::find(cell.begin(), cell.end(), obj));
+        });
+        entry.cells = newCells;
+        ForCells(entry.cells, [&](std::uint64_t key) { cells[key].push_back(obj); });
+        moved.push_back(obj);
+    }
+    else
+        stayed.push_back(obj);
+}
+
+void GridBroadPhase::Remove(Object obj)
+{
+    ForCells(entries[obj].cells, [&](std::uint64_t key)
+    {
+        auto& cell = cells[key];
+        cell.erase(std::find(cell.begin(), cell.end(), obj));
+        if (cell.empty())
+            cells.erase(key);
+    });
+    entries.erase(obj);
+    stayed.erase(std::remove(stayed.begin(), stayed.end(), obj), stayed.end());
+    RemovePairs(obj);
+}
+
+const AlignedBox3f& GridBroadPhase::LooseBound(Object obj) const
+{
+    return entries.at(obj).loose;
+}
+
+void GridBroadPhase::Query(const AlignedBox3f& box, std::vector<Object>& out) const
+{
+    AlignedBox3f clamped = box.intersection(extent);
+    if (clamped.isEmpty())
+        return;
+
+    auto start = out.size();
+    ForCells(Cells(clamped), [&](std::uint64_t key)
+    {
+        auto cell = cells.find(key);
+        if (cell == cells.end())
+            return;
+        for (Object obj : cell->second)
+            if (!entries.at(obj).loose.intersection(box).isEmpty())
+                out.push_back(obj);
+    });
+
+    //objects in several cells show up several times
+    std::sort(out.begin() + start, out.end());
+    out.erase(std::unique(out.begin() + start, out.end()), out.end());
+}
+
+void GridBroadPhase::FindStayedPairs()
+{
+    for (Object obj : stayed)
+    {
+        const Entry& entry = entries.at(obj);
+        //the old bound was in these cells too, so every old partner is here
+        ForCells(entry.cells, [&](std::uint64_t key)
+        {
+            for (Object other : cells.at(key))
+            {
+                if (other == obj)
+                    continue;
+                if (entry.loose.intersection(entries.at(other).loose).isEmpty())
+                    RemovePair(obj, other);
+                else
+                    AddPair(obj, other);
+            }
+        });
+    }
+    stayed.clear();
+}
+
+void GridBroadPhase::FindPairs()
+{
+    FindStayedPairs();
+    FindMovedPairs();
+}
+
+//Benchmark
+
+void BroadPhaseBenchmark()
+{
+    struct Scene
+    {
+        int count;
+        float worldSize, minSize, maxSize;
+        //Profile names, for tree, sweep, and grid
+        const char* names[3];
+    };
+
+    static const Scene scenes[] = {
+        //many equal-size bodies
+        { 10000, 100.f, 1.f, 1.f, { "uniform tree", "uniform sweep", "uniform grid" } },
+        //sparse large world
+        { 2000, 5000.f, .5f, 20.f, { "sparse tree", "sparse sweep", "sparse grid" } },
+        //dense pile
+        { 5000, 20.f, .2f, 3.f, { "pile tree", "pile sweep", "pile grid" } },
+    };
+
+    const int ticks = 60;
+
+    for (const Scene& scene : scenes)
+    {
+        for (int backend = 0; backend < 3; ++backend)
+        {
+            std::unique_ptr<BroadPhase> broad;
+            if (backend == 0)
+                broad = std::make_unique<TreeBroadPhase>();
+            else if (backend == 1)
+                broad = std::make_unique<SweepBroadPhase>();
+            else
+                broad = std::make_unique<GridBroadPhase>((scene.minSize + scene.maxSize));
+
+            //same scene for every backend
+            std::mt19937 gen(1234);
+            std::uniform_real_distribution<float> place(0.f, scene.worldSize);
+            std::uniform_real_distribution<float> size(scene.minSize, scene.maxSize);
+            std::uniform_real_distribution<float> jitter(-.05f, .05f);
+
+            std::vector<AlignedBox3f> boxes;
+            for (int i = 0; i < scene.count; ++i)
+            {
+                Vector3f min{ place(gen), place(gen), place(gen) };
+                boxes.emplace_back(min, min + Vector3f::Constant(size(gen)));
+                broad->Insert(Object(i), boxes.back());
+            }
+            broad->UpdatePairs();
+
+            for (int tick = 0; tick < ticks; ++tick)
+            {
+                for (auto& box : boxes)
+                    box.translate(Vector3f{ jitter(gen), jitter(gen), jitter(gen) } * box.sizes().x());
+
+                Profile p(scene.names[backend]);
+                for (int i = 0; i < scene.count; ++i)
+                    broad->Update(Object(i), boxes[i]);
+                broad->UpdatePairs();
+            }
+
+            std::cout << scene.names[backend] << ": " << broad->Pairs().size() << " pairs\n";
+        }
+    }
+}
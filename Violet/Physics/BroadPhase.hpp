@@ -0,0 +1,179 @@
+#ifndef BROAD_PHASE_HPP
+#define BROAD_PHASE_HPP
+
+#include "Core/Object.hpp"
+#include "Geometry/Shapes.hpp"
+#include "Geometry/AABB.hpp"
+#include "Containers/l_unordered_map.hpp"
+#include "Utils/Template.hpp"
+
+#include <unordered_set>
+#include <unordered_map>
+#include <cstdint>
+
+using ObjectPair = std::pair<Object, Object>;
+
+//Finds pairs of objects whose bounds overlap. Each object gets a loose bound,
+//which is its tight bound grown by 'margin' times its size, and only has to be
+//updated when the tight bound leaves it.
+class BroadPhase
+{
+public:
+    BroadPhase(float margin) : margin(margin), carried(false) {}
+    virtual ~BroadPhase() {}
+
+    virtual void Insert(Object, const AlignedBox3f& bound) = 0;
+    virtual void Update(Object, const AlignedBox3f& bound) = 0;
+    virtual void Remove(Object) = 0;
+    virtual const AlignedBox3f& LooseBound(Object) const = 0;
+    //append objects whose loose bounds overlap box
+    virtual void Query(const AlignedBox3f& box, std::vector<Object>& out) const = 0;
+    //append objects whose loose bounds some of the rays hit, with the lanes
+    //that hit them. By default this queries the packet's bound.
+    virtual void QueryRays(const RayLanes& rays, std::vector<std::pair<Object, unsigned>>& out) const;
+
+    //find pairs which started or stopped overlapping since the last call
+    void UpdatePairs();
+    //take over from another broad phase holding the same objects, once this
+    //one has found its pairs. The next UpdatePairs reports only the pairs
+    //which differ between the two.
+    void CarryOver(const BroadPhase& old);
+
+    //overlapping pairs, ordered (lesser, greater)
+    const std::unordered_set<ObjectPair>& Pairs() const { return pairs; }
+    const std::vector<ObjectPair>& BeginOverlap() const { return beginOverlap; }
+    const std::vector<ObjectPair>& EndOverlap() const { return endOverlap; }
+
+protected:
+    AlignedBox3f Loosen(const AlignedBox3f& box) const;
+    void AddPair(Object a, Object b);
+    void RemovePair(Object a, Object b);
+    //forget a removed object, its pairs end without an end overlap
+    void RemovePairs(Object);
+
+    //for backends that can query: refind pairs for objects in 'moved'
+    void FindMovedPairs();
+    std::vector<Object> moved;
+
+    const float margin;
+
+private:
+    virtual void FindPairs() = 0;
+
+    std::unordered_set<ObjectPair> pairs;
+    //what each object overlaps, so only moved objects' pairs are looked at
+    std::unordered_map<Object, std::vector<Object>> partners;
+    std::vector<ObjectPair> beginOverlap, endOverlap;
+    bool carried; //keep the overlaps from CarryOver through one update
+    std::vector<Object> queryResult, separated;
+};
+
+//Incremental AABB tree. Good all around, and the only choice for large worlds
+//that are mostly empty.
+class TreeBroadPhase : public BroadPhase
+{
+public:
+    TreeBroadPhase(float margin = .1f) : BroadPhase(margin) {}
+
+    void Insert(Object, const AlignedBox3f& bound) override;
+    void Update(Object, const AlignedBox3f& bound) override;
+    void Remove(Object) override;
+    const AlignedBox3f& LooseBound(Object) const override;
+    void Query(const AlignedBox3f& box, std::vector<Object>& out) const override;
+    void QueryRays(const RayLanes& rays, std::vector<std::pair<Object, unsigned>>& out) const override;
+
+    const AABBTree<Object>& Tree() const { return tree; }
+
+private:
+    void FindPairs() override;
+
+    AABBTree<Object> tree;
+    l_unordered_map<Object, AABBTree<Object>::node_id> leaves;
+};
+
+//Sweep and prune on all three axes. Endpoints are kept sorted by insertion
+//sort, which is nearly linear when objects move a little each tick, and
+//overlaps are found from the swaps. Queries are linear in the number of
+//objects.
+class SweepBroadPhase : public BroadPhase
+{
+public:
+    SweepBroadPhase(float margin = .1f) : BroadPhase(margin) {}
+
+    void Insert(Object, const AlignedBox3f& bound) override;
+    void Update(Object, const AlignedBox3f& bound) override;
+    void Remove(Object) override;
+    const AlignedBox3f& LooseBound(Object) const override;
+    void Query(const AlignedBox3f& box, std::vector<Object>& out) const override;
+
+private:
+    void FindPairs() override;
+
+    struct Endpoint
+    {
+        float value;
+        std::uint32_t proxy : 31;
+        std::uint32_t isMax : 1;
+    };
+
+    struct Proxy
+    {
+        Object obj;
+        AlignedBox3f loose;
+        std::uint32_t ends[3][2]; //index of each endpoint in its axis
+    };
+
+    void Sort(int axis);
+    void SetEndpoints(std::uint32_t proxy);
+
+    std::vector<Endpoint> axes[3];
+    std::vector<Proxy> proxies;
+    std::vector<std::uint32_t> freeProxies;
+    std::unordered_map<Object, std::uint32_t> proxyOf;
+};
+
+//Hashed uniform grid. Best when objects are all about the same size as a cell.
+class GridBroadPhase : public BroadPhase
+{
+public:
+    GridBroadPhase(float cellSize = 2.f, float margin = .1f)
+        : BroadPhase(margin), cellSize(cellSize) {}
+
+    void Insert(Object, const AlignedBox3f& bound) override;
+    void Update(Object, const AlignedBox3f& bound) override;
+    void Remove(Object) override;
+    const AlignedBox3f& LooseBound(Object) const override;
+    void Query(const AlignedBox3f& box, std::vector<Object>& out) const override;
+
+private:
+    void FindPairs() override;
+
+    using CellRange = Eigen::AlignedBox<std::int32_t, 3>;
+    CellRange Cells(const AlignedBox3f& box) const;
+    static std::uint64_t Key(std::int32_t x, std::int32_t y, std::int32_t z);
+
+    template<class F>
+    void ForCells(const CellRange& range, F f) const;
+
+    struct Entry
+    {
+        AlignedBox3f loose;
+        CellRange cells;
+    };
+
+    //objects whose loose bound changed but stayed in the same cells. Their
+    //pairs can only change with the other objects in those cells.
+    void FindStayedPairs();
+    std::vector<Object> stayed;
+
+    const float cellSize;
+    //around everything ever inserted, so infinite queries visit finitely many cells
+    AlignedBox3f extent;
+    std::unordered_map<std::uint64_t, std::vector<Object>> cells;
+    l_unordered_map<Object, Entry> entries;
+};
+
+//time each backend on some generated scenes, see Profile::Print
+void BroadPhaseBenchmark();
+
+#endif
@@ -3,28 +3,49 @@
 #include "File/Persist.hpp"
 #include "Position.hpp"
 #include "Geometry/Collide.hpp"
+#include "Geometry/Gjk.hpp"
 
 #include "Utils/Template.hpp"
+#include "Utils/Parallel.hpp"
+#include "Utils/Profiling.hpp"
 #include "Rendering/RenderPasses.hpp"
 
 #include <iostream>
 #include <queue>
 #include <random>
+#include <algorithm>
+#include <tuple>
+#include <limits>
 
 //fixme: 1-tri meshes
 
-void Collision::NarrowPhase(Object a, Object b)
+static const std::size_t MAX_MANIFOLD = 4;
+static const float MISS = std::numeric_limits<float>::infinity();
+//sweeps stop this close to what they hit
+static const float SWEEP_TOLERANCE = 1e-3f;
+static const int MAX_ADVANCE = 32;
+
+//The traversal is done in a's local space, so a's nodes are used as they are
+//and b's are moved by one relative transform. Contacts are moved back to world
+//space when they're found.
+
+void Collision::NarrowPhase(const NarrowPair& pair, NarrowChunk& chunk) const
 {
-	Transform apos = position[a].get();
-	Transform bpos = position[b].get();
+    Object a = pair.a, b = pair.b;
+    const Transform& apos = pair.apos;
+    const Transform& bpos = pair.bpos;
+    Transform rel = Inverse(apos) * bpos;
+    Matrix4f relMat = rel.ToMatrix();
+    auto& nodesToCheck = chunk.nodesToCheck;
 
     nodesToCheck.clear(); //avoid reallocation
 	nodesToCheck.push_back({ data.at(a).Tree().begin(), data.at(b).Tree().begin() });
     
     //if (ConservativeOBBvsOBB(apos * data.at(a).Tree().begin()->get<OBB>(), bpos * data.at(b).Tree().begin()->get<OBB>()))
+    if (debug.enabled)
     {
-        debug.PushInst({ (apos * data.at(a).Tree().begin()->get<OBB>()).matrix(), Vector3f{ 1, 1, 1 } });
-        debug.PushInst({ (bpos * data.at(b).Tree().begin()->get<OBB>()).matrix(), Vector3f{ 1, 1, 1 } });
+        chunk.debug.push_back({ (apos * data.at(a).Tree().begin()->get<OBB>()).matrix(), Vector3f{ 1, 1, 1 } });
+        chunk.debug.push_back({ (bpos * data.at(b).Tree().begin()->get<OBB>()).matrix(), Vector3f{ 1, 1, 1 } });
     }
     
 	while (!nodesToCheck.empty())
@@ -34,135 +55,922 @@ void Collision::NarrowPhase(Object a, Object b)
 		nodesToCheck.pop_back();
 		
         if (aIt->is<Triangle>()) //leaf vs leaf
+            AddContact(aIt, bIt, TransformTri(bIt->get<Triangle>(), relMat), pair, chunk);
+		else if (ConservativeOBBvsOBB(aIt->get<OBB>(), rel * bIt->get<OBB>()))
+            Descend(aIt, bIt, pair, chunk, nodesToCheck);
+	}
+}
+
+//Breadth first, so there are lots of nodes to batch up at each level
+void Collision::NarrowPhaseBatched(const NarrowPair& pair, NarrowChunk& chunk) const
+{
+    const int width = OBBLanes::width;
+    Object a = pair.a, b = pair.b;
+    const Transform& apos = pair.apos;
+    const Transform& bpos = pair.bpos;
+    Transform rel = Inverse(apos) * bpos;
+    Matrix4f relMat = rel.ToMatrix();
+    auto& frontier = chunk.nodesToCheck;
+    auto& next = chunk.nextNodes;
+
+    frontier.clear();
+    next.clear();
+    frontier.push_back({ data.at(a).Tree().begin(), data.at(b).Tree().begin() });
+
+    if (debug.enabled)
+    {
+        chunk.debug.push_back({ (apos * data.at(a).Tree().begin()->get<OBB>()).matrix(), Vector3f{ 1, 1, 1 } });
+        chunk.debug.push_back({ (bpos * data.at(b).Tree().begin()->get<OBB>()).matrix(), Vector3f{ 1, 1, 1 } });
+    }
+
+    int boxes = 0, tris = 0;
+
+    auto flushBoxes = [&]()
+    {
+        unsigned hits = ConservativeOBBvsOBB(chunk.aBoxes, chunk.bBoxes);
+        for (int i = 0; i < boxes; ++i)
+            if (hits & (1u << i))
+                Descend(chunk.boxPairs[i].first, chunk.boxPairs[i].second, pair, chunk, next);
+        boxes = 0;
+    };
+
+    auto flushTris = [&]()
+    {
+        unsigned hits = TrianglePlanesOverlap(chunk.aTris, chunk.bTris);
+        for (int i = 0; i < tris; ++i)
+            if (hits & (1u << i))
+                AddContact(chunk.triPairs[i].first, chunk.triPairs[i].second, chunk.bTri[i], pair, chunk);
+        tris = 0;
+    };
+
+    while (!frontier.empty())
+    {
+        for (IterPair nodes : frontier)
         {
-            Triangle aWorld = TransformTri(aIt->get<Triangle>(), apos.ToMatrix());
-            Triangle bWorld = TransformTri(bIt->get<Triangle>(), bpos.ToMatrix());
-            auto pair = ContactPoint(aWorld, bWorld);
-            if (pair.second)
+            if (nodes.first->is<Triangle>()) //leaf vs leaf
             {
-                //TODO: first-contact early out
-                result.push_back({ a, b, pair.first,
-                    TriNormal(aWorld).normalized(), TriNormal(bWorld).normalized() });
-                
-                debug.PushVector(pair.first, result.back().aNormal, { 1, .5f, 1 });
-                debug.PushVector(pair.first, result.back().bNormal, { 0, 1, 1 });
+                chunk.triPairs[tris] = nodes;
+                chunk.bTri[tris] = TransformTri(nodes.second->get<Triangle>(), relMat);
+                chunk.aTris.Set(tris, nodes.first->get<Triangle>());
+                chunk.bTris.Set(tris, chunk.bTri[tris]);
+                if (++tris == width)
+                    flushTris();
+            }
+            else
+            {
+                chunk.aBoxes.Set(boxes, nodes.first->get<OBB>());
+                chunk.bBoxes.Set(boxes, rel * nodes.second->get<OBB>());
+                chunk.boxPairs[boxes] = nodes;
+                if (++boxes == width)
+                    flushBoxes();
             }
         }
-		else if (ConservativeOBBvsOBB(apos * aIt->get<OBB>(), bpos * bIt->get<OBB>()))
-		{
-            //Cases: Box Box, Tri Box, Tri Tri
-            
-			if (aIt.Left()->is<OBB>() &&
-				(bIt.Left()->is<Triangle>() || aIt->get<OBB>().volume() > bIt->get<OBB>().volume()))
-			{
-				nodesToCheck.push_back({ aIt.Left(), bIt });
-				nodesToCheck.push_back({ aIt.Right(), bIt });
-			}
-			else if (bIt.Left()->is<OBB>())
-			{
-				nodesToCheck.push_back({ aIt, bIt.Left() });
-				nodesToCheck.push_back({ aIt, bIt.Right() });
-			}
-			else //each has at least one triangle
+
+        if (boxes)
+            flushBoxes();
+        if (tris)
+            flushTris();
+
+        swap(frontier, next);
+        next.clear();
+    }
+}
+
+void Collision::AddShapeContacts(const NarrowPair& pair, bool flip, const Transform& xfrm,
+                                 std::uint32_t otherFeature, NarrowChunk& chunk) const
+{
+    for (const ShapeContact& c : chunk.shapeContacts)
+    {
+        Vector3f point = xfrm * c.point, normal = xfrm.rot * c.normal;
+        if (flip)
+            chunk.contacts.push_back({ pair.a, pair.b, point, normal, -normal,
+                otherFeature, c.feature, 0.f, { 0.f, 0.f } });
+        else
+            chunk.contacts.push_back({ pair.a, pair.b, point, -normal, normal,
+                c.feature, otherFeature, 0.f, { 0.f, 0.f } });
+    }
+    chunk.shapeContacts.clear();
+}
+
+//Primitive vs primitive is closed form. Primitive vs mesh walks the mesh's
+//tree in the mesh's space, like NarrowPhase.
+void Collision::PrimitivePhase(const NarrowPair& pair, NarrowChunk& chunk) const
+{
+    //work with the primitive first
+    bool flip = !primitives.count(pair.a);
+    Object other = flip ? pair.a : pair.b;
+    const Transform& primPos = flip ? pair.bpos : pair.apos;
+    const Transform& otherPos = flip ? pair.apos : pair.bpos;
+    const Primitive& shape = primitives.at(flip ? pair.b : pair.a);
+    auto& found = chunk.shapeContacts;
+
+    found.clear();
+    if (debug.enabled)
+        chunk.debug.push_back({ (primPos * shape).BoundingOBB().matrix(), Vector3f{ 1, 1, 1 } });
+
+    auto otherShape = primitives.find(other);
+    if (otherShape != primitives.end())
+    {
+        Collide(primPos * shape, otherPos * otherShape->second, found);
+        AddShapeContacts(pair, flip, Transform{}, 0, chunk);
+        return;
+    }
+
+    Primitive local = Inverse(otherPos) * primPos * shape;
+    OBB bound = local.BoundingOBB();
+    auto& nodesToCheck = chunk.nodesToCheck;
+    nodesToCheck.clear();
+    nodesToCheck.push_back({ data.at(other).Tree().begin(), data.at(other).Tree().begin() });
+
+    while (!nodesToCheck.empty())
+    {
+        Iter it = nodesToCheck.back().first;
+        nodesToCheck.pop_back();
+
+        if (it->is<Triangle>())
+        {
+            Collide(local, it->get<Triangle>(), found);
+            AddShapeContacts(pair, flip, otherPos, static_cast<std::uint32_t>(it.Index()), chunk);
+        }
+        else if (ConservativeOBBvsOBB(it->get<OBB>(), bound))
+        {
+            nodesToCheck.push_back({ it.Left(), it.Left() });
+            nodesToCheck.push_back({ it.Right(), it.Right() });
+        }
+    }
+}
+
+//Hulls use GJK against other hulls and primitives, and against each triangle
+//of static meshes.
+void Collision::HullPhase(const NarrowPair& pair, NarrowChunk& chunk) const
+{
+    //work with the hull first, in its space
+    bool flip = !hulls.count(pair.a);
+    Object other = flip ? pair.a : pair.b;
+    const Transform& hullPos = flip ? pair.bpos : pair.apos;
+    const Transform& otherPos = flip ? pair.apos : pair.bpos;
+    const ConvexHull& hull = hulls.at(flip ? pair.b : pair.a);
+    Transform toHull = Inverse(hullPos) * otherPos;
+    auto& found = chunk.shapeContacts;
+
+    found.clear();
+    if (debug.enabled)
+        chunk.debug.push_back({ (hullPos * hull.BoundingOBB()).matrix(), Vector3f{ 1, 1, 1 } });
+
+    auto otherHull = hulls.find(other);
+    if (otherHull != hulls.end())
+    {
+        Collide(hull, otherHull->second, toHull, found);
+        AddShapeContacts(pair, flip, hullPos, 0, chunk);
+        return;
+    }
+
+    auto otherShape = primitives.find(other);
+    if (otherShape != primitives.end())
+    {
+        Collide(hull, toHull * otherShape->second, found);
+        AddShapeContacts(pair, flip, hullPos, 0, chunk);
+        return;
+    }
+
+    OBB bound = Inverse(toHull) * hull.BoundingOBB();
+    Matrix4f triToHull = toHull.ToMatrix();
+    auto& nodesToCheck = chunk.nodesToCheck;
+    nodesToCheck.clear();
+    nodesToCheck.push_back({ data.at(other).Tree().begin(), data.at(other).Tree().begin() });
+
+    while (!nodesToCheck.empty())
+    {
+        Iter it = nodesToCheck.back().first;
+        nodesToCheck.pop_back();
+
+        if (it->is<Triangle>())
+        {
+            Collide(hull, TransformTri(it->get<Triangle>(), triToHull), found);
+            AddShapeContacts(pair, flip, hullPos, static_cast<std::uint32_t>(it.Index()), chunk);
+        }
+        else if (ConservativeOBBvsOBB(it->get<OBB>(), bound))
+        {
+            nodesToCheck.push_back({ it.Left(), it.Left() });
+            nodesToCheck.push_back({ it.Right(), it.Right() });
+        }
+    }
+}
+
+//Terrain tests the cells under the other shape's bound, in the terrain's
+//space. Static meshes and other terrain are skipped.
+void Collision::TerrainPhase(const NarrowPair& pair, NarrowChunk& chunk) const
+{
+    //work with the other shape first
+    bool flip = !terrain.count(pair.a);
+    Object other = flip ? pair.a : pair.b;
+    const Transform& fieldPos = flip ? pair.bpos : pair.apos;
+    const Transform& otherPos = flip ? pair.apos : pair.bpos;
+    const Heightfield& field = terrain.at(flip ? pair.b : pair.a);
+    Transform toField = Inverse(fieldPos) * otherPos;
+    auto& found = chunk.shapeContacts;
+    found.clear();
+
+    auto hull = hulls.find(other);
+    auto shape = primitives.find(other);
+    if (hull != hulls.end())
+        field.Overlapping((toField * hull->second.BoundingOBB()).Bound(), chunk.cells);
+    else if (shape != primitives.end())
+        field.Overlapping((toField * shape->second).Bound(), chunk.cells);
+    else
+        return;
+
+    Matrix4f fieldToHull = Inverse(toField).ToMatrix();
+    Primitive local = shape != primitives.end() ? toField * shape->second : Primitive{};
+    for (const Vector2i& cell : chunk.cells)
+        for (int t = 0; t < 2; ++t)
+        {
+            Triangle tri = field.CellTriangle(cell.x(), cell.y(), t);
+            auto feature = static_cast<std::uint32_t>((cell.y() * field.Width() + cell.x()) * 2 + t);
+            if (hull != hulls.end())
             {
-                nodesToCheck.push_back({aIt.Left(), bIt.Left()});
-                
-                if (aIt.Right()->is<Triangle>())
-                    nodesToCheck.push_back({aIt.Right(), bIt.Left()});
-                else
-                    nodesToCheck.push_back({aIt.Right(), bIt});
-                
-                if (bIt.Right()->is<Triangle>())
-                {
-                    nodesToCheck.push_back({aIt.Left(), bIt.Right()});
-                    if (aIt.Right()->is<Triangle>())
-                        nodesToCheck.push_back({aIt.Right(), bIt.Right()});
-                }
-                else
-                    nodesToCheck.push_back({aIt, bIt.Right()});
-				
-                debug.PushInst({ (apos * aIt->get<OBB>()).matrix(), Vector3f{ 1, .5f, 0 } });
-                debug.PushInst({ (bpos * bIt->get<OBB>()).matrix(), Vector3f{ 0, 1, 0 } });
-			}
-		}
-	}
+                Collide(hull->second, TransformTri(tri, fieldToHull), found);
+                AddShapeContacts(pair, !flip, otherPos, feature, chunk);
+            }
+            else
+            {
+                Collide(local, tri, found);
+                AddShapeContacts(pair, !flip, fieldPos, feature, chunk);
+            }
+        }
 }
 
-AlignedBox3f Loosen(const AlignedBox3f& box)
+void Collision::Descend(Iter aIt, Iter bIt, const NarrowPair& pair, NarrowChunk& chunk,
+                        std::vector<IterPair>& nodesToCheck) const
 {
-    Vector3f size = box.sizes() * .1f; //magic fudge factor
-    return{ box.min() - size, box.max() + size };
+    //Cases: Box Box, Tri Box, Tri Tri
+    
+    if (aIt.Left()->is<OBB>() &&
+        (bIt.Left()->is<Triangle>() || aIt->get<OBB>().volume() > bIt->get<OBB>().volume()))
+    {
+        nodesToCheck.push_back({ aIt.Left(), bIt });
+        nodesToCheck.push_back({ aIt.Right(), bIt });
+    }
+    else if (bIt.Left()->is<OBB>())
+    {
+        nodesToCheck.push_back({ aIt, bIt.Left() });
+        nodesToCheck.push_back({ aIt, bIt.Right() });
+    }
+    else //each has at least one triangle
+    {
+        nodesToCheck.push_back({aIt.Left(), bIt.Left()});
+        
+        if (aIt.Right()->is<Triangle>())
+            nodesToCheck.push_back({aIt.Right(), bIt.Left()});
+        else
+            nodesToCheck.push_back({aIt.Right(), bIt});
+        
+        if (bIt.Right()->is<Triangle>())
+        {
+            nodesToCheck.push_back({aIt.Left(), bIt.Right()});
+            if (aIt.Right()->is<Triangle>())
+                nodesToCheck.push_back({aIt.Right(), bIt.Right()});
+        }
+        else
+            nodesToCheck.push_back({aIt, bIt.Right()});
+        
+        if (debug.enabled)
+        {
+            chunk.debug.push_back({ (pair.apos * aIt->get<OBB>()).matrix(), Vector3f{ 1, .5f, 0 } });
+            chunk.debug.push_back({ (pair.bpos * bIt->get<OBB>()).matrix(), Vector3f{ 0, 1, 0 } });
+        }
+    }
+}
+
+void Collision::AddContact(Iter aIt, Iter bIt, const Triangle& bTri,
+                           const NarrowPair& pair, NarrowChunk& chunk) const
+{
+    const Triangle& aTri = aIt->get<Triangle>();
+    auto point = ContactPoint(aTri, bTri);
+    if (point.second)
+    {
+        //TODO: first-contact early out
+        const Transform& apos = pair.apos;
+        chunk.contacts.push_back({ pair.a, pair.b, apos * point.first,
+            apos.rot * TriNormal(aTri).normalized(), apos.rot * TriNormal(bTri).normalized(),
+            static_cast<std::uint32_t>(aIt.Index()), static_cast<std::uint32_t>(bIt.Index()), 0.f, { 0.f, 0.f } });
+    }
+}
+
+void Collision::BuildManifold(const NarrowPair& pair, NarrowChunk& chunk, std::size_t begin) const
+{
+    auto& contacts = chunk.contacts;
+    auto first = contacts.begin() + begin;
+
+    //same triangles as last tick, same impulse
+    auto last = manifolds.find({ pair.a, pair.b });
+    if (last != manifolds.end())
+    {
+        auto lastBegin = lastResult.begin() + last->second.begin;
+        auto lastEnd = lastBegin + last->second.size;
+        for (auto c = first; c != contacts.end(); ++c)
+        {
+            auto match = std::find_if(lastBegin, lastEnd, [&](const Contact& l)
+                { return l.aFeature == c->aFeature && l.bFeature == c->bFeature; });
+            if (match != lastEnd)
+            {
+                c->impulse = match->impulse;
+                c->tangentImpulse[0] = match->tangentImpulse[0];
+                c->tangentImpulse[1] = match->tangentImpulse[1];
+            }
+        }
+    }
+
+    if (contacts.size() - begin > MAX_MANIFOLD)
+    {
+        //move the best remaining contact to slot n
+        auto pick = [&](std::size_t n, auto score)
+        {
+            std::iter_swap(first + n, std::max_element(first + n, contacts.end(),
+                [&](const Contact& l, const Contact& r) { return score(l) < score(r); }));
+        };
+
+        //start with the one doing the most work, so the manifold is stable,
+        //then span as much area as possible
+        pick(0, [](const Contact& c) { return c.impulse; });
+        Vector3f p0 = first[0].point;
+        pick(1, [&](const Contact& c) { return (c.point - p0).squaredNorm(); });
+        Vector3f p1 = first[1].point;
+        pick(2, [&](const Contact& c) { return (p1 - p0).cross(c.point - p0).squaredNorm(); });
+        Vector3f p2 = first[2].point;
+        Vector3f n = (p1 - p0).cross(p2 - p0);
+        //farthest outside the triangle
+        pick(3, [&](const Contact& c)
+        {
+            return -std::min({ n.dot((p1 - p0).cross(c.point - p0)),
+                n.dot((p2 - p1).cross(c.point - p1)), n.dot((p0 - p2).cross(c.point - p2)) });
+        });
+
+        contacts.erase(first + MAX_MANIFOLD, contacts.end());
+    }
+
+    if (debug.enabled)
+    {
+        for (auto c = contacts.begin() + begin; c != contacts.end(); ++c)
+        {
+            chunk.debug.push_back(DebugBoxes::Vector(c->point, c->aNormal, { 1, .5f, 1 }));
+            chunk.debug.push_back(DebugBoxes::Vector(c->point, c->bNormal, { 0, 1, 1 }));
+        }
+    }
+}
+
+bool Collision::ReuseManifold(const NarrowPair& pair, NarrowChunk& chunk) const
+{
+    auto last = manifolds.find({ pair.a, pair.b });
+    if (last == manifolds.end() || last->second.apos != pair.apos || last->second.bpos != pair.bpos)
+        return false;
+
+    auto lastBegin = lastResult.begin() + last->second.begin;
+    chunk.contacts.insert(chunk.contacts.end(), lastBegin, lastBegin + last->second.size);
+    return true;
 }
 
 void Collision::PhysTick()
 {
     debug.Begin();
+    //keep last tick's contacts and impulses around for warm starting
+    swap(lastResult, result);
     result.clear();
-    
-    //rejigger leaves that don't fit their object
-    for (auto& pair : broadLeaves)
-    {
-        if (!pair.second->box.contains(Bound(pair.first)))
+
+    for (auto& entry : bounds)
+        if (entry.second.dirty)
         {
-            broadTree.erase(pair.second);
-            pair.second = broadTree.insert(Loosen(Bound(pair.first)), pair.first);
+            entry.second.box = ComputeBound(entry.first);
+            entry.second.dirty = false;
+            broad->Update(entry.first, entry.second.box);
         }
+    broad->UpdatePairs();
+
+    //sorted, so the contact order doesn't depend on the broad phase
+    toTest.clear();
+    for (auto& pair : broad->Pairs())
+        if (!Bound(pair.first).intersection(Bound(pair.second)).isEmpty())
+            toTest.push_back({ pair.first, pair.second, *position[pair.first], *position[pair.second], 0 });
+    std::sort(toTest.begin(), toTest.end(), [](const NarrowPair& l, const NarrowPair& r)
+        { return std::tie(l.a, l.b) < std::tie(r.a, r.b); });
+
+    ThreadPool& pool = ThreadPool::Default();
+    //a few chunks per thread to even out the load
+    std::size_t numChunks = std::min(toTest.size(), std::size_t(pool.Threads() * 4));
+    chunks.resize(numChunks);
+
+    {
+        //compare the two
+        Profile narrowProf(batchNarrow ? "batched narrow phase" : "scalar narrow phase");
+        pool.For(numChunks, [this, numChunks](std::size_t i)
+        {
+            NarrowChunk& chunk = chunks[i];
+            chunk.contacts.clear();
+            chunk.debug.clear();
+            for (std::size_t p = i * toTest.size() / numChunks; p < (i + 1) * toTest.size() / numChunks; ++p)
+            {
+                std::size_t begin = chunk.contacts.size();
+                if (!ReuseManifold(toTest[p], chunk))
+                {
+                    if (terrain.count(toTest[p].a) || terrain.count(toTest[p].b))
+                        TerrainPhase(toTest[p], chunk);
+                    else if (hulls.count(toTest[p].a) || hulls.count(toTest[p].b))
+                        HullPhase(toTest[p], chunk);
+                    else if (primitives.count(toTest[p].a) || primitives.count(toTest[p].b))
+                        PrimitivePhase(toTest[p], chunk);
+                    else if (batchNarrow)
+                        NarrowPhaseBatched(toTest[p], chunk);
+                    else
+                        NarrowPhase(toTest[p], chunk);
+                    BuildManifold(toTest[p], chunk, begin);
+                }
+                toTest[p].contacts = chunk.contacts.size() - begin;
+            }
+        });
     }
-    
-    //don't do the same collision test two ways
-    std::unordered_set<std::pair<Object, Object>> toTest;
-    
-    for (auto& pair : data)
+
+    for (const auto& chunk : chunks)
     {
-        AlignedBox3f query = Bound(pair.first);
-        for (auto it = broadTree.query(query); it != broadTree.query_end(); ++it)
-            if (*it != pair.first)
-                toTest.insert({std::min(*it, pair.first), std::max(*it, pair.first)});
+        result.insert(result.end(), chunk.contacts.begin(), chunk.contacts.end());
+        for (const auto& inst : chunk.debug)
+            debug.PushInst(inst);
+    }
+
+    //contacts are in the same order as the pairs. Pairs with no contacts are
+    //kept too, so they can be skipped if they don't move.
+    manifolds.clear();
+    std::size_t begin = 0;
+    for (const auto& pair : toTest)
+    {
+        manifolds.insert({ { pair.a, pair.b }, { begin, pair.contacts, pair.apos, pair.bpos } });
+        begin += pair.contacts;
     }
-    
-    for (auto& pair : toTest)
-        NarrowPhase(pair.first, pair.second);
     
     debug.End();
 }
 
-AlignedBox3f Collision::Bound(Object obj) const
+//Queries
+
+template<class Fn>
+void Collision::ForRayPackets(const std::vector<Ray>& rays, Fn fn)
 {
+    const std::size_t width = RayLanes::width;
+    std::size_t packets = (rays.size() + width - 1) / width;
+    ThreadPool& pool = ThreadPool::Default();
+    std::size_t numChunks = std::min(packets, std::size_t(pool.Threads() * 4));
+    rayChunks.resize(numChunks);
+
+    pool.For(numChunks, [&](std::size_t i)
+    {
+        RayChunk& chunk = rayChunks[i];
+        for (std::size_t p = i * packets / numChunks; p < (i + 1) * packets / numChunks; ++p)
+        {
+            RayLanes packet;
+            std::size_t first = p * width;
+            for (std::size_t lane = 0; lane < width && first + lane < rays.size(); ++lane)
+                packet.Set(static_cast<int>(lane), rays[first + lane]);
+            chunk.candidates.clear();
+            broad->QueryRays(packet, chunk.candidates);
+            fn(chunk, packet, first);
+        }
+    });
+}
+
+float Collision::RayCast(Object obj, const Ray& ray, Vector3f& normal, std::vector<Iter>& stack) const
+{
+    //this runs on the thread pool
+    const Transform& pos = position.At(obj);
+    Ray local = Inverse(pos) * ray;
+    float t = MISS;
+    Vector3f n;
+
+    auto prim = primitives.find(obj);
+    auto field = terrain.find(obj);
+    if (prim != primitives.end())
+        t = ::RayCast(local, prim->second, n);
+    else if (field != terrain.end())
+        t = field->second.RayCast(local, n);
+    else
+    {
+        //hulls are only for contacts, rays hit the mesh itself
+        stack.clear();
+        stack.push_back(data.at(obj).Tree().begin());
+        while (!stack.empty())
+        {
+            Iter it = stack.back();
+            stack.pop_back();
+
+            if (it->is<Triangle>())
+            {
+                Vector3f triNormal;
+                float triT = ::RayCast(local, it->get<Triangle>(), triNormal);
+                if (triT < t)
+                {
+                    t = triT;
+                    n = triNormal;
+                    local.length = t; //only look for closer ones now
+                }
+            }
+            else if (::RayCast(local, it->get<OBB>()) <= local.length)
+            {
+                stack.push_back(it.Left());
+                stack.push_back(it.Right());
+            }
+        }
+    }
+
+    if (t == MISS)
+        return MISS;
+    normal = pos.rot * n;
+    return t * pos.scale;
+}
+
+void Collision::Raycast(const std::vector<Ray>& rays, std::vector<RayHit>& hits)
+{
+    Profile p("raycast");
+    hits.assign(rays.size(), RayHit{ Object::invalid, Vector3f::Zero(), Vector3f::Zero(), MISS });
+
+    ForRayPackets(rays, [&](RayChunk& chunk, const RayLanes&, std::size_t first)
+    {
+        for (const auto& candidate : chunk.candidates)
+            for (int lane = 0; lane < RayLanes::width; ++lane)
+                if (candidate.second & (1u << lane))
+                {
+                    Ray ray = rays[first + lane];
+                    RayHit& hit = hits[first + lane];
+                    ray.length = std::min(ray.length, hit.distance);
+                    Vector3f normal;
+                    float t = RayCast(candidate.first, ray, normal, chunk.stack);
+                    if (t < hit.distance)
+                        hit = { candidate.first, ray.origin + ray.dir * t, normal, t };
+                }
+    });
+}
+
+void Collision::RaycastAll(const std::vector<Ray>& rays, std::vector<RayHit>& hits,
+                           std::vector<std::pair<std::size_t, std::size_t>>& ranges)
+{
+    Profile p("raycast all");
+    for (auto& chunk : rayChunks)
+    {
+        chunk.hits.clear();
+        chunk.counts.clear();
+    }
+
+    ForRayPackets(rays, [&](RayChunk& chunk, const RayLanes&, std::size_t first)
+    {
+        for (std::size_t lane = 0; lane < RayLanes::width && first + lane < rays.size(); ++lane)
+        {
+            const Ray& ray = rays[first + lane];
+            std::size_t begin = chunk.hits.size();
+            for (const auto& candidate : chunk.candidates)
+                if (candidate.second & (1u << lane))
+                {
+                    Vector3f normal;
+                    float t = RayCast(candidate.first, ray, normal, chunk.stack);
+                    if (t != MISS)
+                        chunk.hits.push_back({ candidate.first, ray.origin + ray.dir * t, normal, t });
+                }
+            std::sort(chunk.hits.begin() + begin, chunk.hits.end(), [](const RayHit& l, const RayHit& r)
+                { return l.distance < r.distance; });
+            chunk.counts.push_back(chunk.hits.size() - begin);
+        }
+    });
+
+    //chunks hold consecutive rays
+    hits.clear();
+    ranges.clear();
+    for (const auto& chunk : rayChunks)
+    {
+        std::size_t begin = hits.size();
+        for (std::size_t count : chunk.counts)
+        {
+            ranges.emplace_back(begin, begin + count);
+            begin += count;
+        }
+        hits.insert(hits.end(), chunk.hits.begin(), chunk.hits.end());
+    }
+}
+
+template<class Fn>
+void Collision::ForPieces(Object obj, const AlignedBox3f& box, Fn fn) const
+{
+    const Transform& pos = position.At(obj);
+    auto prim = primitives.find(obj);
+    if (prim != primitives.end())
+    {
+        fn(pos * prim->second);
+        return;
+    }
+    auto hull = hulls.find(obj);
+    if (hull != hulls.end())
+    {
+        fn(Moved<ConvexHull>{ hull->second, pos });
+        return;
+    }
+
+    OBB local = Inverse(pos) * OBB{ box };
+    Matrix4f toWorld = pos.ToMatrix();
+    auto field = terrain.find(obj);
+    if (field != terrain.end())
+    {
+        std::vector<Vector2i> cells;
+        field->second.Overlapping(local.Bound(), cells);
+        for (const Vector2i& cell : cells)
+            for (int t = 0; t < 2; ++t)
+                if (fn(TransformTri(field->second.CellTriangle(cell.x(), cell.y(), t), toWorld)))
+                    return;
+        return;
+    }
+
+    std::vector<Iter> stack{ data.at(obj).Tree().begin() };
+    while (!stack.empty())
+    {
+        Iter it = stack.back();
+        stack.pop_back();
+
+        if (it->is<Triangle>())
+        {
+            if (fn(TransformTri(it->get<Triangle>(), toWorld)))
+                return;
+        }
+        else if (ConservativeOBBvsOBB(it->get<OBB>(), local))
+        {
+            stack.push_back(it.Left());
+            stack.push_back(it.Right());
+        }
+    }
+}
+
+//Conservative advancement: step by the distance to the piece over how fast
+//the shape closes on it, which can't step past a convex piece
+template<class Piece>
+static float Advance(Primitive shape, const Ray& path, const Piece& piece, Vector3f& normal)
+{
+    Vector3f start = shape.center;
+    float t = 0;
+    for (int i = 0; i < MAX_ADVANCE; ++i)
+    {
+        shape.center = start + path.dir * t;
+        Penetration pen;
+        //too far to reach in what's left of the path
+        if (!Penetrate(shape, piece, path.length - t, pen))
+            return MISS;
+        if (pen.depth > -SWEEP_TOLERANCE)
+        {
+            normal = pen.normal;
+            return t;
+        }
+        float closing = -path.dir.dot(pen.normal);
+        if (closing <= 0.f)
+            return MISS;
+        t += -pen.depth / closing;
+        if (t > path.length)
+            return MISS;
+    }
+    return MISS;
+}
+
+void Collision::Sweep(const Primitive& shape, const std::vector<Ray>& paths, std::vector<RayHit>& hits) const
+{
+    Profile p("sweep");
+    hits.assign(paths.size(), RayHit{ Object::invalid, Vector3f::Zero(), Vector3f::Zero(), MISS });
+
+    ThreadPool::Default().For(paths.size(), [&](std::size_t i)
+    {
+        Ray path = paths[i];
+        RayHit& hit = hits[i];
+        Primitive start = shape, end = shape;
+        start.center = path.origin;
+        end.center = RayEnd(path);
+        AlignedBox3f box = start.Bound().extend(end.Bound());
+
+        std::vector<Object> candidates;
+        broad->Query(box, candidates);
+        for (Object obj : candidates)
+        {
+            if (Bound(obj).intersection(box).isEmpty())
+                continue;
+            ForPieces(obj, box, [&](const auto& piece)
+            {
+                Vector3f normal;
+                float t = Advance(start, path, piece, normal);
+                if (t < hit.distance)
+                {
+                    hit = { obj, path.origin + path.dir * t, normal, t };
+                    path.length = t;
+                }
+                return false;
+            });
+        }
+    });
+}
+
+void Collision::Overlap(const Primitive& shape, std::vector<Object>& out) const
+{
+    out.clear();
+    AlignedBox3f box = shape.Bound();
+    std::vector<Object> candidates;
+    broad->Query(box, candidates);
+    for (Object obj : candidates)
+    {
+        if (Bound(obj).intersection(box).isEmpty())
+            continue;
+        bool hit = false;
+        ForPieces(obj, box, [&](const auto& piece)
+        {
+            Penetration pen;
+            return hit = Penetrate(shape, piece, 0.f, pen) && pen.depth >= 0.f;
+        });
+        if (hit)
+            out.push_back(obj);
+    }
+}
+
+AlignedBox3f Collision::ComputeBound(Object obj) const
+{
+    auto prim = primitives.find(obj);
+    if (prim != primitives.end())
+        return (*position[obj] * prim->second).Bound();
+    auto field = terrain.find(obj);
+    if (field != terrain.end())
+        return (*position[obj] * OBB{ field->second.Bound() }).Bound();
     return (*position[obj] * data.at(obj).Tree().begin()->get<OBB>()).Bound();
 }
 
 Collision::Collision(Position& position, RenderPasses& passes)
-	: position(position), debug(passes)
+	: broad(std::make_unique<TreeBroadPhase>())
+    , broadKind(BroadPhaseKind::Tree), broadCell(2.f), batchNarrow(true)
+    , position(position)
+    , moved([this](Object obj, const Transform&)
+    {
+        auto it = bounds.find(obj);
+        if (it != bounds.end())
+            it->second.dirty = true;
+    })
+    , debug(passes)
 {}
 
+void Collision::Track(Object obj)
+{
+    bounds.try_emplace(obj, CachedBound{ ComputeBound(obj), false });
+    position.Watch(obj, make_magic(moved, obj));
+    broad->Insert(obj, Bound(obj));
+}
+
+static const char* broadPhaseNames[] = { "tree", "sweep", "grid" };
+
+void Collision::UseBroadPhase(BroadPhaseKind kind, float cellSize)
+{
+    std::unique_ptr<BroadPhase> next;
+    if (kind == BroadPhaseKind::Sweep)
+        next = std::make_unique<SweepBroadPhase>();
+    else if (kind == BroadPhaseKind::Grid)
+        next = std::make_unique<GridBroadPhase>(cellSize);
+    else
+        next = std::make_unique<TreeBroadPhase>();
+
+    for (auto& entry : bounds)
+        next->Insert(entry.first, entry.second.box);
+    next->UpdatePairs();
+    next->CarryOver(*broad);
+
+    broad = std::move(next);
+    broadKind = kind;
+    broadCell = cellSize;
+}
+
 void Collision::Add(Object obj, OBBTree mesh)
 {
-    if (!data.count(obj))
+    if (!Has(obj))
     {
         data.emplace(obj, std::move(mesh));
-        auto it = broadTree.insert(Bound(obj), obj);
-        broadLeaves.try_emplace(obj, it);
+        if (wantsHull.count(obj))
+            hulls.emplace(obj, ConvexHull{ data.at(obj).Name() });
+        Track(obj);
+    }
+}
+
+void Collision::Add(Object obj, const Primitive& shape)
+{
+    if (!Has(obj))
+    {
+        primitives.emplace(obj, shape);
+        Track(obj);
+    }
+}
+
+void Collision::AddTerrain(Object obj, Heightfield field)
+{
+    if (!Has(obj))
+    {
+        terrain.emplace(obj, std::move(field));
+        Track(obj);
+    }
+}
+
+void Collision::UseHull(Object obj, bool hull)
+{
+    if (!hull)
+    {
+        wantsHull.erase(obj);
+        hulls.erase(obj);
+        return;
     }
+    wantsHull.insert(obj);
+    if (data.count(obj) && !hulls.count(obj))
+        hulls.emplace(obj, ConvexHull{ data.at(obj).Name() });
 }
 
 void Collision::Load(const Persist& persist)
 {
+    //before anything is in it
+    for (const auto& row : persist.GetAll<CollisionBroadPhase>())
+    {
+        auto name = std::find(std::begin(broadPhaseNames), std::end(broadPhaseNames), std::get<1>(row));
+        if (name == std::end(broadPhaseNames))
+            throw std::runtime_error("Unknown broad phase '" + std::get<1>(row) + "'");
+        UseBroadPhase(static_cast<BroadPhaseKind>(name - std::begin(broadPhaseNames)), std::get<2>(row));
+    }
 	for (const auto& dat : persist.GetAll<Collision>())
         Add(std::get<0>(dat), std::move(std::get<1>(dat)));
+    for (const auto& dat : persist.GetAll<Primitive>())
+        Add(std::get<0>(dat), std::get<1>(dat));
+    for (const auto& dat : persist.GetAll<Heightfield>())
+        AddTerrain(std::get<0>(dat), std::get<1>(dat));
 }
 
 void Collision::Save(Object obj, Persist& persist) const
 {
-	if (Has(obj))
+	if (data.count(obj))
 		persist.Set<Collision>(obj, data.at(obj));
 	else
 		persist.Delete<Collision>(obj);
+
+    if (primitives.count(obj))
+        persist.Set<Primitive>(obj, primitives.at(obj));
+    else
+        persist.Delete<Primitive>(obj);
+
+    if (terrain.count(obj))
+        persist.Set<Heightfield>(obj, terrain.at(obj));
+    else
+        persist.Delete<Heightfield>(obj);
+}
+
+void Collision::SaveBroadPhase(Persist& persist) const
+{
+    persist.Set<CollisionBroadPhase>(0, std::string(broadPhaseNames[static_cast<int>(broadKind)]), broadCell);
+}
+
+void Collision::Unload(const Persist& persist)
+{
+	for (const auto& dat : persist.GetAll<Collision>())
+        Remove(std::get<0>(dat));
+    for (const auto& dat : persist.GetAll<Primitive>())
+        Remove(std::get<0>(dat));
+    for (const auto& dat : persist.GetAll<Heightfield>())
+        Remove(std::get<0>(dat));
+    //the next scene starts from the default
+    if (persist.Exists<CollisionBroadPhase>(0))
+        UseBroadPhase(BroadPhaseKind::Tree);
 }
 
-MAP_COMPONENT_BOILERPLATE(Collision, data)
+bool Collision::Has(Object obj) const
+{
+	return data.count(obj) > 0 || primitives.count(obj) > 0 || terrain.count(obj) > 0;
+}
+
+void Collision::Remove(Object obj)
+{
+    if (!Has(obj))
+        return;
+
+    data.erase(obj);
+    primitives.erase(obj);
+    hulls.erase(obj);
+    terrain.erase(obj);
+    bounds.erase(obj);
+    position.Unwatch(obj, make_magic(moved, obj));
+    broad->Remove(obj);
+}
 
 template<>
 const char* PersistSchema<Collision>::name = "collision";
 template<>
 Columns PersistSchema<Collision>::cols = { "object", "mesh" };
 
+template<>
+const char* PersistSchema<Primitive>::name = "collision_primitive";
+template<>
+Columns PersistSchema<Primitive>::cols = { "object", "shape" };
+
+template<>
+const char* PersistSchema<Heightfield>::name = "collision_heightfield";
+template<>
+Columns PersistSchema<Heightfield>::cols = { "object", "heights" };
+
+template<>
+const char* PersistSchema<CollisionBroadPhase>::name = "collision_broadphase";
+template<>
+Columns PersistSchema<CollisionBroadPhase>::cols = { "id", "kind", "cell" };
@@ -3,14 +3,20 @@
 
 #include "Core/Component.hpp"
 #include "Geometry/OBB.hpp"
+#include "Geometry/CollideBatch.hpp"
+#include "Geometry/Primitives.hpp"
+#include "Geometry/ConvexHull.hpp"
+#include "Geometry/Heightfield.hpp"
+#include "Geometry/Raycast.hpp"
 #include <unordered_map>
+#include <unordered_set>
 #include "Containers/l_unordered_map.hpp"
 
 #include "Utils/DebugBoxes.hpp"
+#include "Position.hpp"
 
-#include "Geometry/AABB.hpp"
+#include "BroadPhase.hpp"
 
-class Position;
 class RenderPasses;
 
 struct Contact
@@ -19,6 +25,19 @@ struct Contact
 	Vector3f point;
 	//contact normals in world coordinates
 	Vector3f aNormal, bNormal;
+    //the triangles in each tree, which identify the contact from tick to tick
+    std::uint32_t aFeature, bFeature;
+    //impulses from the last solve, to warm start the next one. Friction is
+    //along two directions perpendicular to the normal.
+    float impulse, tangentImpulse[2];
+};
+
+struct RayHit
+{
+    Object obj; //Object::invalid if nothing was hit
+    //in world coordinates. The normal faces back along the ray.
+    Vector3f point, normal;
+    float distance;
 };
 
 class Collision : public Component
@@ -26,10 +45,50 @@ class Collision : public Component
 public:
 	Collision(Position&, RenderPasses&);
 	void Add(Object obj, OBBTree mesh);
+    //simple shapes get closed form tests instead of the mesh path
+    void Add(Object obj, const Primitive& shape);
+    //collide with the convex hull of the object's mesh, using GJK. Rigid
+    //bodies do this; static meshes keep their triangles so they can be concave.
+    //This sticks to the object, so it applies to a mesh added later too.
+    void UseHull(Object obj, bool hull = true);
+    //terrain, which only collides with hulls and primitives. Not an overload of
+    //Add, since both it and OBBTree convert from a file name.
+    void AddTerrain(Object obj, Heightfield terrain);
+    //at most four per pair, grouped by pair. The solver writes impulses back.
     const std::vector<Contact>& Contacts() const {return result;}
+    std::vector<Contact>& Contacts() {return result;}
     void PhysTick();
+
+    //pairs whose loose bounds started or stopped overlapping this tick
+    const std::vector<ObjectPair>& BeginOverlap() const {return broad->BeginOverlap();}
+    const std::vector<ObjectPair>& EndOverlap() const {return broad->EndOverlap();}
+
+    //switch to a different broad phase, moving all objects to it. Pairs that
+    //overlap in both carry over, and the rest begin or end on the next tick.
+    //Each scene saves which one it uses.
+    enum class BroadPhaseKind { Tree, Sweep, Grid };
+    void UseBroadPhase(BroadPhaseKind kind, float cellSize = 2.f);
+    BroadPhaseKind CurrentBroadPhase() const { return broadKind; }
+    //this is for the whole scene, so it isn't saved with any object
+    void SaveBroadPhase(Persist&) const;
     
+    //Queries against the world as of the last tick. Rays go through the broad
+    //phase in SIMD packets, and the packets run in parallel.
+    //the nearest hit along each ray
+    void Raycast(const std::vector<Ray>& rays, std::vector<RayHit>& hits);
+    //every object along each ray, nearest first. Ray i's hits are the range
+    //[ranges[i].first, ranges[i].second) of hits.
+    void RaycastAll(const std::vector<Ray>& rays, std::vector<RayHit>& hits,
+                    std::vector<std::pair<std::size_t, std::size_t>>& ranges);
+    //the first thing the shape hits moving along each path, starting centered
+    //on the path's origin. The point is where the shape's center stops.
+    void Sweep(const Primitive& shape, const std::vector<Ray>& paths, std::vector<RayHit>& hits) const;
+    //objects the shape (in world space) overlaps
+    void Overlap(const Primitive& shape, std::vector<Object>& out) const;
+
     bool& Debug() { return debug.enabled; }
+    //test nodes in SIMD batches, or one pair at a time
+    bool& BatchNarrowPhase() { return batchNarrow; }
     
     using TreeTy = OBBTree;
 
@@ -41,25 +100,128 @@ private:
 	void Remove(Object);
     
     //Broad Phase:
-    AABBTree<Object> broadTree;
-    l_unordered_map<Object, AABBTree<Object>::iterator> broadLeaves;
+    std::unique_ptr<BroadPhase> broad;
+    BroadPhaseKind broadKind;
+    float broadCell;
     
     //Narrow Phase:
 	std::unordered_map<Object, TreeTy> data;
+    std::unordered_map<Object, Primitive, std::hash<Object>, std::equal_to<Object>,
+        Eigen::aligned_allocator<std::pair<const Object, Primitive>>> primitives;
+    std::unordered_map<Object, ConvexHull> hulls;
+    std::unordered_set<Object> wantsHull;
+    std::unordered_map<Object, Heightfield> terrain;
     
     using Iter = TreeTy::TreeTy::const_iterator;
     using IterPair = std::pair<Iter, Iter>;
-    std::vector<IterPair> nodesToCheck;
+
+    struct NarrowPair
+    {
+        Object a, b;
+        Transform apos, bpos;
+        std::size_t contacts; //how many it ended up with
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    };
+    std::vector<NarrowPair, Eigen::aligned_allocator<NarrowPair>> toTest;
+
+    //pairs are split into chunks which run in parallel, with results merged
+    //in chunk order
+    struct NarrowChunk
+    {
+        std::vector<IterPair> nodesToCheck, nextNodes;
+        std::vector<Contact> contacts;
+        std::vector<DebugBoxes::Inst> debug;
+
+        //batches being filled
+        OBBLanes aBoxes, bBoxes;
+        std::array<IterPair, OBBLanes::width> boxPairs;
+        TriangleLanes aTris, bTris;
+        std::array<IterPair, TriangleLanes::width> triPairs;
+        std::array<Triangle, TriangleLanes::width> bTri; //in a's space
+
+        std::vector<ShapeContact> shapeContacts;
+        std::vector<Vector2i> cells;
+    };
+    std::vector<NarrowChunk> chunks;
+    bool batchNarrow;
     
-    void NarrowPhase(Object a, Object b);
+    void NarrowPhase(const NarrowPair& pair, NarrowChunk& chunk) const;
+    void NarrowPhaseBatched(const NarrowPair& pair, NarrowChunk& chunk) const;
+    //at least one of the pair is a primitive
+    void PrimitivePhase(const NarrowPair& pair, NarrowChunk& chunk) const;
+    //at least one of the pair is a hull
+    void HullPhase(const NarrowPair& pair, NarrowChunk& chunk) const;
+    //at least one of the pair is terrain
+    void TerrainPhase(const NarrowPair& pair, NarrowChunk& chunk) const;
+    //chunk.shapeContacts are in xfrm's space, with normals pointing at the
+    //first shape, which is b if flip is set
+    void AddShapeContacts(const NarrowPair& pair, bool flip, const Transform& xfrm,
+                          std::uint32_t otherFeature, NarrowChunk& chunk) const;
+    //queue up the children of two intersecting nodes
+    void Descend(Iter aIt, Iter bIt, const NarrowPair& pair, NarrowChunk& chunk,
+                 std::vector<IterPair>& out) const;
+    //bTri is in a's space
+    void AddContact(Iter aIt, Iter bIt, const Triangle& bTri,
+                    const NarrowPair& pair, NarrowChunk& chunk) const;
+
+    //Each pair's contacts from last tick are kept as a range of lastResult,
+    //so new contacts on the same triangles can pick up their impulses
+    struct ManifoldRange
+    {
+        std::size_t begin, size;
+        Transform apos, bpos;
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    };
+    std::unordered_map<ObjectPair, ManifoldRange, std::hash<ObjectPair>, std::equal_to<ObjectPair>,
+        Eigen::aligned_allocator<std::pair<const ObjectPair, ManifoldRange>>> manifolds;
+    std::vector<Contact> lastResult;
+    //warm start and reduce the contacts of one pair, starting at 'begin'
+    void BuildManifold(const NarrowPair& pair, NarrowChunk& chunk, std::size_t begin) const;
+    //if neither object moved (say, they're asleep) copy last tick's contacts
+    bool ReuseManifold(const NarrowPair& pair, NarrowChunk& chunk) const;
     
+    //Queries:
+    struct RayChunk
+    {
+        std::vector<std::pair<Object, unsigned>> candidates;
+        std::vector<Iter> stack;
+        std::vector<RayHit> hits; //for RaycastAll
+        std::vector<std::size_t> counts;
+    };
+    std::vector<RayChunk> rayChunks;
+    //calls fn(chunk, packet, first ray) on packets of rays, in parallel
+    template<class Fn>
+    void ForRayPackets(const std::vector<Ray>& rays, Fn fn);
+    //distance along the world space ray to obj, or infinity
+    float RayCast(Object obj, const Ray& ray, Vector3f& normal, std::vector<Iter>& stack) const;
+    //calls fn on each convex piece of obj which might overlap the world space
+    //box, in world space, until it returns true
+    template<class Fn>
+    void ForPieces(Object obj, const AlignedBox3f& box, Fn fn) const;
+
     //Other:
     Position& position;
-    AlignedBox3f Bound(Object obj) const;
+    //world space bounds are kept densely and only recomputed for colliders
+    //which moved since last tick
+    struct CachedBound
+    {
+        AlignedBox3f box;
+        bool dirty;
+    };
+    l_unordered_map<Object, CachedBound> bounds;
+    accessor<Transform, Object> moved;
+    AlignedBox3f ComputeBound(Object obj) const;
+    const AlignedBox3f& Bound(Object obj) const { return bounds.at(obj).box; }
+    void Track(Object obj);
     std::vector<Contact> result;
     mutable DebugBoxes debug;
 };
 
 MAKE_PERSIST_TRAITS(Collision, Object, Collision::TreeTy)
+MAKE_PERSIST_TRAITS(Primitive, Object, Primitive)
+MAKE_PERSIST_TRAITS(Heightfield, Object, Heightfield)
+//one row per scene, with the kind of broad phase by name and its cell size
+struct CollisionBroadPhase;
+MAKE_PERSIST_TRAITS(CollisionBroadPhase, std::int64_t, std::string, float)
 
 #endif
@@ -5,29 +5,23 @@
 #include "Collision.hpp"
 #include "File/Persist.hpp"
 
-#include "Eigen/SparseQR"
+#include "Utils/Parallel.hpp"
+#include "Utils/Profiling.hpp"
 
 #include <iostream>
+#include <numeric>
 
 using Eigen::VectorXf;
 using Eigen::MatrixXf;
 
 static const float simDt = std::chrono::duration<float>{ Time::dt }.count();
-
-//Generalized contact for one active body
-RigidBody::SparseV RigidBody::GenContact1(Object obj, Vector3f point, Vector3f normal) const
-{
-    int idx = data.at(obj).index;
-    GenCoord genNorm;
-    genNorm << normal, normal.cross(state.location.block<3, 1>(idx * 3, 0) - point);
-    genNorm.normalize();
-    
-    SparseV ret{ static_cast<int>(state.momentum.rows()) };
-    ret.reserve(6);
-    for (int i = 0; i < 6; ++i)
-        ret.insert(idx * 6 + i) = genNorm[i];
-    return ret;
-}
+//slower than this and contacts don't bounce
+static const float restitutionThreshold = 1.f;
+//bodies slower than this, with less kinetic energy per mass than this, for
+//this long, can go to sleep
+static const float sleepVelocity = .05f;
+static const float sleepEnergy = .01f;
+static const float sleepTime = .5f;
 
 //The generalized contact normal is a translation and rotation that moves
 //the contact point perpendicularly away from the surface. In the case of
@@ -35,130 +29,202 @@ RigidBody::SparseV RigidBody::GenContact1(Object obj, Vector3f point, Vector3f n
 //of both that moves the objects away from each other.
 //Equivalently, if f() = 0 defines an implicit surface where the objects
 //are touching, this is the gradient of f.
-RigidBody::SparseV RigidBody::GenContact(const Contact& c) const
+//The friction rows are the same thing along directions tangent to the surface.
+void RigidBody::AddContactRows(const Contact& c, const VectorXf& velocity)
 {
-    if (!Has(c.b))
+    int a = Has(c.a) ? data.at(c.a).index : -1;
+    int b = Has(c.b) ? data.at(c.b).index : -1;
+
+    //pushes a away from b
+    Vector3f normal = c.bNormal - c.aNormal;
+    if (normal.squaredNorm() < .0001f) //the triangles are edge on
+        normal = c.bNormal;
+    normal.normalize();
+    Vector3f tangent = normal.unitOrthogonal();
+    Vector3f dirs[3] = { normal, tangent, normal.cross(tangent) };
+    float impulses[3] = { c.impulse, c.tangentImpulse[0], c.tangentImpulse[1] };
+
+    Vector3f ra = a >= 0 ? Vector3f{ c.point - state.location.segment<3>(a * 3) } : Vector3f::Zero();
+    Vector3f rb = b >= 0 ? Vector3f{ c.point - state.location.segment<3>(b * 3) } : Vector3f::Zero();
+
+    for (int i = 0; i < 3; ++i)
     {
-        if (Has(c.a))
-            return GenContact1(c.a, c.point, c.bNormal);
-        else return{};
+        ContactRow row;
+        row.a = a;
+        row.b = b;
+        row.ja << dirs[i], ra.cross(dirs[i]);
+        row.jb << -dirs[i], rb.cross(-dirs[i]);
+
+        float k = 0.f;
+        if (a >= 0)
+            k += row.ja.dot(inverseInertia.diagonal().segment<6>(a * 6).cwiseProduct(row.ja));
+        if (b >= 0)
+            k += row.jb.dot(inverseInertia.diagonal().segment<6>(b * 6).cwiseProduct(row.jb));
+        row.effectiveMass = k > 0.f ? 1.f / k : 0.f;
+
+        //bounce only things coming in fast, so resting contacts stay put
+        row.bias = 0.f;
+        if (i == 0)
+        {
+            float approach = -RowVelocity(row, velocity);
+            if (approach > restitutionThreshold)
+                row.bias = restitution * approach;
+        }
+
+        row.impulse = impulses[i];
+        rows.push_back(row);
     }
-    if (!Has(c.a))
-        return GenContact1(c.b, c.point, c.aNormal);
-    //else:
-    
-    int idxA = data.at(c.a).index;
-    int idxB = data.at(c.b).index;
-    
-    //the derivative along n of the rotation of a vector v w.r.t the rotataton
-    //angle theta, evaluated at theta=0, is ||v|| sin(alpha), where alpha is the
-    //angle between v and n. Conveniently enough, the direction of the surface
-    //normal in rotation coordinates is in cross(v, n), and n is already normalized.
-    GenCoord a, b;
-    a << c.bNormal, c.bNormal.cross(state.location.block<3, 1>(idxA*3, 0) - c.point);
-    b << c.aNormal, c.aNormal.cross(state.location.block<3, 1>(idxB*3, 0) - c.point);
-    
-    SparseV ret{(int)data.size() * 6};
-    ret.reserve(12);
-    
-    if (idxA < idxB)
+}
+
+float RigidBody::RowVelocity(const ContactRow& row, const VectorXf& velocity) const
+{
+    float ret = 0.f;
+    if (row.a >= 0)
+        ret += row.ja.dot(velocity.segment<6>(row.a * 6));
+    if (row.b >= 0)
+        ret += row.jb.dot(velocity.segment<6>(row.b * 6));
+    return ret;
+}
+
+void RigidBody::ApplyImpulse(const ContactRow& row, float impulse, VectorXf& velocity) const
+{
+    if (row.a >= 0)
+        velocity.segment<6>(row.a * 6) += inverseInertia.diagonal().segment<6>(row.a * 6).cwiseProduct(row.ja) * impulse;
+    if (row.b >= 0)
+        velocity.segment<6>(row.b * 6) += inverseInertia.diagonal().segment<6>(row.b * 6).cwiseProduct(row.jb) * impulse;
+}
+
+int RigidBody::FindIsland(int body)
+{
+    while (islandParent[body] != body)
     {
-        for (int i = 0; i < 6; ++i)
-            ret.insert(idxA*6 + i) = a[i];
-        for (int i = 0; i < 6; ++i)
-            ret.insert(idxB*6 + i) = b[i];
+        islandParent[body] = islandParent[islandParent[body]];
+        body = islandParent[body];
     }
-    else
+    return body;
+}
+
+//Projected Gauss-Seidel: relax one row at a time, clamping the accumulated
+//impulse. Normal impulses push apart, friction is limited by the normal impulse.
+void RigidBody::SolveIsland(std::size_t begin, std::size_t end, VectorXf& velocity)
+{
+    for (int iter = 0; iter < iterations; ++iter)
     {
-        for (int i = 0; i < 6; ++i)
-            ret.insert(idxA*6 + i) = a[i];
-        for (int i = 0; i < 6; ++i)
-            ret.insert(idxB*6 + i) = b[i];
+        for (std::size_t i = begin; i < end; i += 3)
+        {
+            //friction first, so the normal rows get the last word
+            for (std::size_t t = i + 1; t < i + 3; ++t)
+            {
+                ContactRow& row = rows[t];
+                float limit = friction * rows[i].impulse;
+                float old = row.impulse;
+                row.impulse = std::min(std::max(old - row.effectiveMass * RowVelocity(row, velocity), -limit), limit);
+                ApplyImpulse(row, row.impulse - old, velocity);
+            }
+
+            ContactRow& row = rows[i];
+            float old = row.impulse;
+            row.impulse = std::max(old + row.effectiveMass * (row.bias - RowVelocity(row, velocity)), 0.f);
+            ApplyImpulse(row, row.impulse - old, velocity);
+        }
     }
-    
-    ret /= ret.norm();
-    return ret;
 }
 
-struct RigidBody::Derivative
+//velocity and spin of every body in s
+void RigidBody::Derive(const State& s, Derivative& out) const
 {
-	VectorXf force, drag;
-	VectorXf velocity;
-    VectorXf spin; //derivative of quaternion
-};
+    for (int i = 0, j = 0, k = 0; i < s.momentum.rows(); i += 6, j += 4, k += 3)
+    {
+        GenCoord v = inverseInertia.diagonal().segment<6>(i).cwiseProduct(s.momentum.segment<6>(i));
+        //the angular velocity must be transformed into the tangent space of the orientation
+        out.spin.segment<4>(j) = (Quaternionf{ 0, v[3], v[4], v[5] }
+                                  * Quaternionf{ &s.orientation[j] }).coeffs() * .5f;
+        out.velocity.segment<3>(k) = v.head<3>();
+    }
+}
 
-void RigidBody::advance(State& s, const Derivative& d, float dt)
+//derivative at 'alpha' of the way through the tick, going there along d
+void RigidBody::Stage(float alpha, const Derivative& d, Derivative& out)
 {
-    s.momentum += d.force * dt;
-    s.momentum += d.drag * dt;
-	s.location += d.velocity*dt;
-    s.orientation += d.spin*dt;
-    
-    //s.badWork += d.drag.dot(d.velocity)*dt;
+    float dt = simDt * alpha;
+    scratch.momentum = state.momentum + force * dt;
+    scratch.location = state.location + d.velocity * dt;
+    scratch.orientation = state.orientation + d.spin * dt;
+    Derive(scratch, out);
 }
 
-//RK4 step
-template<typename F>
-RigidBody::Derivative RigidBody::step(const State& initial, float alpha, const Derivative* d,
-	Time::clock::duration t, F forces)
+void RigidBody::IntegrateRK4()
 {
-	State s = initial;
-    if (d) advance(s, *d, simDt*alpha);
+    Derivative& a = stages[0], &b = stages[1], &c = stages[2], &d = stages[3];
+    Derive(state, a);
+    Stage(.5f, a, b);
+    Stage(.5f, b, c);
+    Stage(1.f, c, d);
 
-	Time::clock::duration newT = t +
-		std::chrono::duration_cast<Time::clock::duration>(Time::dt*alpha);
+    //the forces are constant over the tick
+    state.momentum += force * simDt;
+    state.location += (a.velocity + 2.f * (b.velocity + c.velocity) + d.velocity) * (simDt / 6.f);
+    state.orientation += (a.spin + 2.f * (b.spin + c.spin) + d.spin) * (simDt / 6.f);
 
-	Derivative ret;
-    std::tie(ret.force, ret.drag) = forces(s, newT);
-    
-    //divide up the velocity
-    VectorXf genVel = inverseInertia * s.momentum;
-    ret.spin = VectorXf{ s.orientation.rows() };
-    ret.velocity = VectorXf{ s.location.rows() };
-    
-    for (int i = 0, j = 0, k = 0; i < genVel.rows(); i += 6, j += 4, k += 3)
+    for (int i = 0; i < state.orientation.rows(); i += 4)
+        state.orientation.segment<4>(i).normalize();
+}
+
+//The symplectic integrators go body by body, skipping sleeping ones
+
+void RigidBody::Rotate(int idx, const Vector3f& angularVelocity, float dt)
+{
+    auto q = state.orientation.segment<4>(idx * 4);
+    q += (Quaternionf{ 0, angularVelocity.x(), angularVelocity.y(), angularVelocity.z() }
+          * Quaternionf{ &state.orientation[idx * 4] }).coeffs() * (.5f * dt);
+    q.normalize();
+}
+
+//kick, then drift with the new velocity
+void RigidBody::IntegrateSemiImplicit()
+{
+    for (auto& pair : data)
     {
-        //the angular velocity must be transformed into the tangent space of the orientation
-        ret.spin.block<4, 1>(j, 0) = (Quaternionf{0, genVel[i+3], genVel[i+4], genVel[i+5]}
-                                      * Quaternionf{&s.orientation[j]}).coeffs() * .5f;
-        
-        ret.velocity.block<3, 1>(k, 0) = genVel.block<3, 1>(i, 0);
+        if (pair.second.asleep)
+            continue;
+        int idx = pair.second.index;
+        auto momentum = state.momentum.segment<6>(idx * 6);
+        momentum += force.segment<6>(idx * 6) * simDt;
+        GenCoord v = inverseInertia.diagonal().segment<6>(idx * 6).cwiseProduct(momentum);
+        state.location.segment<3>(idx * 3) += v.head<3>() * simDt;
+        Rotate(idx, v.tail<3>(), simDt);
     }
-	
-	return ret;
 }
 
-//RK4 integrate
-template<typename F>
-void RigidBody::integrate(State& state, Time::clock::duration t, F forces)
+//half kick, drift, half kick
+void RigidBody::IntegrateLeapfrog()
 {
-    Derivative a, b, c, d;
-	a = step(state, 0.f, nullptr, t, forces);
-	b = step(state, 5.f, &a, t, forces);
-	c = step(state, 5.f, &b, t, forces);
-	d = step(state, 1.f, &c, t, forces);
-
-	Derivative final;
-#define RKINTERP(val) final.val = 1.f / 6.f * (a.val + 2.f*(b.val + c.val) + d.val)
-	RKINTERP(force);
-	RKINTERP(drag);
-    RKINTERP(velocity);
-    RKINTERP(spin);
-    advance(state, final, simDt);
-    
-    //renormalize quaternions
-    for (int i = 0; i < state.orientation.rows(); i += 4)
-        state.orientation.block<4, 1>(i, 0).normalize();
+    for (auto& pair : data)
+    {
+        if (pair.second.asleep)
+            continue;
+        int idx = pair.second.index;
+        auto momentum = state.momentum.segment<6>(idx * 6);
+        momentum += force.segment<6>(idx * 6) * (simDt * .5f);
+        GenCoord v = inverseInertia.diagonal().segment<6>(idx * 6).cwiseProduct(momentum);
+        state.location.segment<3>(idx * 3) += v.head<3>() * simDt;
+        Rotate(idx, v.tail<3>(), simDt);
+        momentum += force.segment<6>(idx * 6) * (simDt * .5f);
+    }
 }
 
 void RigidBody::PhysTick(Time::clock::duration simTime)
 {
     if (paused || !data.size())
         return;
+
+    //nothing in here should touch the heap once things settle down
+    AllocationCheck allocCheck("rigid body tick");
     
     debug.Begin();
     
     auto& contacts = collision.Contacts();
+    writingPositions = true;
 
     //FIXME: This should be done by the editor
     for (auto& pair : data)
@@ -171,150 +237,169 @@ void RigidBody::PhysTick(Time::clock::duration simTime)
         state.orientation.block<4, 1>(pair.second.index * 4, 0) = xfrm.rot.coeffs();
     }
      
-    //now handle free work penalty impulses
-    /*for (auto& pair : data)
+    //Contacts: the solver works on velocities, starting from where gravity
+    //alone would take them
+    velocity = state.momentum + gravity * simDt;
+    velocity.array() *= inverseInertia.diagonal().array();
+
+    //union bodies that touch into islands, which don't affect each other
+    islandParent.resize(state.momentum.rows() / 6);
+    std::iota(islandParent.begin(), islandParent.end(), 0);
+    order.clear();
+    for (std::size_t i = 0; i < contacts.size(); ++i)
     {
-        size_t idx = pair.second.index;
-        if (badWork[idx] > 0)
-        {
-            //std::cerr << state.badWork << '\n';
-            auto m = momentum.block<6, 1>(idx*6, 0);
-            if (!m.isZero(.001f))
-                m = m.normalized() * std::sqrt(std::max(
-                m.squaredNorm()
-                - 2.f * pair.second.mass * badWork[idx], 0.f));
-            else
-                m = GenCoord::Zero();
-            
-            //try taking it out of potential energy too
-            badWork[idx] = 0;
-        }
-    }*/
-    
-    using Index = Eigen::MatrixXf::Index;
-    //number of rows, degrees of freeedom
-    ptrdiff_t m = state.momentum.rows();
+        bool hasA = Has(contacts[i].a), hasB = Has(contacts[i].b);
+        if (!hasA && !hasB)
+            continue;
+        order.push_back(i);
+        if (hasA && hasB)
+            islandParent[FindIsland(data.at(contacts[i].a).index)] = FindIsland(data.at(contacts[i].b).index);
+    }
 
-    VectorXf b = -gravity;
-    VectorXf b2{ m };
-    Eigen::VectorXf x = Eigen::VectorXf::Zero(m);
-    std::vector<float> taus;
-    std::vector<Eigen::VectorXf> QR;
-    std::vector<SparseV> active;
+    auto islandOf = [&](std::size_t contact)
+    {
+        const Contact& c = contacts[contact];
+        return FindIsland(data.at(Has(c.a) ? c.a : c.b).index);
+    };
 
-    VectorXf workspace{ m };
-    VectorXf workspace2{ m };
+    //an island sleeps only if everything in it does, so an awake body
+    //touching a sleeping one wakes it up
+    islandAwake.assign(islandParent.size(), false);
+    for (auto& pair : data)
+        if (!pair.second.asleep)
+            islandAwake[FindIsland(pair.second.index)] = true;
+    for (auto& pair : data)
+        if (islandAwake[FindIsland(pair.second.index)])
+            pair.second.asleep = false;
+
+    //sleeping islands keep their contacts and impulses as they are
+    order.erase(std::remove_if(order.begin(), order.end(),
+        [&](std::size_t ci) { return !islandAwake[islandOf(ci)]; }), order.end());
+    //stable_sort would allocate a buffer, and ties are broken by index anyway
+    std::sort(order.begin(), order.end(), [&](std::size_t l, std::size_t r)
+        { return std::make_pair(islandOf(l), l) < std::make_pair(islandOf(r), r); });
+
+    //warm start with last tick's impulses
+    rows.clear();
+    islandStart.clear();
+    int lastIsland = -1;
+    for (std::size_t ci : order)
+    {
+        int island = islandOf(ci);
+        if (island != lastIsland)
+            islandStart.push_back(rows.size());
+        lastIsland = island;
+
+        AddContactRows(contacts[ci], velocity);
+        for (auto row = rows.end() - 3; row != rows.end(); ++row)
+            ApplyImpulse(*row, row->impulse, velocity);
+    }
+    islandStart.push_back(rows.size());
 
-    //index of current force
-    Index k = 0;
+    //islands touch separate parts of 'velocity', so they can go in parallel
+    ThreadPool::Default().For(islandStart.size() - 1, [&](std::size_t i)
+    {
+        SolveIsland(islandStart[i], islandStart[i + 1], velocity);
+    });
 
-    //First pass: forces that oppose gravity
-    for (auto& contact : contacts)
+    //save the impulses for the next tick, and turn them into forces for the
+    //integrator
+    force = gravity;
+    for (std::size_t g = 0; g < order.size(); ++g)
     {
-        SparseV c = GenContact(contact);
-        
-        //handle contact impulses
-        float badMomentum = -c.dot(state.momentum);
-        if (badMomentum > 0.f)
+        Contact& contact = contacts[order[g]];
+        contact.impulse = rows[g * 3].impulse;
+        contact.tangentImpulse[0] = rows[g * 3 + 1].impulse;
+        contact.tangentImpulse[1] = rows[g * 3 + 2].impulse;
+
+        for (std::size_t i = g * 3; i < g * 3 + 3; ++i)
         {
-            //should this be in the integrator?
-            SparseV dM = c*badMomentum;
-            state.momentum += dM*(1.f + .8f); //restitution
+            const ContactRow& row = rows[i];
+            if (row.a >= 0)
+                force.segment<6>(row.a * 6) += row.ja * (row.impulse / simDt);
+            if (row.b >= 0)
+                force.segment<6>(row.b * 6) += row.jb * (row.impulse / simDt);
         }
-        
-        if (c.dot(gravity) < -.01f)
-        {
-            workspace = c;
-            for (Index j = 0; j < k; ++j)
-            {
-                workspace.tail(m - j).applyHouseholderOnTheLeft(
-                    QR[j].tail(m - j - 1), taus[j], workspace2.data());
-
-                //is c linearly dependent with QR(0..j)?
-                if (workspace.tail(m - j - 1).isZero())
-                    goto next; //early out this loop and continue the outer loop
-            }
+    }
 
-            //form the householder reflector for the current contact
-            float tau;
-            workspace.tail(m - k).makeHouseholderInPlace(tau, workspace[k]);
-            
-            //reflect b by the current column (it is already reflected by
-            //the previous columns)
-            b2 = b;
-            b2.tail(m - k).applyHouseholderOnTheLeft(
-                workspace.tail(m - k - 1), tau, workspace2.data());
-            Eigen::VectorXf xh = x.head(k + 1);
-            xh = b2.head(k + 1);
-            
-            //doing this rowwise instead of columnwise might be faster if we early out
-            
-            //back substitute the current column
-            xh[k] /= workspace[k];
-            xh.head(k) -= xh[k] * workspace.head(k);
-            
-            //did we introduce a non-positive coefficient?
-            if (xh[k] <= 0) goto next;
-
-            //back substitute the previous columns
-            for (Index j = k - 1; j >= 0; --j)
-            {
-                xh[j] /= QR[j][j];
-                xh.head(j) -= xh[j] * QR[j].head(j);
-                
-                //did we introduce a non-positive coefficient?
-                if (xh[j] <= 0) goto next;
-            }
+    //rest long enough, and the whole island goes to sleep
+    for (auto& pair : data)
+    {
+        Props& body = pair.second;
+        if (body.asleep)
+            continue;
+        auto v = velocity.segment<6>(body.index * 6);
+        float energy = .5f * (v.head<3>().squaredNorm() + v.tail<3>().squaredNorm() * body.inertia / body.mass);
+        if (v.head<3>().norm() < sleepVelocity && energy < sleepEnergy)
+            body.restTime += simDt;
+        else
+            body.restTime = 0.f;
+    }
+    islandAwake.assign(islandParent.size(), false);
+    for (auto& pair : data)
+        if (pair.second.restTime < sleepTime)
+            islandAwake[FindIsland(pair.second.index)] = true;
+    for (auto& pair : data)
+        if (!islandAwake[FindIsland(pair.second.index)])
+            pair.second.asleep = true;
 
-            //Success!
-            b = b2; //swap?
-            x.head(k + 1) = xh;
-            QR.push_back(workspace);
-            taus.push_back(tau);
-            active.push_back(c);
-            ++k;
+    //sleeping bodies are held still: no momentum, and whatever they rest on
+    //cancels gravity
+    for (auto& pair : data)
+    {
+        if (pair.second.asleep)
+        {
+            int idx = pair.second.index;
+            state.momentum.segment<6>(idx * 6).setZero();
+            force.segment<6>(idx * 6).setZero();
         }
-    next:
-        ;
     }
-    
-    //Second pass will probably be very neccesary when there are more objects
-    
-    //k is now the number of active forces
 
-    VectorXf normalForce = VectorXf::Zero(m);
-    
-    for (Index j = 0; j < k; ++j)
-        normalForce += active[j] * x[j];
-
-    //if (k > 0)
-    //	std::cerr << "\n\n" << k << "\n\n" << x << "\n\n" << normalForce << "\n\n";
-    //float T = (.5f * state.inverseIntertia * state.momentum).dot(state.momentum);
-    //float K = state.mass * 9.8f * state.position[2];
-    //std::cerr << "H = " << T + K << "\n";
-
-    integrate(state, simTime,
-        [=](const State& state, Time::clock::duration t)
+    switch (integrator)
     {
-        return std::make_tuple(gravity, normalForce);
-    });
+    case Integrator::RK4: IntegrateRK4(); break;
+    case Integrator::SemiImplicitEuler: IntegrateSemiImplicit(); break;
+    case Integrator::Leapfrog: IntegrateLeapfrog(); break;
+    }
 
     for (auto& pair : data)
     {
+        //leaving them alone also lets collision reuse their contacts
+        if (pair.second.asleep)
+            continue;
         Transform xfrm = position[pair.first].get();
         xfrm.pos = state.location.block<3, 1>(pair.second.index * 3, 0);
         xfrm.rot = &state.orientation[pair.second.index * 4];
         position[pair.first].set(xfrm);
     }
+    writingPositions = false;
 
     debug.End();
 }
 
 RigidBody::RigidBody(Position& position, Collision& collision,
     RenderPasses& passes)
-	: paused(false), position(position), collision(collision), debug(passes)
+	: paused(false), iterations(10), friction(.5f), restitution(.8f)
+    , integrator(Integrator::RK4), position(position), collision(collision), slots(0)
+    , wake([this](Object obj, const Transform&) { if (!writingPositions) Wake(obj); })
+    , writingPositions(false), debug(passes)
 {}
 
+void RigidBody::Wake(Object obj)
+{
+    if (Has(obj))
+    {
+        Props& body = data[obj];
+        body.asleep = false;
+        body.restTime = 0.f;
+    }
+}
+
+bool RigidBody::Asleep(Object obj) const
+{
+    return Has(obj) && data.at(obj).asleep;
+}
+
 void RigidBody::Load(const Persist& persist)
 {
 	for (const auto& dat : persist.GetAll<RigidBody>())
@@ -330,6 +415,35 @@ void RigidBody::Save(Object obj, Persist& persist) const
 		persist.Delete<RigidBody>(obj);
 }
 
+void RigidBody::Reserve(int capacity)
+{
+    int old = static_cast<int>(gravity.rows() / 6);
+
+    gravity.conservativeResize(capacity * 6);
+    gravity.tail((capacity - old) * 6).setZero();
+    inverseInertia.diagonal().conservativeResize(capacity * 6);
+    inverseInertia.diagonal().tail((capacity - old) * 6).setZero();
+    state.momentum.conservativeResize(capacity * 6);
+    state.momentum.tail((capacity - old) * 6).setZero();
+    state.location.conservativeResize(capacity * 3);
+    state.location.tail((capacity - old) * 3).setZero();
+    state.orientation.conservativeResize(capacity * 4);
+    for (int i = old; i < capacity; ++i)
+        state.orientation.segment<4>(i * 4) = Quaternionf::Identity().coeffs();
+
+    //scratch space doesn't need to be kept
+    force.resize(capacity * 6);
+    velocity.resize(capacity * 6);
+    scratch.momentum.resize(capacity * 6);
+    scratch.location.resize(capacity * 3);
+    scratch.orientation.resize(capacity * 4);
+    for (Derivative& d : stages)
+    {
+        d.velocity.resize(capacity * 3);
+        d.spin.resize(capacity * 4);
+    }
+}
+
 void RigidBody::Add(Object o, float mass, float inertia)
 {
     int index;
@@ -340,50 +454,30 @@ void RigidBody::Add(Object o, float mass, float inertia)
     }
     else
     {
-        index = (int)data.size();
-        
-        VectorXf g{(index + 1) * 6};
-        g << gravity, 0,0,0,0,0,0;
-        gravity = std::move(g);
-        
-        VectorXf momentum{(index + 1) * 6};
-        momentum << state.momentum, 0,0,0,0,0,0;
-        state.momentum = std::move(momentum);
-        
-        VectorXf location{(index + 1) * 3};
-        location << state.location, 0,0,0;
-        state.location = std::move(location);
-        
-        VectorXf orientation{(index + 1) * 4};
-        orientation << state.orientation, 0,0,0,0;
-        state.orientation = std::move(orientation);
-        
-        VectorXf invIn{(index + 1) * 6};
-        invIn << inverseInertia.diagonal(), 0,0,0,0,0,0;
-        inverseInertia.diagonal() = invIn;
+        index = slots++;
+        //grow geometrically so adding bodies doesn't copy everything each time
+        if (index * 6 == gravity.rows())
+            Reserve(std::max(16, index * 2));
     }
     
-    gravity.block<6, 1>(index * 6, 0).setZero();
-    gravity[index * 6 + 2] = -9.8 * mass;
+    gravity.segment<6>(index * 6).setZero();
+    gravity[index * 6 + 2] = -9.8f * mass;
     
-    state.momentum.block<3, 1>(index * 6, 0).setZero();
-	inverseInertia.diagonal().block<6, 1>(index*6, 0) <<
+    state.momentum.segment<6>(index * 6).setZero();
+	inverseInertia.diagonal().segment<6>(index * 6) <<
 		1.f/mass, 1.f / mass, 1.f / mass,
 		1.f/inertia, 1.f / inertia, 1.f / inertia;
     
-	data.try_emplace(o, Props{index, mass, inertia});
-    
-    
-    //set z components
-    //Eigen::VectorXf gravity(momentum.rows());
-    //for (size_t idx = 0; idx < order.size(); ++idx)
-    //    gravity[idx*6 + 2] = -9.8f * data[order[idx]].mass;
+	data.try_emplace(o, Props{index, mass, inertia, 0.f, false});
+    position.Watch(o, make_magic(wake, o));
+    //moving things collide as their convex hulls
+    collision.UseHull(o);
 }
 
 void RigidBody::Unload(const Persist& persist)
 {
     for (const auto& dat : persist.GetAll<RigidBody>())
-        data.erase(std::get<0>(dat));
+        Remove(std::get<0>(dat));
 }
 bool RigidBody::Has(Object obj) const
 {
@@ -391,11 +485,83 @@ bool RigidBody::Has(Object obj) const
 }
 void RigidBody::Remove(Object obj)
 {
-    freeIndexes.push_back(data[obj].index);
+    if (!Has(obj))
+        return;
+
+    int index = data[obj].index;
+    //stop simulating the slot
+    gravity.segment<6>(index * 6).setZero();
+    state.momentum.segment<6>(index * 6).setZero();
+    inverseInertia.diagonal().segment<6>(index * 6).setZero();
+
+    freeIndexes.push_back(index);
     data.erase(obj);
+    position.Unwatch(obj, make_magic(wake, obj));
+    collision.UseHull(obj, false);
 }
 
 template<>
 const char* PersistSchema<RigidBody>::name = "rigidbody";
 template<>
 Columns PersistSchema<RigidBody>::cols = { "object", "mass", "inertia" };
+
+//Check
+
+bool RigidBodyAllocationCheck(Position& position, Collision& collision, RigidBody& rigidBody)
+{
+    Object floor;
+    position[floor]->pos = { 0, 0, -.5f };
+    collision.Add(floor, Primitive{ Primitive::Kind::Box, Vector3f{ 20, 20, .5f } });
+
+    std::vector<Object> pile(64);
+    for (std::size_t i = 0; i < pile.size(); ++i)
+    {
+        collision.Add(pile[i], Primitive{ i % 2 ? Primitive::Kind::Box : Primitive::Kind::Sphere, Vector3f::Constant(.5f) });
+        rigidBody.Add(pile[i], 1, 1);
+    }
+    //moving them wakes them up and stops them
+    auto drop = [&]()
+    {
+        for (std::size_t i = 0; i < pile.size(); ++i)
+            position[pile[i]]->pos = { float(i % 4) * 1.5f, float(i / 4 % 4) * 1.5f, 1.f + float(i / 16) * 1.5f };
+    };
+
+    const RigidBody::Integrator integrators[] = {
+        RigidBody::Integrator::RK4,
+        RigidBody::Integrator::SemiImplicitEuler,
+        RigidBody::Integrator::Leapfrog,
+    };
+    //buffers grow while the pile lands, so only the later ticks count
+    const int warmup = 120, ticks = 120;
+    Time::clock::duration simTime{ 0 };
+    std::size_t failures = 0;
+
+    for (auto integrator : integrators)
+    {
+        rigidBody.integrator = integrator;
+        drop();
+        for (int tick = 0; tick < warmup + ticks; ++tick)
+        {
+            if (tick == warmup)
+                failures = AllocationCheck::Failures();
+            //a settled pile would go to sleep and skip the solver, which is
+            //the part being checked
+            if (tick >= warmup)
+                for (Object obj : pile)
+                    rigidBody.Wake(obj);
+            collision.PhysTick();
+            rigidBody.PhysTick(simTime += Time::dt);
+            if (tick >= warmup && collision.Contacts().empty())
+            {
+                std::cerr << "integrator " << static_cast<int>(integrator) << " pile has no contacts\n";
+                return false;
+            }
+        }
+        if (AllocationCheck::Failures() != failures)
+        {
+            std::cerr << "integrator " << static_cast<int>(integrator) << " allocates\n";
+            return false;
+        }
+    }
+    return true;
+}
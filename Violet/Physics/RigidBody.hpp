@@ -6,10 +6,8 @@
 #include "Core/Time.hpp"
 
 #include "Utils/DebugBoxes.hpp"
+#include "Position.hpp"
 
-#include "Eigen/SparseCore"
-
-class Position;
 class Collision;
 
 struct Contact;
@@ -26,17 +24,33 @@ public:
 	RigidBody(Position&, Collision&, RenderPasses&);
 	void Add(Object o, float mass, float inertia);
 	void PhysTick(Time::clock::duration simTime);
+
+    //Bodies at rest sleep until something touches or moves them
+    void Wake(Object o);
+    bool Asleep(Object o) const;
     
     bool& Debug() { return debug.enabled; }
     bool paused;
+    //contact solver settings
+    int iterations;
+    float friction, restitution;
+
+    enum class Integrator
+    {
+        RK4,
+        SemiImplicitEuler,
+        Leapfrog,
+    };
+    Integrator integrator;
     
+    //One element per body slot. Slots are allocated in advance and unused
+    //ones have no mass, so nothing is allocated during a tick.
     struct State
     {
         Eigen::VectorXf
             location, // in 3-vectors
             orientation, // in quaternions
-            momentum, // in 6-vectors (linear[3], angular[3])
-            badWork; // in scalars
+            momentum; // in 6-vectors (linear[3], angular[3])
     };
     
 private:
@@ -51,26 +65,55 @@ private:
     {
         int index; //of the vector elements
         float mass, inertia;
+        float restTime; //how long it's been still
+        bool asleep;
     };
 	l_unordered_map<Object, Props> data;
     std::vector<int> freeIndexes;
-    
-    using SparseV = Eigen::SparseVector<float>;
-    //using SparseM = Eigen::SparseMatrix<float>;
+    int slots; //in use, including free ones
+    void Reserve(int capacity);
     
     Eigen::VectorXf gravity;
-    
-    SparseV GenContact1(Object obj, Vector3f point, Vector3f normal) const;
-    SparseV GenContact(const Contact& c) const;
+    //total force for this tick, and the velocity the solver works on
+    Eigen::VectorXf force, velocity;
+
+    //Contact solver:
+    //one constraint direction of a contact, touching at most two bodies
+    struct ContactRow
+    {
+        int a, b; //body indices, or -1 for things that only collide
+        GenCoord ja, jb;
+        float effectiveMass, bias, impulse;
+    };
+    //three rows per contact, the normal and two friction directions, grouped
+    //by island
+    std::vector<ContactRow> rows;
+    //contacts being solved, and where each island's rows start
+    std::vector<std::size_t> order, islandStart;
+    //union-find over body indices
+    std::vector<int> islandParent;
+    std::vector<bool> islandAwake;
+
+    void AddContactRows(const Contact& c, const Eigen::VectorXf& velocity);
+    float RowVelocity(const ContactRow& row, const Eigen::VectorXf& velocity) const;
+    void ApplyImpulse(const ContactRow& row, float impulse, Eigen::VectorXf& velocity) const;
+    int FindIsland(int body);
+    void SolveIsland(std::size_t begin, std::size_t end, Eigen::VectorXf& velocity);
     
     //integrator
-    struct Derivative;
-    void advance(State& s, const Derivative& d, float dt);
-    template<typename F>
-    Derivative step(const State& initial, float alpha, const Derivative* d,
-                    Time::clock::duration t, F forces);
-    template<typename F>
-    void integrate(State& state, Time::clock::duration t, F forces);
+    struct Derivative
+    {
+        Eigen::VectorXf velocity; // in 3-vectors
+        Eigen::VectorXf spin; //derivative of quaternion
+    };
+    State scratch;
+    Derivative stages[4];
+    void Derive(const State& s, Derivative& out) const;
+    void Stage(float alpha, const Derivative& d, Derivative& out);
+    void Rotate(int idx, const Vector3f& angularVelocity, float dt);
+    void IntegrateRK4();
+    void IntegrateSemiImplicit();
+    void IntegrateLeapfrog();
 
 	void Load(const Persist&);
 	void Unload(const Persist&);
@@ -78,9 +121,18 @@ private:
 	void Save(Object, Persist&) const;
     void Remove(Object);
     
+    //wakes bodies moved by someone else
+    accessor<Transform, Object> wake;
+    bool writingPositions;
+
     DebugBoxes debug;
 };
 
 MAKE_PERSIST_TRAITS(RigidBody, Object, float, float)
 
+//drop a pile of boxes and balls on a floor and, after they've had time to
+//hit it, check that ticks don't allocate. Only means something with
+//COUNT_ALLOCATIONS defined.
+bool RigidBodyAllocationCheck(Position&, Collision&, RigidBody&);
+
 #endif
@@ -20,6 +20,29 @@ bool Transform::operator!=(const Transform& other) const
 	return !operator==(other);
 }
 
+Transform operator*(const Transform& l, const Transform& r)
+{
+	Transform ret;
+	ret.pos = l * r.pos;
+	ret.rot = l.rot * r.rot;
+	ret.scale = l.scale * r.scale;
+	return ret;
+}
+
+Vector3f operator*(const Transform& t, const Vector3f& point)
+{
+	return t.pos + t.rot * (t.scale * point);
+}
+
+Transform Inverse(const Transform& t)
+{
+	Transform ret;
+	ret.rot = t.rot.conjugate();
+	ret.scale = 1.f / t.scale;
+	ret.pos = ret.rot * (-t.pos * ret.scale);
+	return ret;
+}
+
 std::ostream & operator<<(std::ostream &os, const Transform& p)
 {
 	return os << p.pos.transpose() << ", " << p.rot.w() << ' ' << p.rot.vec().transpose()
@@ -45,16 +68,31 @@ const Transform& Position::Get(Object obj)
 	return data[obj].loc;
 }
 
+const Transform& Position::At(Object obj) const
+{
+	return data.at(obj).loc;
+}
+
 void Position::Set(Object obj, const Transform& t)
 {
 	auto& dat = data[obj];
 	dat.loc = t;
-	dat.target.set(t);
+	for (auto& target : dat.targets)
+		target.set(t);
 }
 
 void Position::Watch(Object obj, magic_ptr<Transform> w)
 {
-	data[obj].target += w;
+	data[obj].targets.push_back(w);
+}
+
+void Position::Unwatch(Object obj, magic_ptr<Transform> w)
+{
+	auto it = data.find(obj);
+	if (it == data.end())
+		return;
+	auto& targets = it->second.targets;
+	targets.erase(std::remove(targets.begin(), targets.end(), w), targets.end());
 }
 
 void Position::Load(const Persist& persist)
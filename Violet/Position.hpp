@@ -32,6 +32,11 @@ struct Transform
 	using PersistCategory = BinaryPersistTag;
 };
 
+//l * r applies r, then l
+Transform operator*(const Transform& l, const Transform& r);
+Vector3f operator*(const Transform& t, const Vector3f& point);
+Transform Inverse(const Transform& t);
+
 class Position : public Component
 {
 	struct ObjData;
@@ -41,8 +46,11 @@ public:
 
 	magic_ptr<Transform> operator[](Object obj);
 	const Transform& Get(Object obj);
+	//doesn't add the object, so several threads can look at once
+	const Transform& At(Object obj) const;
 	void Set(Object obj, const Transform& t);
 	void Watch(Object obj, magic_ptr<Transform> w);
+	void Unwatch(Object obj, magic_ptr<Transform> w);
 
 	//void Add(Object obj);
 	void Load(const Persist&);
@@ -55,7 +63,7 @@ private:
 	struct ObjData
 	{
 		Transform loc;
-		magic_ptr<Transform> target;
+		std::vector<magic_ptr<Transform>> targets;
 		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 	};
 
@@ -1,6 +1,8 @@
 #ifndef BUFFER_OBJECT_HPP
 #define BUFFER_OBJECT_HPP
 
+#include "GLState.hpp"
+
 struct IgnoreTypeT {};
 static IgnoreTypeT IgnoreType;
 
@@ -10,6 +12,7 @@ class BufferObject
 public:
     ~BufferObject()
     {
+        GLState::DeletedBuffer(buffer);
         glDeleteBuffers(1, &buffer);
     }
 
@@ -124,13 +127,13 @@ public:
 
     void Bind() const
     {
-        glBindBuffer(target, buffer);
+        GLState::BindBuffer(target, buffer);
 	}
 
 	void Bind(GLuint index) const
 	{
 		static_assert(target == GL_UNIFORM_BUFFER, "Only uniform buffers can be bound to an index");
-		glBindBufferBase(target, index, buffer);
+		GLState::BindBufferBase(target, index, buffer);
 	}
 
     size_t Size() const
@@ -143,7 +146,7 @@ public:
     public:
         void Bind() const
         {
-            glBindBufferBase(target, index, buffer);
+            GLState::BindBufferBase(target, index, buffer);
         }
 
         IndexedBindProxy(GLuint index)
@@ -169,7 +172,7 @@ public:
     public:
         ~Mapping()
         {
-            glBindBuffer(target, buffer);
+            GLState::BindBuffer(target, buffer);
             glUnmapBuffer(target);
         }
         T* begin() {return begin_ptr;}
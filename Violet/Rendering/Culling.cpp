@@ -0,0 +1,32 @@
+#include "stdafx.h"
+#include "Culling.hpp"
+
+//Gribb and Hartmann: each plane is the last row of the matrix plus or minus
+//one of the others
+Frustum::Frustum(const Matrix4f& viewProj)
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		planes[2 * i] = (viewProj.row(3) + viewProj.row(i)).transpose();
+		planes[2 * i + 1] = (viewProj.row(3) - viewProj.row(i)).transpose();
+	}
+	for (auto& plane : planes)
+		plane /= plane.head<3>().norm();
+}
+
+unsigned Inside(const Frustum& frustum, const SphereLanes& spheres)
+{
+	SimdFloat x = SimdFloat::Load(spheres.x), y = SimdFloat::Load(spheres.y),
+		z = SimdFloat::Load(spheres.z);
+	SimdFloat negRadius = SimdFloat(0.f) - SimdFloat::Load(spheres.radius);
+
+	auto outside = [&](const Vector4f& p)
+	{
+		return SimdFloat(p.x()) * x + SimdFloat(p.y()) * y + SimdFloat(p.z()) * z
+			+ SimdFloat(p.w()) < negRadius;
+	};
+	SimdMask out = outside(frustum.planes[0]);
+	for (std::size_t i = 1; i < frustum.planes.size(); ++i)
+		out = out | outside(frustum.planes[i]);
+	return ~out.Bits() & ((1u << SphereLanes::width) - 1);
+}
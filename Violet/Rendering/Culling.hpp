@@ -0,0 +1,25 @@
+#ifndef CULLING_HPP
+#define CULLING_HPP
+
+#include "Utils/Simd.hpp"
+#include <array>
+
+//The six planes around what a view projection matrix can see, facing in
+struct Frustum
+{
+	Frustum(const Matrix4f& viewProj);
+	std::array<Vector4f, 6> planes;
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+//Bounding spheres, one per SIMD lane
+struct SphereLanes
+{
+	static const int width = SimdFloat::width;
+	SimdAlign float x[width], y[width], z[width], radius[width];
+};
+
+//bit i is set if sphere i is at least partly inside
+unsigned Inside(const Frustum& frustum, const SphereLanes& spheres);
+
+#endif
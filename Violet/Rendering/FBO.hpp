@@ -2,6 +2,7 @@
 #define FBO_HPP
 
 #include "Texture.hpp"
+#include "BufferObject.hpp"
 
 class RenderBuffer
 {
@@ -41,6 +42,7 @@ public:
 	void AttachDepth(RenderBuffer&& rb);
 	void AttachDepth(Tex tex);
 	Tex& Texture(GLuint num) { return texes[num]; }
+	TexDim Dim() const { return dim; }
 
 	template<typename... Colors>
 	void PreDraw(const Colors&... colors)
@@ -94,4 +96,66 @@ private:
 	std::unique_ptr<Tex> depthTex;
 };
 
+//Reads a pixel back without stalling. Request starts a copy into a pixel
+//buffer, and Poll hands it over once a fence says the GPU is done, usually a
+//frame or two later.
+template<typename Pixel>
+class PixelReadback
+{
+public:
+	PixelReadback()
+		: buffer(1), fence(nullptr)
+	{
+		GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+	PixelReadback(const PixelReadback&) = delete;
+	~PixelReadback()
+	{
+		if (fence)
+			glDeleteSync(fence);
+	}
+
+	//only one read is in flight at a time; this is false if one already is
+	bool Request(const FBO& fbo, GLuint texNum, TexDim texel)
+	{
+		if (fence)
+			return false;
+
+		auto bound = fbo.Bind(GL_READ_FRAMEBUFFER);
+		glReadBuffer(GL_COLOR_ATTACHMENT0 + texNum);
+		buffer.Bind();
+		//with a pack buffer bound, the pointer is an offset into it
+		glReadPixels(texel.x(), texel.y(), 1, 1,
+			PixelTraits<Pixel>::format, PixelTraits<Pixel>::type, nullptr);
+		GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		return true;
+	}
+
+	//true if the last request has arrived, which goes in 'out'
+	bool Poll(Pixel& out)
+	{
+		if (!fence)
+			return false;
+		//don't wait, but make sure the fence gets to the GPU
+		if (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+			return false;
+		glDeleteSync(fence);
+		fence = nullptr;
+
+		{
+			auto mapping = buffer.Map(GL_READ_ONLY);
+			out = *mapping.begin();
+		}
+		GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		return true;
+	}
+
+	bool Pending() const { return fence != nullptr; }
+
+private:
+	BufferObject<Pixel, GL_PIXEL_PACK_BUFFER, GL_STREAM_READ> buffer;
+	GLsync fence;
+};
+
 #endif
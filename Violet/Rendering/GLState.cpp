@@ -0,0 +1,174 @@
+#include "stdafx.h"
+#include "GLState.hpp"
+
+#include <iostream>
+#include <map>
+
+//no real object has this name
+static const GLuint UNKNOWN = ~0u;
+
+static GLuint program = UNKNOWN;
+static GLuint activeUnit = UNKNOWN;
+static std::vector<GLuint> textures;
+static std::map<GLenum, GLuint> buffers;
+static std::map<std::pair<GLenum, GLuint>, GLuint> indexedBuffers;
+//nothing else binds VAOs, and VAO::Binding needs something to go back to
+static GLuint vertexArray = 0;
+static std::map<GLenum, bool> enabled;
+static GLState::Counts counts = {0, 0};
+
+//true if the call is needed, and remembers the new value
+template<class T>
+static bool Set(T& cached, T value)
+{
+	if (cached == value)
+	{
+		++counts.skipped;
+		return false;
+	}
+	++counts.issued;
+	cached = value;
+	return true;
+}
+
+static GLuint& Cached(std::map<GLenum, GLuint>& map, GLenum key)
+{
+	return map.emplace(key, UNKNOWN).first->second;
+}
+
+void GLState::UseProgram(GLuint prog)
+{
+	if (Set(program, prog))
+		glUseProgram(prog);
+}
+
+void GLState::ActiveTexture(GLuint unit)
+{
+	if (Set(activeUnit, unit))
+		glActiveTexture(static_cast<GLenum>(static_cast<GLuint>(GL_TEXTURE0) + unit));
+}
+
+void GLState::BindTexture(GLuint texture)
+{
+	//we don't know which unit this is going to
+	if (activeUnit == UNKNOWN)
+	{
+		++counts.issued;
+		glBindTexture(GL_TEXTURE_2D, texture);
+		return;
+	}
+	if (textures.size() <= activeUnit)
+		textures.resize(activeUnit + 1, UNKNOWN);
+	if (Set(textures[activeUnit], texture))
+		glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+void GLState::BindTexture(GLuint unit, GLuint texture)
+{
+	if (unit < textures.size() && textures[unit] == texture)
+	{
+		++counts.skipped;
+		return;
+	}
+	ActiveTexture(unit);
+	BindTexture(texture);
+}
+
+void GLState::BindBuffer(GLenum target, GLuint buffer)
+{
+	if (Set(Cached(buffers, target), buffer))
+		glBindBuffer(target, buffer);
+}
+
+void GLState::BindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+	auto& cached = indexedBuffers.emplace(std::make_pair(target, index), UNKNOWN).first->second;
+	if (Set(cached, buffer))
+	{
+		glBindBufferBase(target, index, buffer);
+		Cached(buffers, target) = buffer;
+	}
+}
+
+void GLState::BindVertexArray(GLuint vao)
+{
+	if (Set(vertexArray, vao))
+	{
+		glBindVertexArray(vao);
+		Cached(buffers, GL_ELEMENT_ARRAY_BUFFER) = UNKNOWN;
+	}
+}
+
+GLuint GLState::VertexArray()
+{
+	return vertexArray;
+}
+
+void GLState::Enable(GLenum cap)
+{
+	auto it = enabled.find(cap);
+	if (it != enabled.end() && it->second)
+	{
+		++counts.skipped;
+		return;
+	}
+	++counts.issued;
+	enabled[cap] = true;
+	glEnable(cap);
+}
+
+void GLState::Disable(GLenum cap)
+{
+	auto it = enabled.find(cap);
+	if (it != enabled.end() && !it->second)
+	{
+		++counts.skipped;
+		return;
+	}
+	++counts.issued;
+	enabled[cap] = false;
+	glDisable(cap);
+}
+
+void GLState::DeletedTexture(GLuint texture)
+{
+	for (auto& bound : textures)
+		if (bound == texture)
+			bound = 0;
+}
+
+void GLState::DeletedBuffer(GLuint buffer)
+{
+	for (auto& bound : buffers)
+		if (bound.second == buffer)
+			bound.second = 0;
+	//it isn't clear whether indexed bindings are reset too
+	for (auto& bound : indexedBuffers)
+		if (bound.second == buffer)
+			bound.second = UNKNOWN;
+}
+
+void GLState::DeletedVertexArray(GLuint vao)
+{
+	if (vertexArray == vao)
+	{
+		vertexArray = 0;
+		Cached(buffers, GL_ELEMENT_ARRAY_BUFFER) = UNKNOWN;
+	}
+}
+
+GLState::Counts GLState::GetCounts()
+{
+	return counts;
+}
+
+void GLState::ResetCounts()
+{
+	counts = {0, 0};
+}
+
+void GLState::PrintCounts()
+{
+	std::cout << "GL state calls: " << counts.issued << " issued, "
+		<< counts.skipped << " skipped\n";
+}
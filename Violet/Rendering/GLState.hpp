@@ -0,0 +1,45 @@
+#ifndef GL_STATE_HPP
+#define GL_STATE_HPP
+
+//A shadow of the GL state the wrappers touch, so binding what's already bound
+//costs a compare instead of a driver call. Everything that binds a program,
+//texture, buffer or VAO, or flips an enable flag, has to come through here or
+//the shadow goes stale. Apart from the VAO, which starts at 0, nothing is
+//known until it's set through here, so the first call always goes through.
+namespace GLState
+{
+	void UseProgram(GLuint program);
+
+	//texture units are numbers from 0, not GL_TEXTUREi
+	void ActiveTexture(GLuint unit);
+	//GL_TEXTURE_2D on the active unit
+	void BindTexture(GLuint texture);
+	//both at once, only switching units if the texture isn't already there
+	void BindTexture(GLuint unit, GLuint texture);
+
+	void BindBuffer(GLenum target, GLuint buffer);
+	//also binds the generic target, like GL does
+	void BindBufferBase(GLenum target, GLuint index, GLuint buffer);
+
+	//the element buffer belongs to the VAO, so it's forgotten when this changes
+	void BindVertexArray(GLuint vao);
+	GLuint VertexArray();
+
+	void Enable(GLenum cap);
+	void Disable(GLenum cap);
+
+	//deleting a bound object unbinds it
+	void DeletedTexture(GLuint texture);
+	void DeletedBuffer(GLuint buffer);
+	void DeletedVertexArray(GLuint vao);
+
+	struct Counts
+	{
+		std::size_t issued, skipped;
+	};
+	Counts GetCounts();
+	void ResetCounts();
+	void PrintCounts();
+}
+
+#endif
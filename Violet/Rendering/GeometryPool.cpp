@@ -0,0 +1,134 @@
+#include "stdafx.h"
+#include "GeometryPool.hpp"
+#include "VAO.hpp"
+
+#include <algorithm>
+
+//big enough for a few hundred props, small enough that a layout used by one
+//little mesh doesn't waste much
+static const GLsizei POOL_VERTS = 1 << 16;
+static const GLsizei POOL_INDS = 1 << 18;
+
+GLint GeometryPool::Spans::Alloc(GLsizei size)
+{
+	if (size == 0)
+		return 0;
+	for (auto it = free.begin(); it != free.end(); ++it)
+	{
+		if (it->second < size)
+			continue;
+		GLint begin = it->first;
+		if (it->second > size)
+			free[begin + size] = it->second - size;
+		free.erase(it);
+		return begin;
+	}
+	return -1;
+}
+
+void GeometryPool::Spans::Free(GLint begin, GLsizei size)
+{
+	if (size == 0)
+		return;
+	auto next = free.lower_bound(begin);
+	if (next != free.end() && begin + size == next->first)
+	{
+		size += next->second;
+		next = free.erase(next);
+	}
+	if (next != free.begin())
+	{
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == begin)
+		{
+			prev->second += size;
+			return;
+		}
+	}
+	free[begin] = size;
+}
+
+GeometryPool::GeometryPool(const std::string& format, GLsizei stride, GLsizei verts, GLsizei inds)
+	: format(format), stride(stride)
+	, vertexBuffer(static_cast<size_t>(verts) * stride), indexBuffer(inds)
+	, vertSpans(verts), indSpans(inds)
+{}
+
+std::vector<std::weak_ptr<GeometryPool>>& GeometryPool::Pools()
+{
+	static std::vector<std::weak_ptr<GeometryPool>> pools;
+	return pools;
+}
+
+std::shared_ptr<GeometryPool> GeometryPool::Add(const std::string& format, GLsizei stride,
+	range<const char*> verts, range<const char*> inds, Range& where)
+{
+	//the index buffer binds would attach it to whatever VAO is bound
+	auto unbound = VAO::Unbind();
+	auto& pools = Pools();
+	pools.erase(std::remove_if(pools.begin(), pools.end(),
+		[](const std::weak_ptr<GeometryPool>& pool) { return pool.expired(); }),
+		pools.end());
+
+	for (const auto& weak : pools)
+	{
+		auto pool = weak.lock();
+		if (pool->format == format && pool->TryAdd(verts, inds, where))
+			return pool;
+	}
+
+	//meshes too big for a pool get one to themselves
+	auto numVerts = static_cast<GLsizei>(verts.size() / stride);
+	auto numInds = static_cast<GLsizei>(inds.size() / sizeof(GLint));
+	auto pool = std::make_shared<GeometryPool>(format, stride,
+		std::max(numVerts, POOL_VERTS), std::max(numInds, POOL_INDS));
+	pool->TryAdd(verts, inds, where);
+	pools.push_back(pool);
+	return pool;
+}
+
+bool GeometryPool::TryAdd(range<const char*> verts, range<const char*> inds, Range& where)
+{
+	where.numVerts = static_cast<GLsizei>(verts.size() / stride);
+	where.numInds = static_cast<GLsizei>(inds.size() / sizeof(GLint));
+
+	where.baseVertex = vertSpans.Alloc(where.numVerts);
+	if (where.baseVertex < 0)
+		return false;
+	where.firstIndex = indSpans.Alloc(where.numInds);
+	if (where.firstIndex < 0)
+	{
+		vertSpans.Free(where.baseVertex, where.numVerts);
+		return false;
+	}
+
+	vertexBuffer.Bind();
+	glBufferSubData(GL_ARRAY_BUFFER, where.baseVertex * stride, verts.size(), verts.begin());
+	indexBuffer.Bind();
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, where.firstIndex * sizeof(GLint), inds.size(), inds.begin());
+	return true;
+}
+
+void GeometryPool::Remove(const Range& where)
+{
+	vertSpans.Free(where.baseVertex, where.numVerts);
+	indSpans.Free(where.firstIndex, where.numInds);
+}
+
+void GeometryPool::Read(const Range& where, std::vector<char>& verts, std::vector<GLint>& inds) const
+{
+	verts.resize(static_cast<std::size_t>(where.numVerts) * stride);
+	inds.resize(where.numInds);
+	auto unbound = VAO::Unbind();
+	vertexBuffer.Bind();
+	glGetBufferSubData(GL_ARRAY_BUFFER, where.baseVertex * stride, verts.size(), verts.data());
+	indexBuffer.Bind();
+	glGetBufferSubData(GL_ELEMENT_ARRAY_BUFFER, where.firstIndex * sizeof(GLint),
+		inds.size() * sizeof(GLint), inds.data());
+}
+
+void GeometryPool::Bind() const
+{
+	indexBuffer.Bind();
+	vertexBuffer.Bind();
+}
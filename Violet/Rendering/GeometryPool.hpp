@@ -0,0 +1,60 @@
+#ifndef GEOMETRY_POOL_HPP
+#define GEOMETRY_POOL_HPP
+
+#include "BufferObject.hpp"
+#include "Containers/WrappedIterator.hpp"
+
+#include <map>
+
+//Big vertex and index buffers which meshes with the same vertex layout are
+//packed into, so one VAO can draw any of them with a base vertex. Pools never
+//grow, so VAOs never have to rebind them; once one is full, another is made.
+class GeometryPool
+{
+public:
+	//where a mesh went, in vertices and indices
+	struct Range
+	{
+		GLint baseVertex;
+		GLsizei numVerts;
+		GLsizei firstIndex;
+		GLsizei numInds;
+	};
+
+	//upload the mesh into a pool with this layout, making one if none has room.
+	//'format' is anything which is equal exactly when the layouts are.
+	static std::shared_ptr<GeometryPool> Add(const std::string& format, GLsizei stride,
+		range<const char*> verts, range<const char*> inds, Range& where);
+	void Remove(const Range& where);
+	void Read(const Range& where, std::vector<char>& verts, std::vector<GLint>& inds) const;
+
+	//attach both buffers to the bound VAO
+	void Bind() const;
+
+	GeometryPool(const std::string& format, GLsizei stride, GLsizei verts, GLsizei inds);
+	GeometryPool(const GeometryPool&) = delete;
+
+private:
+	//first fit over the free spans, which are merged as they're freed
+	class Spans
+	{
+	public:
+		Spans(GLsizei size) { free[0] = size; }
+		//-1 if there's no room
+		GLint Alloc(GLsizei size);
+		void Free(GLint begin, GLsizei size);
+	private:
+		std::map<GLint, GLsizei> free; //start to length
+	};
+
+	std::string format;
+	GLsizei stride;
+	BufferObject<char, GL_ARRAY_BUFFER, GL_STATIC_DRAW> vertexBuffer;
+	BufferObject<GLint, GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW> indexBuffer;
+	Spans vertSpans, indSpans;
+
+	bool TryAdd(range<const char*> verts, range<const char*> inds, Range& where);
+	static std::vector<std::weak_ptr<GeometryPool>>& Pools();
+};
+
+#endif
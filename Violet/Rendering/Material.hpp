@@ -34,14 +34,18 @@ public:
 	std::vector<Tex>& Textures();
 	const std::vector<Tex>& Textures() const;
 
-	//Todo: cache friendly
+	//binds only what isn't already bound, so switching between materials
+	//which share a shader or textures is cheap
 	void use() const;
 
 	void Save(Persist& persist) const;
 	Id Key() const;
 	using PersistCategory = EmbeddedResourcePersistTag;
+	HAS_HASH
 };
 
+MEMBER_HASH(Material, resource)
+
 MAKE_PERSIST_TRAITS(Material, Material::Id, std::string,
 	ShaderProgram, UBO::BufferTy, std::vector<Tex>)
 
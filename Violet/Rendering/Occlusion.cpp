@@ -0,0 +1,260 @@
+#include "stdafx.h"
+#include "Occlusion.hpp"
+
+#include "Utils/Simd.hpp"
+#include "Utils/Parallel.hpp"
+#include "Utils/Profiling.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <iostream>
+
+static const int TILES_X = OcclusionBuffer::width / OcclusionBuffer::tileSize;
+static const int TILES_Y = OcclusionBuffer::height / OcclusionBuffer::tileSize;
+static_assert(OcclusionBuffer::tileSize % SimdFloat::width == 0, "Tiles must be whole SIMD runs");
+//anything closer to the eye plane than this isn't projected. Occluders there
+//are dropped and boxes there are visible, which is conservative either way.
+static const float MIN_W = 1e-3f;
+static const float FAR_DEPTH = 1.f;
+
+OcclusionBuffer::OcclusionBuffer()
+    : viewProj(Matrix4f::Identity())
+    , bins(TILES_Y)
+    , depth(width * height, FAR_DEPTH)
+    , tileFar(TILES_X * TILES_Y, FAR_DEPTH)
+{}
+
+void OcclusionBuffer::Clear(const Matrix4f& newViewProj)
+{
+    viewProj = newViewProj;
+    tris.clear();
+    for (auto& bin : bins)
+        bin.clear();
+    std::fill(depth.begin(), depth.end(), FAR_DEPTH);
+    std::fill(tileFar.begin(), tileFar.end(), FAR_DEPTH);
+}
+
+static bool Project(const Matrix4f& mat, const Vector3f& p, Vector3f& out)
+{
+    Vector4f clip = mat * Vector4f{ p.x(), p.y(), p.z(), 1.f };
+    if (clip.w() < MIN_W)
+        return false;
+    Vector3f ndc = clip.head<3>() / clip.w();
+    out = { (ndc.x() * .5f + .5f) * OcclusionBuffer::width,
+        (ndc.y() * .5f + .5f) * OcclusionBuffer::height, ndc.z() };
+    return true;
+}
+
+void OcclusionBuffer::Add(const Mesh& mesh, const Matrix4f& model)
+{
+    Matrix4f toScreen = viewProj * model;
+    for (const Triangle& tri : mesh)
+    {
+        ScreenTri st;
+        if (!Project(toScreen, tri.col(0), st.a) || !Project(toScreen, tri.col(1), st.b)
+            || !Project(toScreen, tri.col(2), st.c))
+            continue;
+
+        float minX = std::min({ st.a.x(), st.b.x(), st.c.x() });
+        float maxX = std::max({ st.a.x(), st.b.x(), st.c.x() });
+        float minY = std::min({ st.a.y(), st.b.y(), st.c.y() });
+        float maxY = std::max({ st.a.y(), st.b.y(), st.c.y() });
+        float minZ = std::min({ st.a.z(), st.b.z(), st.c.z() });
+        if (maxX < 0 || minX >= width || maxY < 0 || minY >= height || minZ > FAR_DEPTH)
+            continue;
+
+        auto index = static_cast<std::uint32_t>(tris.size());
+        tris.push_back(st);
+        int first = std::max(0, static_cast<int>(minY) / tileSize);
+        int last = std::min(TILES_Y - 1, static_cast<int>(maxY) / tileSize);
+        for (int row = first; row <= last; ++row)
+            bins[row].push_back(index);
+    }
+}
+
+void OcclusionBuffer::Rasterize()
+{
+    auto p = Profile("occlusion raster");
+    //rows don't share pixels, so they can go in any order
+    ThreadPool::Default().For(TILES_Y, [this](std::size_t row)
+    {
+        RasterizeBin(static_cast<int>(row));
+    });
+}
+
+void OcclusionBuffer::RasterizeBin(int row)
+{
+    for (std::uint32_t tri : bins[row])
+        DrawTriangle(tris[tri], row);
+
+    for (int tx = 0; tx < TILES_X; ++tx)
+    {
+        float farthest = -FAR_DEPTH;
+        for (int y = row * tileSize; y < (row + 1) * tileSize; ++y)
+        {
+            const float* line = &depth[y * width + tx * tileSize];
+            farthest = std::max(farthest, *std::max_element(line, line + tileSize));
+        }
+        tileFar[row * TILES_X + tx] = farthest;
+    }
+}
+
+//Edge functions and depth are planes over the screen, so a run of pixels is
+//a few multiply-adds
+void OcclusionBuffer::DrawTriangle(const ScreenTri& tri, int row)
+{
+    Vector3f a = tri.a, b = tri.b, c = tri.c;
+    auto edge = [](const Vector3f& from, const Vector3f& to, const Vector2f& p)
+    {
+        return (to.x() - from.x()) * (p.y() - from.y()) - (to.y() - from.y()) * (p.x() - from.x());
+    };
+    float area = edge(a, b, c.head<2>());
+    if (std::abs(area) < 1e-6f)
+        return;
+    if (area < 0) //both windings are occluders
+    {
+        std::swap(b, c);
+        area = -area;
+    }
+
+    //E(p) = dx * p.x + dy * p.y + e0, for the edges opposite a, b, and c
+    struct Plane { float dx, dy, e0; };
+    auto edgePlane = [&](const Vector3f& from, const Vector3f& to)
+    {
+        float e0 = edge(from, to, Vector2f::Zero());
+        return Plane{ edge(from, to, Vector2f::UnitX()) - e0, edge(from, to, Vector2f::UnitY()) - e0, e0 };
+    };
+    Plane edges[] = { edgePlane(b, c), edgePlane(c, a), edgePlane(a, b) };
+    //z is the barycentric blend of the corners
+    Plane z{ 0, 0, 0 };
+    const float corners[] = { a.z(), b.z(), c.z() };
+    for (int i = 0; i < 3; ++i)
+    {
+        z.dx += edges[i].dx * corners[i] / area;
+        z.dy += edges[i].dy * corners[i] / area;
+        z.e0 += edges[i].e0 * corners[i] / area;
+    }
+
+    int minX = std::max(0, static_cast<int>(std::min({ a.x(), b.x(), c.x() })));
+    int maxX = std::min(width - 1, static_cast<int>(std::max({ a.x(), b.x(), c.x() })));
+    int minY = std::max(row * tileSize, static_cast<int>(std::min({ a.y(), b.y(), c.y() })));
+    int maxY = std::min((row + 1) * tileSize - 1, static_cast<int>(std::max({ a.y(), b.y(), c.y() })));
+    minX -= minX % SimdFloat::width;
+
+    SimdAlign float laneOffsets[SimdFloat::width];
+    for (int i = 0; i < SimdFloat::width; ++i)
+        laneOffsets[i] = i + .5f;
+    SimdFloat lanes = SimdFloat::Load(laneOffsets);
+    SimdFloat zero = 0.f;
+
+    for (int y = minY; y <= maxY; ++y)
+    {
+        float py = y + .5f;
+        for (int x = minX; x <= maxX; x += SimdFloat::width)
+        {
+            SimdFloat px = lanes + SimdFloat(float(x));
+            SimdMask outside = edges[0].dx * px + SimdFloat(edges[0].dy * py + edges[0].e0) < zero;
+            for (int i = 1; i < 3; ++i)
+                outside = outside | (edges[i].dx * px + SimdFloat(edges[i].dy * py + edges[i].e0) < zero);
+            if (outside.Bits() == (1u << SimdFloat::width) - 1)
+                continue;
+
+            float* out = &depth[y * width + x];
+            SimdFloat pz = z.dx * px + SimdFloat(z.dy * py + z.e0);
+            SimdFloat old = SimdFloat::Load(out);
+            Select(outside, old, Min(old, pz)).Store(out);
+        }
+    }
+}
+
+bool OcclusionBuffer::Visible(const AlignedBox3f& box) const
+{
+    Vector2f lo = Vector2f::Constant(std::numeric_limits<float>::max()), hi = -lo;
+    float nearest = std::numeric_limits<float>::max();
+    for (int i = 0; i < 8; ++i)
+    {
+        Vector3f p;
+        if (!Project(viewProj, box.corner(static_cast<AlignedBox3f::CornerType>(i)), p))
+            return true;
+        lo = lo.cwiseMin(p.head<2>());
+        hi = hi.cwiseMax(p.head<2>());
+        nearest = std::min(nearest, p.z());
+    }
+
+    //occluders are only known at pixel centers, so test the centers inside
+    //the box and the nearest one past each side, which bracket the whole box
+    if (hi.x() < 0.f || lo.x() > width || hi.y() < 0.f || lo.y() > height) //off screen
+        return false;
+    int x0 = std::max(0, static_cast<int>(std::floor(lo.x() - .5f)));
+    int x1 = std::min(width - 1, static_cast<int>(std::ceil(hi.x() - .5f)));
+    int y0 = std::max(0, static_cast<int>(std::floor(lo.y() - .5f)));
+    int y1 = std::min(height - 1, static_cast<int>(std::ceil(hi.y() - .5f)));
+
+    for (int ty = y0 / tileSize; ty <= y1 / tileSize; ++ty)
+        for (int tx = x0 / tileSize; tx <= x1 / tileSize; ++tx)
+        {
+            if (nearest > tileFar[ty * TILES_X + tx])
+                continue; //behind everything in the tile
+
+            for (int y = std::max(y0, ty * tileSize); y <= std::min(y1, (ty + 1) * tileSize - 1); ++y)
+                for (int x = std::max(x0, tx * tileSize); x <= std::min(x1, (tx + 1) * tileSize - 1); ++x)
+                    if (nearest <= depth[y * width + x])
+                        return true;
+        }
+    return false;
+}
+
+//Check
+
+bool OcclusionCheck()
+{
+    //a unit quad in the z = 0 plane, moved to the middle of the screen. With
+    //an identity view, NDC is world space.
+    Vector3f corners[] = { { -1, -1, 0 }, { 1, -1, 0 }, { 1, 1, 0 }, { -1, 1, 0 } };
+    Mesh quad = {
+        (Triangle() << corners[0], corners[1], corners[2]).finished(),
+        (Triangle() << corners[0], corners[2], corners[3]).finished(),
+    };
+    Matrix4f model = (Eigen::Translation3f(.1f, 0, 0) * Eigen::Scaling(.5f)).matrix();
+
+    OcclusionBuffer buffer;
+    buffer.Clear(Matrix4f::Identity());
+    buffer.Add(quad, model);
+    buffer.Rasterize();
+
+    struct Case
+    {
+        const char* name;
+        AlignedBox3f box;
+        bool visible;
+    };
+    const Case cases[] = {
+        { "behind", { Vector3f{ -.2f, -.2f, .2f }, Vector3f{ .2f, .2f, .4f } }, false },
+        { "in front", { Vector3f{ -.2f, -.2f, -.4f }, Vector3f{ .2f, .2f, -.2f } }, true },
+        { "through", { Vector3f{ -.2f, -.2f, -.1f }, Vector3f{ .2f, .2f, .1f } }, true },
+        { "beside", { Vector3f{ .7f, -.2f, .2f }, Vector3f{ .9f, .2f, .4f } }, true },
+        { "over the edge", { Vector3f{ .5f, -.2f, .2f }, Vector3f{ .7f, .2f, .4f } }, true },
+        { "off screen", { Vector3f{ 1.2f, -.2f, .2f }, Vector3f{ 1.4f, .2f, .4f } }, false },
+    };
+
+    bool ok = true;
+    for (const Case& c : cases)
+    {
+        if (buffer.Visible(c.box) == c.visible)
+            continue;
+        std::cerr << "occlusion: box " << c.name << " should be "
+            << (c.visible ? "visible" : "hidden") << "\n";
+        ok = false;
+    }
+
+    //an empty buffer hides nothing
+    buffer.Clear(Matrix4f::Identity());
+    buffer.Rasterize();
+    if (!buffer.Visible(cases[0].box))
+    {
+        std::cerr << "occlusion: empty buffer hides a box\n";
+        ok = false;
+    }
+    return ok;
+}
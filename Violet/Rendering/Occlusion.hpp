@@ -0,0 +1,54 @@
+#ifndef OCCLUSION_HPP
+#define OCCLUSION_HPP
+
+#include "Geometry/Shapes.hpp"
+#include <cstdint>
+
+//A small depth buffer drawn on the CPU from a few big occluders, to skip
+//drawing what's behind them. Triangles are binned into rows of tiles which are
+//rasterized in parallel, a SIMD run of pixels at a time. Each tile keeps its
+//farthest depth, so most tests never look at pixels. Depths are NDC z.
+class OcclusionBuffer
+{
+public:
+    static const int width = 256, height = 128, tileSize = 8;
+
+    OcclusionBuffer();
+    //start over with a new view
+    void Clear(const Matrix4f& viewProj);
+    //queue up the triangles of a mesh
+    void Add(const Mesh& mesh, const Matrix4f& model);
+    //draw everything queued, on the thread pool
+    void Rasterize();
+
+    //false if the world space box is certainly hidden
+    bool Visible(const AlignedBox3f& box) const;
+
+    float Depth(int x, int y) const { return depth[y * width + x]; }
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+    Matrix4f viewProj;
+
+    //in pixels, with NDC z
+    struct ScreenTri
+    {
+        Vector3f a, b, c;
+    };
+    std::vector<ScreenTri> tris;
+    //the triangles touching each row of tiles
+    std::vector<std::vector<std::uint32_t>> bins;
+
+    std::vector<float> depth;
+    std::vector<float> tileFar;
+
+    void RasterizeBin(int row);
+    void DrawTriangle(const ScreenTri& tri, int row);
+};
+
+//rasterize a quad and test boxes in front of, behind, and beside it. Needs no
+//GPU, so it runs before the window is made. False if any answer was wrong.
+bool OcclusionCheck();
+
+#endif
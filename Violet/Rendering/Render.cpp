@@ -4,67 +4,383 @@
 #include "Position.hpp"
 #include "Mobile.hpp"
 #include "File/Persist.hpp"
+#include "Geometry/Mesh.hpp"
+#include "Utils/Parallel.hpp"
+#include "Utils/RadixSort.hpp"
+#include "StaticBatch.hpp"
 
-using namespace Render_detail;
+#include <cstring>
+#include <cmath>
+
+//Draw order, from the top bit down: pass, shader, material, VAO, batch, then
+//depth front to back. There is only the one pass so far.
+static const int PASS_BITS = 4, SHADER_BITS = 10, MAT_BITS = 12, VAO_BITS = 8,
+	BATCH_BITS = 14, DEPTH_BITS = 16;
+static_assert(PASS_BITS + SHADER_BITS + MAT_BITS + VAO_BITS + BATCH_BITS + DEPTH_BITS == 64,
+	"Sort key fields don't fill the key");
+static const std::uint32_t STATIC_INST = 1u << 31;
+//instances per job when building the queue
+static const std::size_t QUEUE_CHUNK = 1024;
+//width of the grid cells static objects are merged in
+static const float STATIC_CELL = 32.f;
+static const std::uint32_t NO_BATCH = ~0u;
+//the transform part of the instance attributes, which is all merged chunks
+//take from the instance
+static const Schema chunkInstSchema = {
+	AttribProperties{ "posScale", GL_FLOAT, false, 0, {4, 1}, 0 },
+	AttribProperties{ "rotation", GL_FLOAT, false, 4 * sizeof(float), {4, 1}, 0 },
+};
+
+static std::uint32_t MatId(std::uint64_t key)
+{
+	return static_cast<std::uint32_t>(key >> (VAO_BITS + BATCH_BITS + DEPTH_BITS)) & ((1u << MAT_BITS) - 1);
+}
+
+//'toDepth' is the last row of the view projection matrix. Positive floats
+//sort like their bits, so keep the top ones (below the sign).
+static std::uint64_t DepthKey(const Vector4f& toDepth, const Vector3f& center)
+{
+	float w = std::max(0.f, toDepth.head<3>().dot(center) + toDepth.w());
+	std::uint32_t bits;
+	std::memcpy(&bits, &w, sizeof(bits));
+	return bits >> (31 - DEPTH_BITS);
+}
+
+//Spheres are tested a SIMD batch at a time. The boxes around the ones in the
+//frustum are then tested against the occluders. sphere(i, center, radius)
+//fills in sphere i, or returns false to skip it, and visible(i, center) is
+//called for the ones left.
+template<class Sphere, class Visible>
+static void CullSpheres(std::size_t begin, std::size_t end,
+	const Frustum* frustum, const OcclusionBuffer* occlusion, Sphere sphere, Visible visible)
+{
+	SphereLanes lanes;
+	std::size_t which[SphereLanes::width];
+	while (begin != end)
+	{
+		int n = 0;
+		for (; n < SphereLanes::width && begin != end; ++begin)
+		{
+			Vector3f center;
+			float radius;
+			if (!sphere(begin, center, radius))
+				continue;
+			lanes.x[n] = center.x();
+			lanes.y[n] = center.y();
+			lanes.z[n] = center.z();
+			lanes.radius[n] = radius;
+			which[n++] = begin;
+		}
+
+		unsigned inside = frustum ? Inside(*frustum, lanes) : ~0u;
+		for (int i = 0; i < n; ++i)
+		{
+			if (!(inside & (1u << i)))
+				continue;
+			Vector3f center{ lanes.x[i], lanes.y[i], lanes.z[i] };
+			Vector3f extent = Vector3f::Constant(lanes.radius[i]);
+			if (!occlusion || occlusion->Visible({ center - extent, center + extent }))
+				visible(which[i], center);
+		}
+	}
+}
 
 Render::Render(Position& position)
 	: position(position), mobile(position)
+	, mergedMeshes(0), staticBatching(true)
+	, staticMoved([this](Object obj, const Transform& xfrm)
+	{
+		auto it = sBucket.index.find(obj);
+		if (it != sBucket.index.end())
+		{
+			RemoveFromChunk(it->second);
+			sBucket.insts[it->second] = xfrm;
+			AddToChunk(it->second);
+		}
+	})
+	, cull(true), occlusionCull(true)
 {}
 
-template<GLenum bufferUsage>
-void Render::Bucket<bufferUsage>::FixInstances()
+template<class T>
+std::uint32_t Render::IdTable<T>::Add(const T& item, std::uint32_t limit)
 {
-	GLsizei offset = 0;
+	auto found = index.find(item);
+	if (found != index.end())
+	{
+		++refs[found->second];
+		return found->second;
+	}
 
-	for (auto& shader : data)
-		for (auto& ss : data.children<MatLevel>(shader))
-			for (auto& vao : data.children<VAOLevel>(ss))
-			{
-				auto numInstances =
-					static_cast<GLsizei>(data.children<InstanceLevel>(vao).size());
-				vao.first.BindInstanceData(shader.first, instances, offset, numInstances);
-				offset += numInstances;
-			}
+	std::uint32_t id;
+	if (!free.empty())
+	{
+		id = free.back();
+		free.pop_back();
+		items[id] = item;
+	}
+	else
+	{
+		id = static_cast<std::uint32_t>(items.size());
+		if (id == limit)
+			throw std::runtime_error("Too many distinct shaders or materials to sort");
+		items.push_back(item);
+		refs.push_back(0);
+	}
+	index.emplace(item, id);
+	refs[id] = 1;
+	return id;
 }
 
-template<GLenum bufferUsage>
-render_data_t::perma_refs_t
-Render::Bucket<bufferUsage>::Create(
-	Object obj, Material mat,
-	VertexData vertData, const InstData& inst)
+template<class T>
+void Render::IdTable<T>::Release(std::uint32_t id)
 {
-	auto refs = data.emplace(mat.Shader(), mat, std::tie(mat.Shader(), vertData), inst);
-	objs.insert(std::make_pair(obj, refs));
-	FixInstances();
-	return refs;
+	if (--refs[id])
+		return;
+	index.erase(items[id]);
+	free.push_back(id);
 }
 
-void Render::InternalCreate(Object obj, Material mat, VertexData vertData)
+Render::SharedVAO::SharedVAO(ShaderProgram shader, VertexData vertData)
+	: shader(shader), pool(vertData.Pool()), vao(shader, vertData), refs(0)
+{}
+
+Render::Batch::Batch(Material mat, VertexData vertData)
+	: mat(mat), mesh(vertData), vao(0), sphere(vertData.BoundingSphere()), key(0), refs(0)
+{}
+
+std::uint32_t Render::AddVAO(const ShaderProgram& shader, const VertexData& vertData)
 {
-	mBucket.Create(obj, mat, vertData, InstData{ obj, position.Get(obj).ToMatrix() });
-	//send the actual data each draw call
-	mBucket.instances.Data(mBucket.data.get_level<InstanceLevel>().size());
+	auto found = vaoIndex.find({ shader, vertData.Pool() });
+	if (found != vaoIndex.end())
+	{
+		++vaos[found->second].refs;
+		return found->second;
+	}
+
+	std::uint32_t id;
+	if (!freeVAOs.empty())
+	{
+		id = freeVAOs.back();
+		freeVAOs.pop_back();
+		vaos[id] = SharedVAO{ shader, vertData };
+	}
+	else
+	{
+		id = static_cast<std::uint32_t>(vaos.size());
+		if (id == 1u << VAO_BITS)
+			throw std::runtime_error("Too many distinct shader and vertex format pairs to sort");
+		vaos.emplace_back(shader, vertData);
+	}
+	vaoIndex.emplace(std::make_pair(shader, vertData.Pool()), id);
+	vaos[id].refs = 1;
+	return id;
 }
 
-void Render::InternalCreateStatic(Object obj, Material mat, VertexData vertData)
+std::uint32_t Render::AddBatch(const Material& mat, const VertexData& vertData)
+{
+	auto found = batchIndex.find({ mat, vertData });
+	if (found != batchIndex.end())
+	{
+		++batches[found->second].refs;
+		return found->second;
+	}
+
+	std::uint32_t id;
+	if (!freeBatches.empty())
+	{
+		id = freeBatches.back();
+		freeBatches.pop_back();
+		batches[id] = Batch{ mat, vertData };
+	}
+	else
+	{
+		id = static_cast<std::uint32_t>(batches.size());
+		if (id == 1u << BATCH_BITS)
+			throw std::runtime_error("Too many distinct material and mesh pairs to sort");
+		batches.emplace_back(mat, vertData);
+	}
+	batchIndex.emplace(std::make_pair(mat, vertData), id);
+
+	Batch& batch = batches[id];
+	std::uint64_t shader = shaderIds.Add(batch.mat.Shader(), 1u << SHADER_BITS);
+	std::uint64_t material = matIds.Add(mat, 1u << MAT_BITS);
+	batch.vao = AddVAO(batch.mat.Shader(), vertData);
+	batch.key = shader << (MAT_BITS + VAO_BITS + BATCH_BITS + DEPTH_BITS)
+		| material << (VAO_BITS + BATCH_BITS + DEPTH_BITS)
+		| std::uint64_t(batch.vao) << (BATCH_BITS + DEPTH_BITS)
+		| std::uint64_t(id) << DEPTH_BITS;
+	batch.refs = 1;
+	return id;
+}
+
+void Render::ReleaseBatch(std::uint32_t id)
+{
+	Batch& batch = batches[id];
+	if (--batch.refs)
+		return;
+	batchIndex.erase({ batch.mat, batch.mesh });
+	freeBatches.push_back(id);
+	//let go of the mesh now, so merged ones give back their space in the pool
+	batch.mat = Material{};
+	batch.mesh = VertexData{ UnitBox };
+	shaderIds.Release(static_cast<std::uint32_t>(batch.key >> (MAT_BITS + VAO_BITS + BATCH_BITS + DEPTH_BITS)));
+	matIds.Release(MatId(batch.key));
+
+	SharedVAO& vao = vaos[batch.vao];
+	if (--vao.refs)
+		return;
+	vaoIndex.erase({ vao.shader, vao.pool });
+	freeVAOs.push_back(batch.vao);
+}
+
+void Render::Bucket::Add(Object obj, std::uint32_t b, const InstData& inst)
 {
-	using InstPermaRef = render_data_t::perma_ref_t<InstanceLevel>;
-	static accessor<Transform, InstPermaRef> locaccesor = 
-		[this](InstPermaRef ref, const Transform& v) mutable
+	index[obj] = insts.size();
+	insts.push_back(inst);
+	batch.push_back(b);
+	chunk.push_back(nullptr);
+}
+
+std::uint32_t Render::Bucket::Remove(Object obj)
+{
+	auto it = index.find(obj);
+	std::size_t i = it->second;
+	std::uint32_t ret = batch[i];
+	index.erase(it);
+
+	if (i + 1 != insts.size())
+	{
+		insts[i] = insts.back();
+		batch[i] = batch.back();
+		chunk[i] = chunk.back();
+		index[insts[i].obj] = i;
+	}
+	insts.pop_back();
+	batch.pop_back();
+	chunk.pop_back();
+	return ret;
+}
+
+//Spheres are moved by each instance's transform. Static instances which
+//were merged are drawn with their chunk instead.
+void Render::Enqueue(const Bucket& bucket, std::uint32_t flag, std::size_t begin, std::size_t end,
+	const Frustum* frustum, const OcclusionBuffer* occlusion, const Matrix4f& viewProj,
+	std::vector<DrawItem>& out) const
+{
+	Vector4f toDepth = viewProj.row(3);
+	bool skipMerged = flag == STATIC_INST && staticBatching;
+	CullSpheres(begin, end, frustum, occlusion,
+		[&](std::size_t i, Vector3f& center, float& radius)
+		{
+			if (skipMerged && bucket.chunk[i] && bucket.chunk[i]->batch != NO_BATCH)
+				return false;
+			const InstData& inst = bucket.insts[i];
+			const auto& sphere = batches[bucket.batch[i]].sphere;
+			center = inst.Pos() + inst.rot * (sphere.head<3>() * inst.Scale());
+			radius = sphere.w() * inst.Scale();
+			return true;
+		},
+		[&](std::size_t i, const Vector3f& center)
+		{
+			out.push_back({ batches[bucket.batch[i]].key | DepthKey(toDepth, center),
+				static_cast<std::uint32_t>(i) | flag });
+		});
+}
+
+void Render::AddToChunk(std::size_t i)
+{
+	const Batch& batch = batches[sBucket.batch[i]];
+	//without positions, there's nothing to cull it with
+	if (!std::isfinite(batch.sphere.w()))
+		return;
+
+	Vector3f cell = sBucket.insts[i].Pos() / STATIC_CELL;
+	ChunkKey key{ MatId(batch.key), batch.mesh.Layout(), batch.mesh.Mode(),
+		int(std::floor(cell.x())), int(std::floor(cell.y())), int(std::floor(cell.z())) };
+	StaticChunk& chunk = staticChunks.emplace(key, StaticChunk{ {}, NO_BATCH, false }).first->second;
+	chunk.objs.push_back(sBucket.insts[i].obj);
+	chunk.dirty = true;
+	sBucket.chunk[i] = &chunk;
+}
+
+void Render::RemoveFromChunk(std::size_t i)
+{
+	StaticChunk* chunk = sBucket.chunk[i];
+	if (!chunk)
+		return;
+	auto& objs = chunk->objs;
+	objs.erase(std::find(objs.begin(), objs.end(), sBucket.insts[i].obj));
+	chunk->dirty = true;
+	sBucket.chunk[i] = nullptr;
+}
+
+void Render::BuildChunks()
+{
+	bool changed = false;
+	for (auto it = staticChunks.begin(); it != staticChunks.end();)
+	{
+		StaticChunk& chunk = it->second;
+		if (!chunk.dirty)
+		{
+			++it;
+			continue;
+		}
+
+		changed = true;
+		if (chunk.batch != NO_BATCH)
+			ReleaseBatch(chunk.batch);
+		chunk.batch = NO_BATCH;
+		if (chunk.objs.empty())
 		{
-			auto it = sBucket.data.find<InstanceLevel>(ref);
-			it->mat = v.ToMatrix();
-			size_t offset = it - sBucket.data.begin<InstanceLevel>();
-			sBucket.instances.Assign(offset, *it);
-		};
+			it = staticChunks.erase(it);
+			continue;
+		}
 
-	auto inst = InstData{ obj, position.Get(obj).ToMatrix() };
-	auto refs = sBucket.Create(obj, mat, vertData, inst);
+		//one object isn't worth a copy
+		chunk.dirty = false;
+		if (chunk.objs.size() > 1)
+		{
+			std::vector<VertexData> meshes;
+			std::vector<const MeshCopy*> copies;
+			std::vector<InstData> insts;
+			for (Object obj : chunk.objs)
+			{
+				std::size_t i = sBucket.index[obj];
+				meshes.push_back(batches[sBucket.batch[i]].mesh);
+				copies.push_back(&staticSources.at(meshes.back()).copy);
+				insts.push_back(sBucket.insts[i]);
+			}
+			Material mat = batches[sBucket.batch[sBucket.index[chunk.objs[0]]]].mat;
+			VertexData merged = MergeStatic("static chunk " + to_string(mergedMeshes++), meshes, copies, insts);
+			chunk.batch = AddBatch(mat, merged);
+		}
+		++it;
+	}
+
+	if (changed)
+	{
+		chunkBatches.clear();
+		for (const auto& chunk : staticChunks)
+			if (chunk.second.batch != NO_BATCH)
+				chunkBatches.push_back(chunk.second.batch);
+	}
+}
+
+void Render::InternalCreate(Object obj, Material mat, VertexData vertData)
+{
+	mBucket.Add(obj, AddBatch(mat, vertData), InstData{ obj, position.Get(obj) });
+}
+
+void Render::InternalCreateStatic(Object obj, Material mat, VertexData vertData)
+{
+	//once per mesh, rather than every time a chunk with it is rebuilt
+	SourceMesh& source = staticSources.emplace(vertData, SourceMesh{}).first->second;
+	if (!source.users++)
+		vertData.Read(source.copy.verts, source.copy.inds);
 
-	auto instref = std::get<InstanceLevel>(refs);
-	position.Watch(obj, make_magic(locaccesor, instref));
-	//send the data now
-	sBucket.instances.Data(sBucket.data.get_level<InstanceLevel>().vector());
+	sBucket.Add(obj, AddBatch(mat, vertData), InstData{ obj, position.Get(obj) });
+	AddToChunk(sBucket.insts.size() - 1);
+	position.Watch(obj, make_magic(staticMoved, obj));
 }
 
 void Render::Create(Object obj, std::tuple<Material, VertexData, Mobilty> tup)
@@ -80,36 +396,118 @@ void Render::Create(Object obj, Material mat, VertexData vertData, Mobilty mobil
 		InternalCreateStatic(obj, mat, vertData);
 }
 
-template<GLenum bufferUsage>
-void Render::Bucket<bufferUsage>::Draw()
+void Render::Draw(float alpha, const Matrix4f& viewProj)
 {
-	for (auto& shader : data)
+	if (staticBatching)
+		BuildChunks();
+	mobile.Update(alpha, mBucket.insts.begin(), mBucket.insts.end());
+
+	const OcclusionBuffer* occlusionTest = nullptr;
+	if (cull && occlusionCull && !occluders.empty())
 	{
-		shader.first.use();
-		for (auto& ss : data.children<MatLevel>(shader))
-		{
-			ss.first.use();
-			for (auto& vao : data.children<VAOLevel>(ss))
+		occlusion.Clear(viewProj);
+		for (const auto& occluder : occluders)
+			occlusion.Add(occluder.second, position.Get(occluder.first).ToMatrix());
+		occlusion.Rasterize();
+		occlusionTest = &occlusion;
+	}
+
+	//cull and build keys in chunks, then gather them up to sort
+	Frustum frustum{ viewProj };
+	std::size_t mChunks = (mBucket.insts.size() + QUEUE_CHUNK - 1) / QUEUE_CHUNK;
+	std::size_t numChunks = mChunks + (sBucket.insts.size() + QUEUE_CHUNK - 1) / QUEUE_CHUNK;
+	if (chunks.size() < numChunks)
+		chunks.resize(numChunks);
+	ThreadPool::Default().For(numChunks, [&](std::size_t chunk)
+	{
+		bool isStatic = chunk >= mChunks;
+		const Bucket& bucket = isStatic ? sBucket : mBucket;
+		std::size_t first = (isStatic ? chunk - mChunks : chunk) * QUEUE_CHUNK;
+		chunks[chunk].clear();
+		Enqueue(bucket, isStatic ? STATIC_INST : 0,
+			first, std::min(first + QUEUE_CHUNK, bucket.insts.size()),
+			cull ? &frustum : nullptr, occlusionTest, viewProj, chunks[chunk]);
+	});
+
+	queue.clear();
+	for (std::size_t chunk = 0; chunk < numChunks; ++chunk)
+		queue.insert(queue.end(), chunks[chunk].begin(), chunks[chunk].end());
+	chunkQueue.clear();
+	if (staticBatching)
+	{
+		Vector4f toDepth = viewProj.row(3);
+		CullSpheres(0, chunkBatches.size(), cull ? &frustum : nullptr, occlusionTest,
+			[&](std::size_t i, Vector3f& center, float& radius)
 			{
-				vao.first.Draw();
-			}
+				const auto& sphere = batches[chunkBatches[i]].sphere;
+				center = sphere.head<3>();
+				radius = sphere.w();
+				return true;
+			},
+			[&](std::size_t i, const Vector3f& center)
+			{
+				chunkQueue.push_back({ batches[chunkBatches[i]].key | DepthKey(toDepth, center), 0 });
+			});
+	}
+	RadixSort(queue, sortScratch, [](const DrawItem& item) { return item.key; });
+	RadixSort(chunkQueue, sortScratch, [](const DrawItem& item) { return item.key; });
+
+	//merged chunks are already in place, so they all draw with the identity
+	//at the end
+	InstData* out = instances.Begin(queue.size() + 1);
+	for (std::size_t i = 0; i < queue.size(); ++i)
+	{
+		std::uint32_t inst = queue[i].inst;
+		out[i] = inst & STATIC_INST ? sBucket.insts[inst & ~STATIC_INST] : mBucket.insts[inst];
+	}
+	out[queue.size()] = InstData{};
+	instances.End(queue.size() + 1);
+	auto identity = static_cast<GLsizei>(instances.Offset() + queue.size());
+
+	//one draw per batch, switching material only when it changes. Batches
+	//in the same pool are next to each other, so the VAO rarely changes.
+	//Chunks are merged in by key, one draw each.
+	std::uint64_t curMat = ~std::uint64_t(0);
+	for (std::size_t begin = 0, end, nextChunk = 0;
+		begin < queue.size() || nextChunk < chunkQueue.size(); begin = end)
+	{
+		bool isChunk = nextChunk < chunkQueue.size()
+			&& (begin == queue.size() || chunkQueue[nextChunk].key < queue[begin].key);
+		std::uint64_t run = (isChunk ? chunkQueue[nextChunk++] : queue[begin]).key >> DEPTH_BITS;
+		end = begin;
+		if (!isChunk)
+			for (end = begin + 1; end < queue.size() && queue[end].key >> DEPTH_BITS == run; ++end)
+				;
+
+		Batch& batch = batches[run & ((1u << BATCH_BITS) - 1)];
+		if (run >> (VAO_BITS + BATCH_BITS) != curMat)
+		{
+			batch.mat.use();
+			curMat = run >> (VAO_BITS + BATCH_BITS);
 		}
+		VAO& vao = vaos[batch.vao].vao;
+		//merged meshes have the object in each vertex, so only the transform
+		//comes from the instance
+		if (isChunk)
+			vao.BindInstanceData(batch.mat.Shader(), instances.Buffer(), chunkInstSchema, identity, 1);
+		else
+			vao.BindInstanceData(batch.mat.Shader(), instances.Buffer(),
+				static_cast<GLsizei>(instances.Offset() + begin), static_cast<GLsizei>(end - begin));
+		vao.Draw(batch.mesh);
 	}
+	instances.Fence();
 }
 
-void Render::Draw(float alpha)
+Matrix4f InstData::ToMatrix() const
 {
-	auto vec = mBucket.data.get_level<InstanceLevel>().vector();
-	mobile.Update(alpha, vec.begin(), vec.end());
-	mBucket.instances.Data(vec);
-
-	mBucket.Draw(); sBucket.Draw();
+	return (Eigen::Translation3f(Pos()) * Quaternionf(rot) * Eigen::Scaling(Scale())).matrix();
 }
 
 template<>
 const Schema AttribTraits<InstData>::schema = {
-	AttribProperties{ "transform", GL_FLOAT, false, 0, {4, 4}, 4 * sizeof(float) },
-	AttribProperties{ "object", GL_UNSIGNED_INT, true, 16 * sizeof(float), {1, 1}, 0 },
+	AttribProperties{ "posScale", GL_FLOAT, false, 0, {4, 1}, 0 },
+	AttribProperties{ "rotation", GL_FLOAT, false, 4 * sizeof(float), {4, 1}, 0 },
+	AttribProperties{ "object", GL_UNSIGNED_INT, true, 8 * sizeof(float), {1, 1}, 0 },
 };
 
 void Render::Load(const Persist& persist)
@@ -117,6 +515,8 @@ void Render::Load(const Persist& persist)
 	for (const auto& row : persist.GetAll<Render>())
 		Create(std::get<0>(row), std::get<2>(row), std::get<3>(row),
 			std::get<1>(row) ? Mobilty::Yes : Mobilty::No);
+	for (const auto& row : persist.GetAll<RenderOccluder>())
+		Occluder(std::get<0>(row), true);
 }
 
 void Render::Unload(const Persist& persist)
@@ -127,70 +527,87 @@ void Render::Unload(const Persist& persist)
 
 bool Render::Has(Object obj) const
 {
-	return mBucket.objs.count(obj) || sBucket.objs.count(obj);
+	return mBucket.index.count(obj) || sBucket.index.count(obj);
 }
 
-template<GLenum bufferUsage>
-void Render::Bucket<bufferUsage>::Save(Object obj, bool mobile, Persist& persist) const
+const Render::Batch* Render::BatchOf(Object obj, Mobilty& mobile) const
 {
-	auto refs = objs.find(obj)->second;
-	persist.Set<Render>(obj, mobile,
-		data.find<MatLevel>(std::get<MatLevel>(refs))->first,
-		data.find<VAOLevel>(std::get<VAOLevel>(refs))->first.GetVertexData());
+	auto it = mBucket.index.find(obj);
+	if (it != mBucket.index.end())
+	{
+		mobile = Mobilty::Yes;
+		return &batches[mBucket.batch[it->second]];
+	}
+	it = sBucket.index.find(obj);
+	if (it != sBucket.index.end())
+	{
+		mobile = Mobilty::No;
+		return &batches[sBucket.batch[it->second]];
+	}
+	return nullptr;
 }
 
 void Render::Save(Object obj, Persist& persist) const
 {
-	if (mBucket.objs.count(obj))
-		mBucket.Save(obj, true, persist);
-	else if (sBucket.objs.count(obj))
-		sBucket.Save(obj, false, persist);
+	Mobilty mobile;
+	if (const Batch* batch = BatchOf(obj, mobile))
+		persist.Set<Render>(obj, mobile == Mobilty::Yes, batch->mat, batch->mesh);
 	else
 		persist.Delete<Render>(obj);
+
+	if (occluders.count(obj))
+		persist.Set<RenderOccluder>(obj);
+	else
+		persist.Delete<RenderOccluder>(obj);
+}
+
+void Render::Occluder(Object obj, bool occludes)
+{
+	if (!occludes)
+		occluders.erase(obj);
+	else if (Has(obj) && !occluders.count(obj))
+		occluders.emplace(obj, LoadMesh(std::get<1>(Info(obj)).Name()));
 }
 
-template<GLenum bufferUsage>
-void Render::Bucket<bufferUsage>::Remove(Object obj)
+bool Render::IsOccluder(Object obj) const
 {
-	auto refs = objs.find(obj)->second;
-	data.erase(refs);
-	objs.erase(obj);
-	FixInstances();
+	return occluders.count(obj) > 0;
 }
 
 void Render::Remove(Object obj)
 {
-	if (mBucket.objs.count(obj))
+	occluders.erase(obj);
+	if (mBucket.index.count(obj))
 	{
-		mBucket.Remove(obj);
-		mBucket.instances.Data(mBucket.data.get_level<InstanceLevel>().size());
+		mobile.Remove(obj);
+		ReleaseBatch(mBucket.Remove(obj));
 	}
-	else if (sBucket.objs.count(obj))
+	else if (sBucket.index.count(obj))
 	{
-		sBucket.Remove(obj);
-		sBucket.instances.Data(sBucket.data.get_level<InstanceLevel>().vector());
+		position.Unwatch(obj, make_magic(staticMoved, obj));
+		RemoveFromChunk(sBucket.index[obj]);
+		std::uint32_t batch = sBucket.Remove(obj);
+		auto source = staticSources.find(batches[batch].mesh);
+		if (!--source->second.users)
+			staticSources.erase(source);
+		ReleaseBatch(batch);
 	}
 }
 
-template<GLenum bufferUsage>
-std::tuple<Material, VertexData> Render::Bucket<bufferUsage>::Info(Object obj)
-{
-	auto refs = objs.find(obj)->second;
-	return std::make_tuple(
-		data.find<MatLevel>(std::get<MatLevel>(refs))->first,
-		data.find<VAOLevel>(std::get<VAOLevel>(refs))->first.GetVertexData());
-}
-
 std::tuple<Material, VertexData, Mobilty> Render::Info(Object obj)
 {
-	if (mBucket.objs.count(obj))
-		return std::tuple_cat(mBucket.Info(obj), std::make_tuple(Mobilty::Yes));
-	else if (sBucket.objs.count(obj))
-		return std::tuple_cat(sBucket.Info(obj), std::make_tuple(Mobilty::No));
+	Mobilty mobile;
+	if (const Batch* batch = BatchOf(obj, mobile))
+		return std::make_tuple(batch->mat, batch->mesh, mobile);
 	throw std::domain_error(to_string(obj) + " is not being rendered");
 }
 
 template<>
 const char* PersistSchema<Render>::name = "render";
 template<>
-Columns PersistSchema<Render>::cols = { "object", "static", "shader", "ss", "vertdata" };
\ No newline at end of file
+Columns PersistSchema<Render>::cols = { "object", "static", "shader", "ss", "vertdata" };
+
+template<>
+const char* PersistSchema<RenderOccluder>::name = "render_occluder";
+template<>
+Columns PersistSchema<RenderOccluder>::cols = { "object" };
\ No newline at end of file
@@ -7,15 +7,20 @@
 #include "RenderPasses.hpp"
 #include "Material.hpp"
 #include "Mobile.hpp"
-
-#include "Containers/l_bag.hpp"
-#include "Containers/tuple_tree.hpp"
+#include "Culling.hpp"
+#include "Occlusion.hpp"
+#include "StreamBuffer.hpp"
+#include "StaticBatch.hpp"
 
 #include "Core/Component.hpp"
+#include "Utils/Template.hpp"
 
 #include <unordered_set>
 #include <unordered_map>
+#include <map>
 #include <array>
+#include <vector>
+#include <cstdint>
 
 class Position;
 class Persist;
@@ -26,29 +31,33 @@ enum class Mobilty
 	No
 };
 
+//Instances only ever have uniform scale, so the shaders rebuild the matrix
+//from these. Unaligned, so it packs into 36 bytes.
 struct InstData
 {
-	Matrix4f mat;
+	Eigen::Matrix<float, 4, 1, Eigen::DontAlign> posScale; //xyz, then scale
+	Eigen::Quaternion<float, Eigen::DontAlign> rot;
 	Object obj;
 
 	InstData(const InstData&) = default;
-	InstData(Object o) : mat(), obj(o) {}
-	InstData(Object o, const Matrix4f& m) : mat(m), obj(o) {}
-	InstData() : mat(), obj(Object::invalid) {}
-	InstData& operator=(const Matrix4f& m) { mat = m; return *this; }
+	InstData(Object o) : posScale(0, 0, 0, 1), rot(1, 0, 0, 0), obj(o) {}
+	InstData(Object o, const Transform& xfrm) : obj(o) { *this = xfrm; }
+	InstData() : InstData(Object::invalid) {}
+	InstData& operator=(const Transform& xfrm)
+	{
+		posScale << xfrm.pos, xfrm.scale;
+		rot = xfrm.rot;
+		return *this;
+	}
+
+	Vector3f Pos() const { return posScale.head<3>(); }
+	float Scale() const { return posScale.w(); }
+	Matrix4f ToMatrix() const;
 
 	MEMBER_EQUALITY(Object, obj);
 	BASIC_EQUALITY(InstData, obj);
 };
 
-using InstanceVec = l_bag<InstData, Eigen::aligned_allocator<InstData>>;
-
-namespace Render_detail
-{
-	static const int ShaderLevel = 0, MatLevel = 1, VAOLevel = 2, InstanceLevel = 3;
-	using render_data_t = tuple_tree<ShaderProgram, Material, VAO, InstData>;
-}
-
 class Render : public Component
 {
 public:
@@ -61,7 +70,19 @@ public:
 	void Save(Object obj, Persist&) const;
 	void Remove(Object obj);
 
-	void Draw(float alpha);
+	//Instances outside the view are skipped, and the rest are sorted into
+	//draw order and streamed to the GPU each frame
+	void Draw(float alpha, const Matrix4f& viewProj);
+	//off draws everything, to compare
+	bool& FrustumCull() { return cull; }
+	//draw the object's mesh into a CPU depth buffer each frame, and skip
+	//things it hides
+	void Occluder(Object obj, bool occludes);
+	bool IsOccluder(Object obj) const;
+	bool& OcclusionCull() { return occlusionCull; }
+	//merge nearby static objects with the same material into one mesh, which
+	//is rebuilt when one of them changes
+	bool& StaticBatching() { return staticBatching; }
 
 	std::tuple<Material, VertexData, Mobilty> Info(Object obj);
 
@@ -73,32 +94,131 @@ private:
 	Position& position;
 	Mobile mobile;
 
-	template<GLenum bufferUsage>
-	struct Bucket
+	//Meshes in the same geometry pool draw through one VAO per shader
+	struct SharedVAO
+	{
+		ShaderProgram shader;
+		const GeometryPool* pool;
+		VAO vao;
+		std::size_t refs;
+
+		SharedVAO(ShaderProgram shader, VertexData vertData);
+	};
+	std::vector<SharedVAO> vaos;
+	std::unordered_map<std::pair<ShaderProgram, const GeometryPool*>, std::uint32_t> vaoIndex;
+	std::vector<std::uint32_t> freeVAOs;
+
+	//Everything drawn with one material and mesh, as one instanced draw.
+	//Mobile and static instances share these.
+	struct Batch
+	{
+		Material mat;
+		VertexData mesh;
+		std::uint32_t vao;
+		Eigen::Matrix<float, 4, 1, Eigen::DontAlign> sphere; //bounds the mesh
+		std::uint64_t key; //all but the depth bits of the sort key
+		std::size_t refs;
+
+		Batch(Material mat, VertexData vertData);
+	};
+	std::vector<Batch> batches;
+	std::unordered_map<std::pair<Material, VertexData>, std::uint32_t> batchIndex;
+	std::vector<std::uint32_t> freeBatches;
+
+	//Small ids for the sort keys, handed out again once nothing uses them
+	template<class T>
+	struct IdTable
 	{
-		using render_data_t = Render_detail::render_data_t;
+		std::vector<T> items;
+		std::vector<std::size_t> refs;
+		std::unordered_map<T, std::uint32_t> index; //of the ones in use
+		std::vector<std::uint32_t> free;
 
-		render_data_t data;
-		BufferObject<InstData, GL_ARRAY_BUFFER, bufferUsage> instances;
-		std::unordered_map<Object, render_data_t::perma_refs_t> objs;
+		std::uint32_t Add(const T& item, std::uint32_t limit);
+		void Release(std::uint32_t id);
+	};
+	IdTable<ShaderProgram> shaderIds;
+	IdTable<Material> matIds;
 
-		render_data_t::perma_refs_t
-		Create(Object obj, Material mat, VertexData vertData, const InstData& inst);
-		void FixInstances();
-		void Draw();
+	std::uint32_t AddVAO(const ShaderProgram& shader, const VertexData& vertData);
+	std::uint32_t AddBatch(const Material& mat, const VertexData& vertData);
+	void ReleaseBatch(std::uint32_t batch);
 
-		void Save(Object obj, bool mobile, Persist& persist) const;
-		void Remove(Object obj);
-		std::tuple<Material, VertexData> Info(Object obj);
+	//Static objects with the same material and vertex layout in one cell of a
+	//grid, merged so they draw at once but still cull
+	struct StaticChunk
+	{
+		std::vector<Object> objs;
+		std::uint32_t batch; //of the merged mesh, if it's built
+		bool dirty;
 	};
+	//material id, layout, mode, and cell
+	using ChunkKey = std::tuple<std::uint32_t, std::string, GLenum, int, int, int>;
+	std::map<ChunkKey, StaticChunk> staticChunks;
+	std::vector<std::uint32_t> chunkBatches; //of the built ones
+	//the contents of each mesh static objects use, so merging doesn't read
+	//them back from the GPU
+	struct SourceMesh
+	{
+		MeshCopy copy;
+		std::size_t users;
+	};
+	std::unordered_map<VertexData, SourceMesh> staticSources;
+	unsigned mergedMeshes; //to name them
+	bool staticBatching;
 
-	Bucket<GL_STREAM_DRAW> mBucket;
-	Bucket<GL_STATIC_DRAW> sBucket;
+	//Instances in no particular order, with the batch each is in
+	struct Bucket
+	{
+		std::vector<InstData> insts;
+		std::vector<std::uint32_t> batch;
+		std::vector<StaticChunk*> chunk; //only for static instances
+		std::unordered_map<Object, std::size_t> index;
+
+		void Add(Object obj, std::uint32_t batch, const InstData& inst);
+		//swaps the last instance into its place, and returns its batch
+		std::uint32_t Remove(Object obj);
+	};
+
+	Bucket mBucket;
+	Bucket sBucket;
+	accessor<Transform, Object> staticMoved;
+	const Batch* BatchOf(Object obj, Mobilty& mobile) const;
+
+	void AddToChunk(std::size_t inst);
+	void RemoveFromChunk(std::size_t inst);
+	//merge the chunks changed since last time
+	void BuildChunks();
+
+	//an instance to draw this frame. The top bit of inst is set for sBucket.
+	struct DrawItem
+	{
+		std::uint64_t key;
+		std::uint32_t inst;
+	};
+	//one chunk of a bucket, which runs on the thread pool
+	void Enqueue(const Bucket& bucket, std::uint32_t flag, std::size_t begin, std::size_t end,
+		const Frustum* frustum, const OcclusionBuffer* occlusion, const Matrix4f& viewProj,
+		std::vector<DrawItem>& out) const;
+	std::vector<std::vector<DrawItem>> chunks;
+	std::vector<DrawItem> queue, sortScratch;
+	//merged chunks, which have no instances of their own
+	std::vector<DrawItem> chunkQueue;
+
+	bool cull;
+	bool occlusionCull;
+	OcclusionBuffer occlusion;
+	std::unordered_map<Object, Mesh> occluders;
+	//this frame's visible instances, in draw order
+	StreamBuffer<InstData> instances;
 
 	void InternalCreateStatic(Object obj, Material mat, VertexData vertData);
 	void InternalCreate(Object obj, Material mat, VertexData vertData);
 };
 
 MAKE_PERSIST_TRAITS(Render, Object, bool, Material, VertexData);
+//objects which are also drawn into the occlusion buffer
+struct RenderOccluder;
+MAKE_PERSIST_TRAITS(RenderOccluder, Object);
 
 #endif
@@ -2,12 +2,15 @@
 #include "RenderPasses.hpp"
 
 #include "Render.hpp"
+#include "GLState.hpp"
 #include "Window.hpp"
 
 #include "Utils/Math.hpp"
 
 RenderPasses::RenderPasses(Position& p, Window& w, Render& r)
 	: r(r), w(w), mobile(p), camera(Object::invalid)
+	, pickTexel(-1, -1), readTexel(-1, -1), pickedTexel(-1, -1)
+	, pickWanted(false), picked(Object::none)
 	, simpleShader("assets/simple")
 	, commonUBO(simpleShader, "Common")
 	, screenMat("screenMat", { "assets/screen" })
@@ -53,13 +56,14 @@ void RenderPasses::Draw(const Viewport& view, float alpha)
     SetViewport(view);
 
 	//Draw the correct sides of things
-	glEnable(GL_CULL_FACE);
-	glEnable(GL_DEPTH_TEST);
+	GLState::Enable(GL_CULL_FACE);
+	GLState::Enable(GL_DEPTH_TEST);
 
 	//for now it's just this
-	InstData cameraMat(camera);
-	mobile.Update(alpha, &cameraMat, &cameraMat + 1);
-	commonUBO["camera"] = cameraMat.mat; //AffineInverse(cameraMat.mat); //TODO
+	InstData cameraInst(camera);
+	mobile.Update(alpha, &cameraInst, &cameraInst + 1);
+	Matrix4f cameraMat = cameraInst.ToMatrix();
+	commonUBO["camera"] = cameraMat; //AffineInverse(cameraMat); //TODO
 	commonUBO["projection"] = view.PerspMat();
 	commonUBO.Bind();
 
@@ -68,15 +72,21 @@ void RenderPasses::Draw(const Viewport& view, float alpha)
 		fbo.PreDraw(Vector4f{ 0, 0, 0, 0 },
 			Eigen::Matrix<GLuint, 4, 1>{ Object::none.Id(), 0, 0, 0 });
 		//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-		r.Draw(alpha);
+		r.Draw(alpha, view.PerspMat() * cameraMat);
 		//glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
 		for (auto& fn : customs) fn.second(alpha);
 	}
 
+	if (pickWanted && pickReadback.Request(fbo, PickerPass, pickTexel))
+	{
+		readTexel = pickTexel;
+		pickWanted = false;
+	}
+
 	view.GlViewport();
-	glDisable(GL_DEPTH_TEST);
-	glDisable(GL_CULL_FACE);
+	GLState::Disable(GL_DEPTH_TEST);
+	GLState::Disable(GL_CULL_FACE);
 	
 	screenMat.use();
 	screenQuad.Draw();
@@ -87,7 +97,7 @@ void RenderPasses::Highlight(Object o, Highlights type)
 	screenMat.GetUBO()["selected"][type] = o.Id();
 }
 
-Object RenderPasses::Pick(Vector2f posSc) const
+Object RenderPasses::Pick(Vector2f posSc)
 {
 	Eigen::Array2f posTex = view.Sc2Tex(posSc).array();
 
@@ -95,5 +105,21 @@ Object RenderPasses::Pick(Vector2f posSc) const
 		|| (posTex > Eigen::Array2f(1, 1)).any())
 		return Object::invalid;
 
-	return Object{ fbo.ReadPixel<std::uint32_t>(RenderPasses::PickerPass, posTex) };
+	std::uint32_t id;
+	if (pickReadback.Poll(id))
+	{
+		picked = Object{ id };
+		pickedTexel = readTexel;
+	}
+
+	//read it again even if the cursor is still, in case the scene moved.
+	//Requests are coalesced, so only the latest position gets read.
+	TexDim texel = (posTex * fbo.Dim().cast<float>().array()).cast<GLsizei>().matrix()
+		.cwiseMin(fbo.Dim() - TexDim::Ones());
+	pickTexel = texel;
+	pickWanted = true;
+
+	if (texel != pickedTexel)
+		return Object::invalid;
+	return picked;
 }
\ No newline at end of file
@@ -39,7 +39,10 @@ public:
 
 	//set the highlighted object
 	void Highlight(Object o, Highlights type);
-	Object Pick(Vector2f posSc) const;
+	//Exact to the pixel, without waiting for the GPU. This asks for the object
+	//at posSc, which arrives a frame or two later. Until something has arrived
+	//for that pixel, it's Object::invalid.
+	Object Pick(Vector2f posSc);
 	void Camera(Object camera);
 
 private:
@@ -52,6 +55,15 @@ private:
 
 	FBO fbo;
 
+	//the picker attachment is read back at most once a frame, on frames where
+	//something asked for it
+	PixelReadback<std::uint32_t> pickReadback;
+	TexDim pickTexel; //wanted
+	TexDim readTexel; //of the read in flight
+	TexDim pickedTexel; //where 'picked' came from
+	bool pickWanted;
+	Object picked;
+
 	//UBO shared with all shaders
 	ShaderProgram simpleShader;
 	UBO commonUBO;
@@ -81,6 +81,8 @@ struct ShaderProgram::ShaderResource : public Resource<ShaderResource>
 //This lets us swap out shaders that use standard attributes
 //at a minimum there are 16 attribute locations, and generally there are no more
 std::map<std::string, GLint> standardAttribs = {
+    {"posScale",  8},
+    {"rotation",  9},
     {"transform", 10}, //take up 4 locations
     {"position",  14},
     {"object",    15}
@@ -117,7 +119,7 @@ ShaderProgram::ShaderProgram(std::shared_ptr<ShaderResource> ptr)
 void ShaderProgram::use() const
 {
     //set this program as current
-    glUseProgram(program);
+    GLState::UseProgram(program);
 
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 }
@@ -165,20 +167,33 @@ GLuint CreateShader(GLenum eShaderType, const std::string& name)
     
 	static const std::string versionString =
 #ifdef __APPLE__
-		"#version 330\n"
-		"#line 1\n";
+		"#version 330\n";
 #else
 		"#version 130\n"
-		"#extension GL_ARB_uniform_buffer_object : require\n"
+		"#extension GL_ARB_uniform_buffer_object : require\n";
+#endif
+	//so errors point at the right line of the file
+	static const std::string lineString =
+#ifdef __APPLE__
+		"#line 1\n";
+#else
 		"#line 0\n";
 #endif
-    
-    GLint lens[2] = {
+
+	//vertex shaders share the code to unpack instances
+	static MappedFile vertexPrelude{ "assets/instance.glsl" };
+	bool vertex = eShaderType == GL_VERTEX_SHADER;
+
+    GLint lens[4] = {
         static_cast<GLint>(versionString.size()),
+        static_cast<GLint>(vertex ? vertexPrelude.Size() : 0),
+        static_cast<GLint>(lineString.size()),
         static_cast<GLint>(shaderFile.Size()) };
-    const GLchar* srcs[2] = { versionString.c_str(), shaderFile.Data<GLchar>() };
+    const GLchar* srcs[4] = { versionString.c_str(),
+        vertex ? vertexPrelude.Data<GLchar>() : "",
+        lineString.c_str(), shaderFile.Data<GLchar>() };
     
-    glShaderSource(shader, 2, srcs, lens);
+    glShaderSource(shader, 4, srcs, lens);
     glCompileShader(shader);
     
     GLint status;
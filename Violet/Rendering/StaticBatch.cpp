@@ -0,0 +1,68 @@
+#include "stdafx.h"
+#include "StaticBatch.hpp"
+#include "Render.hpp"
+
+#include <cstring>
+
+//a three float attribute, or null
+static const AttribProperties* FindVec3(const Schema& schema, const char* name)
+{
+	for (const auto& props : schema)
+		if (props.name == name && props.glType == GL_FLOAT && props.dims.x() >= 3)
+			return &props;
+	return nullptr;
+}
+
+template<class Fn>
+static void Modify(char* vert, const AttribProperties* props, Fn fn)
+{
+	if (!props)
+		return;
+	Vector3f v;
+	std::memcpy(v.data(), vert + props->offset, sizeof(v));
+	v = fn(v);
+	std::memcpy(vert + props->offset, v.data(), sizeof(v));
+}
+
+VertexData MergeStatic(const std::string& name, const std::vector<VertexData>& meshes,
+	const std::vector<const MeshCopy*>& copies, const std::vector<InstData>& insts)
+{
+	const VertexData& first = meshes[0];
+	GLsizei stride = first.Stride();
+	GLsizei mergedStride = stride + sizeof(GLuint);
+	Schema schema = first.GetSchema();
+	schema.push_back(AttribProperties{ "object", GL_UNSIGNED_INT, true,
+		static_cast<size_t>(stride), { 1, 1 }, 0 });
+	const AttribProperties* position = FindVec3(schema, "position");
+	const AttribProperties* normal = FindVec3(schema, "normal");
+
+	std::vector<char> verts;
+	std::vector<GLint> inds;
+	for (std::size_t i = 0; i < meshes.size(); ++i)
+	{
+		const std::vector<char>& src = copies[i]->verts;
+		const InstData& inst = insts[i];
+		GLuint obj = inst.obj.Id();
+
+		auto base = static_cast<GLint>(verts.size() / mergedStride);
+		for (GLint ind : copies[i]->inds)
+			inds.push_back(base + ind);
+
+		for (std::size_t from = 0; from + stride <= src.size(); from += stride)
+		{
+			std::size_t at = verts.size();
+			verts.resize(at + mergedStride);
+			char* vert = &verts[at];
+			std::memcpy(vert, &src[from], stride);
+			std::memcpy(vert + stride, &obj, sizeof(obj));
+			Modify(vert, position, [&](const Vector3f& p) -> Vector3f
+				{ return inst.Pos() + inst.rot * (p * inst.Scale()); });
+			Modify(vert, normal, [&](const Vector3f& n) -> Vector3f
+				{ return inst.rot * n; });
+		}
+	}
+
+	return{ name, schema, mergedStride, first.Mode(),
+		{ verts.data(), verts.data() + verts.size() },
+		{ reinterpret_cast<const char*>(inds.data()), reinterpret_cast<const char*>(inds.data() + inds.size()) } };
+}
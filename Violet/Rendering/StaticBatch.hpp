@@ -0,0 +1,22 @@
+#ifndef STATIC_BATCH_HPP
+#define STATIC_BATCH_HPP
+
+#include "VertexData.hpp"
+
+struct InstData;
+
+//What a mesh has on the GPU, kept so merging doesn't have to read it back
+struct MeshCopy
+{
+	std::vector<char> verts;
+	std::vector<GLint> inds;
+};
+
+//Copy each mesh, move it by its instance's transform, and join them into one
+//mesh. Every vertex gets the object it came from as an "object" attribute, since
+//there's no instance to carry it. The meshes must all have the same layout
+//and mode, and copies[i] holds the contents of meshes[i].
+VertexData MergeStatic(const std::string& name, const std::vector<VertexData>& meshes,
+	const std::vector<const MeshCopy*>& copies, const std::vector<InstData>& insts);
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef STREAM_BUFFER_HPP
+#define STREAM_BUFFER_HPP
+
+#include "BufferObject.hpp"
+#include <algorithm>
+#include <array>
+#include <vector>
+
+//A vertex buffer refilled every frame without the driver copying or waiting.
+//It's split into regions used in turn, each written through an unsynchronized
+//mapping once the fence after the last draw from it has passed. Offsets are in
+//elements from the start of the whole buffer. If the driver won't map it, the
+//region is written to memory here and uploaded at the end instead.
+template<class T>
+class StreamBuffer
+{
+public:
+    static const int regions = 3;
+
+    StreamBuffer()
+        : capacity(0), region(0), mapped(nullptr)
+    {
+        fences.fill(nullptr);
+    }
+    StreamBuffer(const StreamBuffer&) = delete;
+    ~StreamBuffer()
+    {
+        for (GLsync fence : fences)
+            if (fence)
+                glDeleteSync(fence);
+    }
+
+    //map room for 'size' elements in the next region, to be written (not read)
+    T* Begin(std::size_t size)
+    {
+        size = std::max(size, std::size_t(1));
+        if (size > capacity)
+        {
+            //orphan the old storage, which draws in flight keep using
+            capacity = std::max(size, capacity * 2);
+            buffer.Data(capacity * regions);
+            for (GLsync& fence : fences)
+            {
+                if (fence)
+                    glDeleteSync(fence);
+                fence = nullptr;
+            }
+        }
+        region = (region + 1) % regions;
+
+        GLsync& fence = fences[region];
+        if (fence)
+        {
+            //normally long done
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+
+        buffer.Bind();
+        mapped = static_cast<T*>(glMapBufferRange(GL_ARRAY_BUFFER,
+            Offset() * sizeof(T), size * sizeof(T),
+            GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT
+            | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT));
+        if (mapped)
+            return mapped;
+        staging.resize(size);
+        return staging.data();
+    }
+
+    //only the first 'used' elements were written
+    void End(std::size_t used)
+    {
+        buffer.Bind();
+        if (!mapped)
+        {
+            //the fence in Begin means nothing is reading this region
+            if (used)
+                glBufferSubData(GL_ARRAY_BUFFER, Offset() * sizeof(T), used * sizeof(T), staging.data());
+            return;
+        }
+        if (used)
+            glFlushMappedBufferRange(GL_ARRAY_BUFFER, 0, used * sizeof(T));
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        mapped = nullptr;
+    }
+
+    //call after the draws which read this frame's region
+    void Fence()
+    {
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    //where this frame's region starts
+    std::size_t Offset() const { return region * capacity; }
+    const BufferObject<T, GL_ARRAY_BUFFER, GL_STREAM_DRAW>& Buffer() const { return buffer; }
+
+private:
+    BufferObject<T, GL_ARRAY_BUFFER, GL_STREAM_DRAW> buffer;
+    std::size_t capacity; //of each region
+    int region;
+    T* mapped;
+    std::vector<T> staging; //when mapping failed
+    std::array<GLsync, regions> fences;
+};
+
+#endif
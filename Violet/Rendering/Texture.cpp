@@ -53,7 +53,7 @@ Tex::TexResource::TexResource(std::string path)
 	dim << width, height;
 
 	glGenTextures(1, &textureObject);
-	glBindTexture(GL_TEXTURE_2D, textureObject);
+	GLState::BindTexture(textureObject);
 	//Ideally this would be GL_BGRA for performance, but stbi_image doesn't support it
 	glTexImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(GL_RGBA), dim.x(), dim.y(), 0,
 		GL_RGBA, GL_UNSIGNED_BYTE, data.get());
@@ -68,13 +68,13 @@ Tex::TexResource::TexResource(std::string path)
 
 Tex::TexResource::~TexResource()
 {
+	GLState::DeletedTexture(textureObject);
 	glDeleteTextures(1, &textureObject);
 }
 
 void Tex::Bind(GLuint texUnit) const
 {
-	glActiveTexture(static_cast<GLenum>(static_cast<GLuint>(GL_TEXTURE0) + texUnit));
-	glBindTexture(GL_TEXTURE_2D, textureObject);
+	GLState::BindTexture(texUnit, textureObject);
 }
 
 TexDim Tex::Dim() const
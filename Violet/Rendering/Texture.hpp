@@ -2,6 +2,7 @@
 #define TEXTURE_HPP
 
 #include "Core/Resource.hpp"
+#include "GLState.hpp"
 
 struct ResourcePersistTag;
 
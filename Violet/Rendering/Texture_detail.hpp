@@ -29,7 +29,7 @@ TypedTex<Pixel>::TypedTex(TexDim dim)
     : Tex(std::make_shared<TexResource>(dim))
 {
 	//Bind(0);
-	glBindTexture(GL_TEXTURE_2D, textureObject);
+	GLState::BindTexture(textureObject);
     //https://www.opengl.org/wiki/Common_Mistakes#Creating_a_complete_texture
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
@@ -44,7 +44,7 @@ template<class Pixel>
 void TypedTex<Pixel>::Image(const Pixel* data)
 {
 	auto dim = resource->dim;
-	glBindTexture(GL_TEXTURE_2D, textureObject);
+	GLState::BindTexture(textureObject);
 	glTexImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(PixelTraits<Pixel>::internalFormat),
 		dim.x(), dim.y(), 0, PixelTraits<Pixel>::format, PixelTraits<Pixel>::type, data);
 }
@@ -53,7 +53,7 @@ template<class Pixel>
 void TypedTex<Pixel>::SubImageOf(const Pixel* data, TexBox box)
 {
     auto dim = resource->dim;
-    glBindTexture(GL_TEXTURE_2D, textureObject);
+    GLState::BindTexture(textureObject);
     glPixelStorei(GL_UNPACK_ROW_LENGTH, dim.x()); //unpack only the correct bytes
     glTexSubImage2D(GL_TEXTURE_2D, 0, box.min().x(), box.min().y(), box.sizes().x(), box.sizes().y(),
                     PixelTraits<Pixel>::format, PixelTraits<Pixel>::type,
@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "VAO.hpp"
 #include "Shader.hpp"
+#include "GLState.hpp"
 #include <iostream>
 
 void VAO::BindArrayBufToShader(const ShaderProgram& program, const Schema& schema,
@@ -45,30 +46,26 @@ void VAO::BindArrayBufToShader(const ShaderProgram& program, const Schema& schem
 
 VAO::VAO(const ShaderProgram& program, const VertexData& vertdata)
 	: vertexData(vertdata)
-	, numVertecies(vertdata.resource->numVertecies)
 	, numInstances(1)
-	, mode(vertdata.resource->mode)
 {
 	glGenVertexArrays(1, &vertexArrayObject);
 	auto bound = Bind();
 	auto& res = *vertexData.resource;
-	res.indexBuffer.Bind();
-	res.vertexBuffer.Bind();
+	res.pool->Bind();
 	BindArrayBufToShader(program, res.vertexBufferSchema, res.vertexBufferStride);
 }
 
 VAO::VAO(VAO&& other)
 	: vertexArrayObject(other.vertexArrayObject)
 	, vertexData(std::move(other.vertexData))
-	, numVertecies(other.numVertecies)
 	, numInstances(other.numInstances)
-	, mode(other.mode)
 {
 	other.vertexArrayObject = 0;
 }
 
 VAO::~VAO()
 {
+	GLState::DeletedVertexArray(vertexArrayObject);
 	glDeleteVertexArrays(1, &vertexArrayObject);
 }
 
@@ -82,37 +79,37 @@ void swap(VAO& l, VAO& r)
 {
 	swap(l.vertexArrayObject, r.vertexArrayObject);
 	swap(l.vertexData, r.vertexData);
-	swap(l.numVertecies, r.numVertecies);
 	swap(l.numInstances, r.numInstances);
-	swap(l.mode, r.mode);
 }
 
-GLuint VAO::Binding::current = 0;
-
 VAO::Binding::Binding(GLuint next)
-	: prev(current)
+	: prev(GLState::VertexArray())
 {
-	if (current != next)
-	{
-		glBindVertexArray(next);
-		current = next;
-	}
+	GLState::BindVertexArray(next);
 }
 
 VAO::Binding::~Binding()
 {
-	if (prev != current)
-	{
-		glBindVertexArray(prev);
-		current = prev;
-	}
+	GLState::BindVertexArray(prev);
 }
 
 void VAO::Draw() const
+{
+	Draw(vertexData);
+}
+
+void VAO::Draw(const VertexData& mesh) const
 {
 	auto bound = Bind();
+	auto& res = *mesh.resource;
 	//draw verteces according to the index and position buffer object
 	//the final argument to this call is an integer offset, cast to pointer type. don't ask me why.
-	glDrawElementsInstanced(mode, numVertecies, GL_UNSIGNED_INT,
-		static_cast<GLvoid*>(0), numInstances);
+	glDrawElementsInstancedBaseVertex(res.mode, res.numVertecies, GL_UNSIGNED_INT,
+		static_cast<const char*>(nullptr) + res.placed.firstIndex * sizeof(GLint),
+		numInstances, res.placed.baseVertex);
+}
+
+bool VAO::Shares(const VertexData& mesh) const
+{
+	return vertexData.resource->pool == mesh.resource->pool;
 }
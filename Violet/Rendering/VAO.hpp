@@ -28,14 +28,18 @@ public:
 	private:
 		Binding(GLuint next);
 		GLuint prev;
-		static GLuint current;
 		friend class VAO;
 	};
 
 	//This is only an optimization
 	Binding Bind() const { return vertexArrayObject; }
+	//with no VAO bound, element buffers can be bound without changing any VAO
+	static Binding Unbind() { return 0; }
 
 	void Draw() const;
+	//draw another mesh which shares this one's buffers, with this one's instances
+	void Draw(const VertexData& mesh) const;
+	bool Shares(const VertexData& mesh) const;
 
 	template<class T, GLenum usage>
 	void BindInstanceData(const ShaderProgram& program,
@@ -51,10 +55,19 @@ public:
 	void BindInstanceData(const ShaderProgram& program,
 		const BufferObject<T, GL_ARRAY_BUFFER, usage>& buf,
 		GLsizei offset, GLsizei len)
+	{
+		BindInstanceData(program, buf, AttribTraits<T>::schema, offset, len);
+	}
+
+	//only some of T's attributes, for meshes that have the rest per vertex
+	template<class T, GLenum usage>
+	void BindInstanceData(const ShaderProgram& program,
+		const BufferObject<T, GL_ARRAY_BUFFER, usage>& buf, const Schema& schema,
+		GLsizei offset, GLsizei len)
 	{
 		auto bound = Bind();
 		buf.Bind();
-		BindArrayBufToShader(program, AttribTraits<T>::schema, sizeof(T), offset, true);
+		BindArrayBufToShader(program, schema, sizeof(T), offset, true);
 		numInstances = len;
 	}
 
@@ -80,14 +93,8 @@ private:
 	//GL buffer objects for vertex and vertex index data
 	VertexData vertexData;
 
-	//how many vertex indices we have
-	GLsizei numVertecies;
-
 	//how many instances we have
 	GLsizei numInstances;
-
-	//draw mode
-	GLenum mode;
 };
 
 #endif
@@ -6,6 +6,9 @@
 #include "File/Filesystem.hpp"
 #include "Utils/Profiling.hpp"
 #include <iostream>
+#include <sstream>
+#include <cstring>
+#include <limits>
 
 struct SimpleVert
 {
@@ -41,6 +44,18 @@ std::vector<LineInd> cubeInds = {
 	{4, 5}, {5, 6}, {6, 7}, {7, 4}
 };
 
+//meshes can share a pool when their vertices are laid out the same
+static std::string Format(const Schema& schema, GLsizei stride)
+{
+	std::ostringstream ret;
+	ret << stride;
+	for (const auto& props : schema)
+		ret << ' ' << props.name << ' ' << props.glType << ' ' << props.integer
+			<< ' ' << props.offset << ' ' << props.dims.x() << ' ' << props.dims.y()
+			<< ' ' << props.matrixStride;
+	return ret.str();
+}
+
 VertexData::VertexData(UnitBoxT)
 {
     resource = VertexDataResource::FindResource("UnitBox");
@@ -83,11 +98,102 @@ VertexData::VertexData(const std::string& file)
 		throw std::runtime_error("Unrecognized object file " + file);
 }
 
+VertexData::VertexData(const std::string& name, const Schema& schema, GLsizei stride, GLenum mode,
+	range<const char*> verts, range<const char*> inds)
+	: resource(VertexDataResource::MakeShared(name, schema, stride, mode, verts, inds))
+{}
+
+VertexData::VertexDataResource::VertexDataResource(const std::string& name, const Schema& schema,
+	GLsizei stride, GLenum mode, range<const char*> verts, range<const char*> inds)
+	: ResourceTy(name), vertexBufferSchema(schema), vertexBufferStride(stride), mode(mode)
+{
+	Place(verts, inds);
+}
+
 std::string VertexData::Name() const
 {
 	return resource->Key();
 }
 
+const Schema& VertexData::GetSchema() const
+{
+	return resource->vertexBufferSchema;
+}
+
+GLsizei VertexData::Stride() const
+{
+	return resource->vertexBufferStride;
+}
+
+GLenum VertexData::Mode() const
+{
+	return resource->mode;
+}
+
+std::string VertexData::Layout() const
+{
+	return Format(resource->vertexBufferSchema, resource->vertexBufferStride);
+}
+
+const GeometryPool* VertexData::Pool() const
+{
+	return resource->pool.get();
+}
+
+void VertexData::Read(std::vector<char>& verts, std::vector<GLint>& inds) const
+{
+	resource->pool->Read(resource->placed, verts, inds);
+}
+
+Vector4f VertexData::BoundingSphere() const
+{
+	Vector4f ret;
+	ret << resource->boundCenter, resource->boundRadius;
+	return ret;
+}
+
+void VertexData::VertexDataResource::Place(range<const char*> verts, range<const char*> inds)
+{
+	pool = GeometryPool::Add(Format(vertexBufferSchema, vertexBufferStride),
+		vertexBufferStride, verts, inds, placed);
+	numVertecies = placed.numInds;
+	FindBound(verts);
+}
+
+VertexData::VertexDataResource::~VertexDataResource()
+{
+	pool->Remove(placed);
+}
+
+void VertexData::VertexDataResource::FindBound(range<const char*> verts)
+{
+	boundCenter = Vector3f::Zero();
+	boundRadius = std::numeric_limits<float>::infinity();
+
+	auto pos = std::find_if(vertexBufferSchema.begin(), vertexBufferSchema.end(),
+		[](const AttribProperties& props) { return props.name == "position"; });
+	if (pos == vertexBufferSchema.end() || pos->glType != GL_FLOAT || pos->dims.x() < 3)
+		return;
+
+	auto position = [&](const char* vert)
+	{
+		Vector3f ret;
+		std::memcpy(ret.data(), vert + pos->offset, sizeof(ret));
+		return ret;
+	};
+
+	AlignedBox3f box;
+	for (const char* vert = verts.begin(); vert < verts.end(); vert += vertexBufferStride)
+		box.extend(position(vert));
+	if (box.isEmpty())
+		return;
+
+	boundCenter = box.center();
+	boundRadius = 0;
+	for (const char* vert = verts.begin(); vert < verts.end(); vert += vertexBufferStride)
+		boundRadius = std::max(boundRadius, (position(vert) - boundCenter).norm());
+}
+
 template<>
 const Schema AttribTraits<SimpleVert>::schema = {
 	AttribProperties{"position", GL_FLOAT, false, 0,                 {3, 1}},
@@ -157,7 +263,6 @@ VertexData::VertexDataResource::VertexDataResource(const std::string& name)
 	}
 
 	auto verts = cache.ReadVector<char>();
-	vertexBuffer.Data(verts);
 	auto inds = cache.ReadVector<char>();
-	indexBuffer.Data(inds, IgnoreType);
+	Place({ verts.data(), verts.data() + verts.size() }, { inds.data(), inds.data() + inds.size() });
 }
@@ -3,6 +3,7 @@
 
 #include "Core/Resource.hpp"
 #include "BufferObject.hpp"
+#include "GeometryPool.hpp"
 #include "Containers/WrappedIterator.hpp"
 
 struct ResourcePersistTag;
@@ -56,9 +57,25 @@ public:
 				reinterpret_cast<const char*>(inds.data() + inds.size())});
 	}
 
+	//a mesh in a layout only known at run time
+	VertexData(const std::string& name, const Schema& schema, GLsizei stride, GLenum mode,
+		range<const char*> verts, range<const char*> inds);
+
 	BASIC_EQUALITY(VertexData, resource)
 
 	std::string Name() const;
+	const Schema& GetSchema() const;
+	GLsizei Stride() const;
+	GLenum Mode() const;
+	//equal for meshes whose vertices are laid out the same
+	std::string Layout() const;
+	//the geometry pool it was placed in, which meshes drawn through one VAO share
+	const GeometryPool* Pool() const;
+	//copy the mesh back from the GPU, which waits for it
+	void Read(std::vector<char>& verts, std::vector<GLint>& inds) const;
+	//a sphere around the positions, as center and radius. The radius is
+	//infinite if there's no position attribute.
+	Vector4f BoundingSphere() const;
 
 	using PersistCategory = ResourcePersistTag;
 
@@ -69,24 +86,33 @@ private:
         VertexDataResource(const std::string& name,
             const std::vector<V, VAlloc>& verts, const std::vector<I, IAlloc>& inds)
             : ResourceTy(name), vertexBufferSchema(AttribTraits<V>::schema),
-            vertexBufferStride(sizeof(V)), mode(I::mode),
-            indexBuffer(inds, IgnoreType),
-            vertexBuffer(verts, IgnoreType)
+            vertexBufferStride(sizeof(V)), mode(I::mode)
         {
-            numVertecies = static_cast<GLsizei>(indexBuffer.Size());
+            Place({ reinterpret_cast<const char*>(verts.data()),
+                reinterpret_cast<const char*>(verts.data() + verts.size()) },
+                { reinterpret_cast<const char*>(inds.data()),
+                reinterpret_cast<const char*>(inds.data() + inds.size()) });
         }
 
+		VertexDataResource(const std::string& name, const Schema& schema, GLsizei stride,
+			GLenum mode, range<const char*> verts, range<const char*> inds);
 		//read from cache
 		VertexDataResource(const std::string& name);
+		~VertexDataResource();
 
 		void WriteCache(range<const char*> verts, range<const char*> inds);
+		//upload into a pool, and find the bound
+		void Place(range<const char*> verts, range<const char*> inds);
+		void FindBound(range<const char*> verts);
 
         Schema vertexBufferSchema;
         GLsizei vertexBufferStride;
         GLenum mode;
         GLsizei numVertecies;
-        BufferObject<GLint, GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW> indexBuffer;
-        BufferObject<char, GL_ARRAY_BUFFER, GL_STATIC_DRAW> vertexBuffer;
+        std::shared_ptr<GeometryPool> pool;
+        GeometryPool::Range placed;
+        Vector3f boundCenter;
+        float boundRadius;
     };
 
     VertexData() = default;
@@ -2,6 +2,7 @@
 #include "Scripting.hpp"
 
 #include "Utils/Profiling.hpp"
+#include "Physics/Collision.hpp"
 
 #include "EigenLib.hpp"
 #include "Utils.hpp"
@@ -21,8 +22,8 @@ static const luaL_Reg loadedlibs[] = {
 	{ NULL, NULL }
 };
 
-Scripting::Scripting(ComponentManager& mgr)
-	: mgr(mgr), L(luaL_newstate())
+Scripting::Scripting(ComponentManager& mgr, Collision& collision)
+	: mgr(mgr), collision(collision), L(luaL_newstate())
 {
 	if (!L)
 		throw std::runtime_error("Out of memory");
@@ -60,6 +61,10 @@ int Scripting::OpenLib(lua_State* L)
 	lua_pushglobaltable(L);
 	luaU_push_mem_fn<Scripting, &Scripting::Component>(L, this);
 	lua_setfield(L, -2, "component");
+	luaU_push_mem_fn<Scripting, &Scripting::Raycast>(L, this);
+	lua_setfield(L, -2, "raycast");
+	luaU_push_mem_fn<Scripting, &Scripting::Overlap>(L, this);
+	lua_setfield(L, -2, "overlap");
 	return 1;
 }
 
@@ -74,6 +79,51 @@ int Scripting::Component(lua_State* L)
 	return 1;
 }
 
+//raycast(ox, oy, oz, dx, dy, dz [, length]) returns the object id, distance,
+//point, and normal of the first hit, or nil. The ray is as long as d unless
+//a length is given.
+int Scripting::Raycast(lua_State* L)
+{
+	Vector3f origin{ float(luaL_checknumber(L, 1)), float(luaL_checknumber(L, 2)), float(luaL_checknumber(L, 3)) };
+	Vector3f dir{ float(luaL_checknumber(L, 4)), float(luaL_checknumber(L, 5)), float(luaL_checknumber(L, 6)) };
+	float length = float(luaL_optnumber(L, 7, dir.norm()));
+	luaL_argcheck(L, dir.squaredNorm() > 0, 4, "direction is zero");
+
+	std::vector<RayHit> hits;
+	collision.Raycast({ Ray{ origin, dir.normalized(), length } }, hits);
+	const RayHit& hit = hits[0];
+	if (hit.obj == Object::invalid)
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+
+	lua_pushinteger(L, hit.obj.Id());
+	lua_pushnumber(L, hit.distance);
+	for (int i = 0; i < 3; ++i)
+		lua_pushnumber(L, hit.point[i]);
+	for (int i = 0; i < 3; ++i)
+		lua_pushnumber(L, hit.normal[i]);
+	return 8;
+}
+
+//overlap(x, y, z, radius) returns a list of the ids of objects the sphere touches
+int Scripting::Overlap(lua_State* L)
+{
+	Primitive sphere{ Primitive::Kind::Sphere, Vector3f{ float(luaL_checknumber(L, 4)), 0, 0 } };
+	sphere.center = { float(luaL_checknumber(L, 1)), float(luaL_checknumber(L, 2)), float(luaL_checknumber(L, 3)) };
+
+	std::vector<Object> objects;
+	collision.Overlap(sphere, objects);
+	lua_createtable(L, static_cast<int>(objects.size()), 0);
+	for (std::size_t i = 0; i < objects.size(); ++i)
+	{
+		lua_pushinteger(L, objects[i].Id());
+		lua_rawseti(L, -2, static_cast<int>(i + 1));
+	}
+	return 1;
+}
+
 void Scripting::PhysTick()
 {
 	luaL_getsubtable(L, LUA_REGISTRYINDEX, "_LOADED");
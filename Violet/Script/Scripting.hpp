@@ -4,6 +4,7 @@
 #include "Core/Component.hpp"
 
 class Persist;
+class Collision;
 
 struct ScriptComponent : public Component
 {
@@ -21,7 +22,7 @@ struct lua_State;
 class Scripting
 {
 public:
-	Scripting(ComponentManager& mgr);
+	Scripting(ComponentManager& mgr, Collision& collision);
 	~Scripting();
 
 	void PhysTick();
@@ -36,8 +37,11 @@ private:
 
 	int OpenLib(lua_State *L);
 	int Component(lua_State* L);
+	int Raycast(lua_State* L);
+	int Overlap(lua_State* L);
 
 	ComponentManager& mgr;
+	Collision& collision;
 
 	lua_State* L;
 };
@@ -4,6 +4,7 @@
 #include "Rendering/Shader.hpp"
 #include "Rendering/VAO.hpp"
 #include "Rendering/FBO.hpp"
+#include "Rendering/GLState.hpp"
 #include "Window.hpp"
 #include "Layout.hpp"
 #include "Text.hpp"
@@ -158,7 +159,7 @@ void UI::EndFrame()
     DrawAllText();
     
 	SetViewport();
-	glEnable(GL_DEPTH_TEST);
+	GLState::Enable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LESS);
 
 	//Draw boxes
@@ -182,7 +183,7 @@ void UI::EndFrame()
 
 	boxVAO.Draw();
 
-	glEnable(GL_BLEND);
+	GLState::Enable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	//Draw textured quads
@@ -202,9 +203,9 @@ void UI::EndFrame()
 	}
 
 	//Draw specials
-	glDisable(GL_BLEND);
+	GLState::Disable(GL_BLEND);
 	for (auto& fn : FrameVisuals().specials) fn();
-	glEnable(GL_BLEND);
+	GLState::Enable(GL_BLEND);
 
 	//Draw shadows
 	glBlendFunc(GL_DST_COLOR, GL_ZERO); //multiply
@@ -223,9 +224,9 @@ void UI::EndFrame()
 	shadowVAO.Draw();
 
 	glDepthMask(GL_TRUE);
-	glDisable(GL_BLEND);
+	GLState::Disable(GL_BLEND);
 
-	glDisable(GL_DEPTH_TEST);
+	GLState::Disable(GL_DEPTH_TEST);
 }
 
 void UI::PushZ(int dz)
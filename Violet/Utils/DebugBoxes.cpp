@@ -23,19 +23,23 @@ void DebugBoxes::PushInst(Inst i)
         insts.emplace_back(std::move(i));
 }
 
+DebugBoxes::Inst DebugBoxes::Vector(const Vector3f& from, const Vector3f& dir,
+                                     const Vector3f& color)
+{
+    Inst i;
+    i.color = color;
+    i.loc = Matrix4f::Zero();
+    i.loc(3, 3) = 1;
+    i.loc.block<3, 1>(0, 3) = from;
+    i.loc.block<3, 1>(0, 0) = dir;
+    return i;
+}
+
 void DebugBoxes::PushVector(const Vector3f& from, const Vector3f& dir,
                                  const Vector3f& color)
 {
     if (enabled)
-    {
-        Inst i;
-        i.color = color;
-        i.loc = Matrix4f::Zero();
-        i.loc(3, 3) = 1;
-        i.loc.block<3, 1>(0, 3) = from;
-        i.loc.block<3, 1>(0, 0) = dir;
-        PushInst(i);
-    }
+        PushInst(Vector(from, dir, color));
 }
 
 void DebugBoxes::Begin()
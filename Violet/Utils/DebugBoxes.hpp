@@ -14,6 +14,9 @@ struct DebugBoxes
         Vector3f color;
     };
     
+    //an instance drawing a line segment
+    static Inst Vector(const Vector3f& from, const Vector3f& dir, const Vector3f& color);
+
     //These only have an effect if it is enabled
     void PushInst(Inst);
     void PushVector(const Vector3f& from, const Vector3f& dir, const Vector3f& color);
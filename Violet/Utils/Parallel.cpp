@@ -0,0 +1,79 @@
+#include "stdafx.h"
+#include "Parallel.hpp"
+
+ThreadPool::ThreadPool(unsigned threads)
+    : job(nullptr), count(0), next(0), busy(0), generation(0), quit(false)
+{
+    //hardware_concurrency is 0 if it doesn't know, then everything runs inline
+    for (unsigned i = 1; i < threads; ++i)
+        workers.emplace_back(&ThreadPool::Work, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+ThreadPool& ThreadPool::Default()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::For(std::size_t n, const std::function<void(std::size_t)>& f)
+{
+    if (workers.empty() || n < 2)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+            f(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &f;
+        count = n;
+        next = 0;
+        busy = static_cast<unsigned>(workers.size());
+        ++generation;
+    }
+    wake.notify_all();
+
+    RunJobs();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this]() {return busy == 0; });
+    job = nullptr;
+}
+
+void ThreadPool::RunJobs()
+{
+    for (std::size_t i = next++; i < count; i = next++)
+        (*job)(i);
+}
+
+void ThreadPool::Work()
+{
+    std::uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        wake.wait(lock, [&]() {return quit || generation != seen; });
+        if (quit)
+            return;
+        seen = generation;
+
+        lock.unlock();
+        RunJobs();
+        lock.lock();
+
+        if (--busy == 0)
+            done.notify_one();
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+//A fixed set of worker threads that run loop bodies. The calling thread
+//helps out, and For returns once every index is done. Not reentrant: don't
+//call For from inside a loop body.
+class ThreadPool
+{
+public:
+    //'threads' counts the caller, so 1 runs everything inline
+    ThreadPool(unsigned threads = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    //run job(i) for each i in [0, count), in no particular order
+    void For(std::size_t count, const std::function<void(std::size_t)>& job);
+    unsigned Threads() const { return static_cast<unsigned>(workers.size()) + 1; }
+
+    //shared pool, created on first use
+    static ThreadPool& Default();
+
+private:
+    void Work();
+    void RunJobs();
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+
+    const std::function<void(std::size_t)>* job;
+    std::size_t count;
+    std::atomic<std::size_t> next;
+    unsigned busy; //workers which haven't finished the current loop
+    std::uint64_t generation;
+    bool quit;
+};
+
+#endif
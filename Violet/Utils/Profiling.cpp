@@ -43,4 +43,52 @@ void Profile::Print()
 {
 	std::cout << "No profiling data\n";
 }
-#endif
\ No newline at end of file
+#endif
+
+#ifdef COUNT_ALLOCATIONS
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<std::size_t> allocations{ 0 };
+static std::size_t failures = 0;
+
+void* operator new(std::size_t size)
+{
+    ++allocations;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+AllocationCheck::AllocationCheck(const char * name)
+    : name(name), start(allocations)
+{
+    Eigen::internal::set_is_malloc_allowed(false);
+}
+
+AllocationCheck::~AllocationCheck()
+{
+    Eigen::internal::set_is_malloc_allowed(true);
+    if (allocations != start)
+    {
+        std::cerr << name << ": " << allocations - start << " allocations\n";
+        ++failures;
+    }
+}
+
+std::size_t AllocationCheck::Count()
+{
+    return allocations;
+}
+
+std::size_t AllocationCheck::Failures()
+{
+    return failures;
+}
+#endif
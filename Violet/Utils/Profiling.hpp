@@ -69,4 +69,35 @@ public:
 };
 #endif
 
+//Complains about heap allocations made while it's alive. Eigen allocations
+//assert, and others are counted. Only on when COUNT_ALLOCATIONS is defined
+//in stdafx.h.
+#ifdef COUNT_ALLOCATIONS
+#include <cstddef>
+
+class AllocationCheck
+{
+public:
+    AllocationCheck(const char * name);
+    ~AllocationCheck();
+
+    //allocations since startup
+    static std::size_t Count();
+    //checks which have complained
+    static std::size_t Failures();
+
+private:
+    const char* name;
+    std::size_t start;
+};
+#else
+class AllocationCheck
+{
+public:
+    AllocationCheck(const char * name) {}
+    static std::size_t Count() { return 0; }
+    static std::size_t Failures() { return 0; }
+};
+#endif
+
 #endif
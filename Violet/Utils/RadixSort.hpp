@@ -0,0 +1,49 @@
+#ifndef RADIX_SORT_HPP
+#define RADIX_SORT_HPP
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+//Stable sort on a 64 bit key, a byte at a time, least significant first.
+//All the byte counts are taken in one pass, and bytes which are the same in
+//every item are skipped, so unused key bits cost nothing. 'scratch' is only
+//there to keep its memory between calls.
+template<class T, class Key>
+void RadixSort(std::vector<T>& items, std::vector<T>& scratch, Key key)
+{
+	if (items.size() < 2)
+		return;
+
+	std::size_t counts[8][256] = {};
+	for (const T& item : items)
+	{
+		std::uint64_t k = key(item);
+		for (int byte = 0; byte < 8; ++byte)
+			++counts[byte][(k >> (byte * 8)) & 0xff];
+	}
+
+	scratch.resize(items.size());
+	std::uint64_t first = key(items[0]);
+	for (int byte = 0; byte < 8; ++byte)
+	{
+		std::size_t* count = counts[byte];
+		if (count[(first >> (byte * 8)) & 0xff] == items.size())
+			continue;
+
+		//counts to starting positions
+		std::size_t sum = 0;
+		for (int digit = 0; digit < 256; ++digit)
+		{
+			std::size_t n = count[digit];
+			count[digit] = sum;
+			sum += n;
+		}
+
+		for (const T& item : items)
+			scratch[count[(key(item) >> (byte * 8)) & 0xff]++] = item;
+		items.swap(scratch);
+	}
+}
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+//Thin wrappers over SIMD registers, so batch kernels can be written once.
+//SimdFloat holds 'width' floats: 8 with AVX, 4 with SSE, and 1 otherwise.
+//SimdMask is the result of a lane-wise comparison.
+
+#if defined(__AVX__)
+
+#include <immintrin.h>
+
+struct SimdMask
+{
+    __m256 v;
+    SimdMask() {}
+    SimdMask(__m256 v) : v(v) {}
+    friend SimdMask operator|(SimdMask a, SimdMask b) { return _mm256_or_ps(a.v, b.v); }
+    friend SimdMask operator&(SimdMask a, SimdMask b) { return _mm256_and_ps(a.v, b.v); }
+    friend SimdMask AndNot(SimdMask a, SimdMask b) { return _mm256_andnot_ps(b.v, a.v); }
+    //bit i is lane i
+    unsigned Bits() const { return static_cast<unsigned>(_mm256_movemask_ps(v)); }
+};
+
+struct SimdFloat
+{
+    static const int width = 8;
+    __m256 v;
+    SimdFloat() {}
+    SimdFloat(__m256 v) : v(v) {}
+    SimdFloat(float f) : v(_mm256_set1_ps(f)) {}
+    //unaligned, but SimdAlign arrays load faster
+    static SimdFloat Load(const float* p) { return _mm256_loadu_ps(p); }
+    void Store(float* p) const { _mm256_storeu_ps(p, v); }
+
+    friend SimdFloat operator+(SimdFloat a, SimdFloat b) { return _mm256_add_ps(a.v, b.v); }
+    friend SimdFloat operator-(SimdFloat a, SimdFloat b) { return _mm256_sub_ps(a.v, b.v); }
+    friend SimdFloat operator*(SimdFloat a, SimdFloat b) { return _mm256_mul_ps(a.v, b.v); }
+    friend SimdFloat Abs(SimdFloat a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a.v); }
+    friend SimdFloat Min(SimdFloat a, SimdFloat b) { return _mm256_min_ps(a.v, b.v); }
+    friend SimdFloat Max(SimdFloat a, SimdFloat b) { return _mm256_max_ps(a.v, b.v); }
+    friend SimdMask operator<(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+    friend SimdMask operator>(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+    //a where the mask is set, b elsewhere
+    friend SimdFloat Select(SimdMask m, SimdFloat a, SimdFloat b) { return _mm256_blendv_ps(b.v, a.v, m.v); }
+};
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+#include <emmintrin.h>
+
+struct SimdMask
+{
+    __m128 v;
+    SimdMask() {}
+    SimdMask(__m128 v) : v(v) {}
+    friend SimdMask operator|(SimdMask a, SimdMask b) { return _mm_or_ps(a.v, b.v); }
+    friend SimdMask operator&(SimdMask a, SimdMask b) { return _mm_and_ps(a.v, b.v); }
+    friend SimdMask AndNot(SimdMask a, SimdMask b) { return _mm_andnot_ps(b.v, a.v); }
+    unsigned Bits() const { return static_cast<unsigned>(_mm_movemask_ps(v)); }
+};
+
+struct SimdFloat
+{
+    static const int width = 4;
+    __m128 v;
+    SimdFloat() {}
+    SimdFloat(__m128 v) : v(v) {}
+    SimdFloat(float f) : v(_mm_set1_ps(f)) {}
+    static SimdFloat Load(const float* p) { return _mm_loadu_ps(p); }
+    void Store(float* p) const { _mm_storeu_ps(p, v); }
+
+    friend SimdFloat operator+(SimdFloat a, SimdFloat b) { return _mm_add_ps(a.v, b.v); }
+    friend SimdFloat operator-(SimdFloat a, SimdFloat b) { return _mm_sub_ps(a.v, b.v); }
+    friend SimdFloat operator*(SimdFloat a, SimdFloat b) { return _mm_mul_ps(a.v, b.v); }
+    friend SimdFloat Abs(SimdFloat a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a.v); }
+    friend SimdFloat Min(SimdFloat a, SimdFloat b) { return _mm_min_ps(a.v, b.v); }
+    friend SimdFloat Max(SimdFloat a, SimdFloat b) { return _mm_max_ps(a.v, b.v); }
+    friend SimdMask operator<(SimdFloat a, SimdFloat b) { return _mm_cmplt_ps(a.v, b.v); }
+    friend SimdMask operator>(SimdFloat a, SimdFloat b) { return _mm_cmpgt_ps(a.v, b.v); }
+    friend SimdFloat Select(SimdMask m, SimdFloat a, SimdFloat b)
+    { return _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)); }
+};
+
+#else
+
+#include <cmath>
+#include <algorithm>
+
+struct SimdMask
+{
+    bool v;
+    SimdMask() {}
+    SimdMask(bool v) : v(v) {}
+    friend SimdMask operator|(SimdMask a, SimdMask b) { return a.v || b.v; }
+    friend SimdMask operator&(SimdMask a, SimdMask b) { return a.v && b.v; }
+    friend SimdMask AndNot(SimdMask a, SimdMask b) { return a.v && !b.v; }
+    unsigned Bits() const { return v ? 1u : 0u; }
+};
+
+struct SimdFloat
+{
+    static const int width = 1;
+    float v;
+    SimdFloat() {}
+    SimdFloat(float f) : v(f) {}
+    static SimdFloat Load(const float* p) { return *p; }
+    void Store(float* p) const { *p = v; }
+
+    friend SimdFloat operator+(SimdFloat a, SimdFloat b) { return a.v + b.v; }
+    friend SimdFloat operator-(SimdFloat a, SimdFloat b) { return a.v - b.v; }
+    friend SimdFloat operator*(SimdFloat a, SimdFloat b) { return a.v * b.v; }
+    friend SimdFloat Abs(SimdFloat a) { return std::abs(a.v); }
+    friend SimdFloat Min(SimdFloat a, SimdFloat b) { return std::min(a.v, b.v); }
+    friend SimdFloat Max(SimdFloat a, SimdFloat b) { return std::max(a.v, b.v); }
+    friend SimdMask operator<(SimdFloat a, SimdFloat b) { return a.v < b.v; }
+    friend SimdMask operator>(SimdFloat a, SimdFloat b) { return a.v > b.v; }
+    friend SimdFloat Select(SimdMask m, SimdFloat a, SimdFloat b) { return m.v ? a : b; }
+};
+
+#endif
+
+//preferred alignment for arrays passed to SimdFloat::Load and Store
+#define SimdAlign alignas(32)
+
+#endif
@@ -88,7 +88,7 @@ inline std::size_t hash_combine(const T& first, Args... args)
 template<class... Types>
 struct std::hash<std::tuple<Types...>>
 {
-	size_t operator()(const std::tuple<Types...>& tup)
+	size_t operator()(const std::tuple<Types...>& tup) const
 	{
 		return invoke(hash_combine, tup);
 	}
@@ -97,7 +97,7 @@ struct std::hash<std::tuple<Types...>>
 template<class A, class B>
 struct std::hash<std::pair<A, B>>
 {
-    size_t operator()(const std::pair<A, B>& pair)
+    size_t operator()(const std::pair<A, B>& pair) const
     {
         return hash_combine(pair.first, pair.second);
     }
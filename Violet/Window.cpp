@@ -2,6 +2,7 @@
 #include "Window.hpp"
 
 #include "Utils/Profiling.hpp"
+#include "Rendering/GLState.hpp"
 
 #include <iostream>
 #include <iomanip>
@@ -298,7 +299,7 @@ Window::Window()
 	//glDebugMessageControlARB(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_LOW_ARB,
 	//	0, nullptr, GL_FALSE);
     //get stacktrace in correct thread & function
-    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS_ARB);
+    GLState::Enable(GL_DEBUG_OUTPUT_SYNCHRONOUS_ARB);
     glDebugMessageCallbackARB(glDebugProc, nullptr);
 #endif
 
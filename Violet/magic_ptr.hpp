@@ -256,6 +256,16 @@ public:
 		return bool(acc);
 	}
 
+	//same accessor and key, so combined magic_ptrs are never equal to their parts
+	bool operator==(const magic_ptr& other) const
+	{
+		return acc == other.acc && std::memcmp(&key, &other.key, sizeof(key)) == 0;
+	}
+	bool operator!=(const magic_ptr& other) const
+	{
+		return !(*this == other);
+	}
+
 	//combine magic_ptrs. only calls getter of lhs
 	magic_ptr operator+(magic_ptr other)
 	{
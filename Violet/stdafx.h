@@ -14,6 +14,12 @@
 #define _POSIX_C_SOURCE 200112L
 #endif
 
+//count heap allocations, see AllocationCheck
+//#define COUNT_ALLOCATIONS
+#ifdef COUNT_ALLOCATIONS
+#define EIGEN_RUNTIME_NO_MALLOC
+#endif
+
 #include "GL/gl_core_3_3.h"
 #include "Eigen/Core"
 #include "Eigen/Geometry"
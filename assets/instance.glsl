@@ -0,0 +1,19 @@
+//Prepended to every vertex shader
+
+in vec4 posScale;
+in vec4 rotation;
+
+//rebuild the instance's matrix from its position, scale, and rotation
+vec3 rotate(vec3 v)
+{
+	return v + 2*cross(rotation.xyz, cross(rotation.xyz, v) + rotation.w*v);
+}
+
+mat4 instanceTransform()
+{
+	return mat4(
+		vec4(rotate(vec3(1, 0, 0))*posScale.w, 0),
+		vec4(rotate(vec3(0, 1, 0))*posScale.w, 0),
+		vec4(rotate(vec3(0, 0, 1))*posScale.w, 0),
+		vec4(posScale.xyz, 1));
+}
@@ -16,11 +16,11 @@ out vec3 fragPos;
 
 flat out uint objectFrag;
 
-in mat4 transform;
 in uint object;
 
 void main()
 {
+	mat4 transform = instanceTransform();
     gl_Position = projection * camera * transform * vec4(position, 1);
 
 	screenLight = (projection * camera * transform * vec4(light, 0)).xyz;
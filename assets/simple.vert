@@ -14,11 +14,11 @@ out vec3 posFrag;
 
 flat out uint objectFrag;
 
-in mat4 transform;
 in uint object;
 
 void main()
 {
+	mat4 transform = instanceTransform();
     gl_Position = projection * camera * transform * vec4(position, 1);
 	posFrag = (transform * vec4(position, 1)).xyz;
 	normalFrag = (transform * vec4(normal, 0)).xyz;
@@ -1,6 +1,5 @@
 in vec3 position;
 
-in mat4 transform;
 in uint object;
 
 flat out uint objectFrag;
@@ -21,6 +20,7 @@ float size = .1;
 
 void main()
 {
+	mat4 transform = instanceTransform();
 	vec4 screenpos = projection * camera * transform[3];
 	screenpos /= screenpos[3];
     vec4 dir = projection * camera * transform * vec4(direction, 0);
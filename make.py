@@ -5,6 +5,7 @@ import subprocess
 import cPickle as pickle
 import hashlib
 import platform
+import sys
 
 #glLoadGenFlags = ['-style=pointer_c', '-spec=gl', '-version=3.3', '-profile=core', '-stdext=gl_ubiquitous.txt']
 #glLoadGenOutput = 'GL/core_3_3'
@@ -21,6 +22,14 @@ libglfw = (['-framework', 'Cocoa', '-framework', 'OpenGL', '-framework', 'IOKit'
 libs = libgl + libglfw + ['-rdynamic']
 executable = 'violet.o'
 
+#'./make.py check' builds the engine once per check, with the check's flags,
+#and runs it. It fails if any of them don't build or exit unsuccessfully.
+checks = {
+    'occlusion': ['-DOCCLUSION_CHECK'],
+    #needs a window for the debug views, but draws nothing
+    'allocations': ['-DCOUNT_ALLOCATIONS', '-DALLOCATION_CHECK'],
+}
+
 def makedir(dir):
     return [os.path.join(path,fname) for path,_,fnames in os.walk(dir) for fname in fnames
         if fname.endswith('.cpp') or fname.endswith('.c')]
@@ -40,42 +49,56 @@ def cxx(fname):
 def command(fname):
     return [cxx(fname), fname] + flags(fname)
 
-def obj(fname):
-    return os.path.join('obj', fname.replace('.cpp', '.o').replace('.c', '.o'))
-
-if not os.path.isfile('sums'):
-    with open('sums','wb') as hdl:
-        pickle.dump({}, hdl, -1)
-
-with open('sums','rb') as hdl:
-    oldsums = pickle.load(hdl)
+def obj(fname, objdir):
+    return os.path.join(objdir, fname.replace('.cpp', '.o').replace('.c', '.o'))
 
 #glLoadGenCmd = (['lua', 'glLoadGen_2_0_2/LoadGen.lua'] + glLoadGenFlags + [glLoadGenOutput] + 
 #    (['-exts'] + glLoadGenExts if glLoadGenExts else []))
 #print ' '.join(glLoadGenCmd)
 #subprocess.check_call(glLoadGenCmd, stderr=subprocess.STDOUT)
 
-sums = {}
-procs = {}
-sources = [src for dirname in sourcedirs for src in makedir(dirname)]
-for fname in sources:
-    sums[fname] = hashlib.md5(subprocess.check_output(command(fname) + ['-E'])).hexdigest()
-    if not fname in oldsums or not oldsums[fname] == sums[fname]:
-        if not os.path.isdir(os.path.dirname(obj(fname))):
-            os.makedirs(os.path.dirname(obj(fname)))
-        cmd = command(fname) + ['-c', '-o', obj(fname)]
-        print ' '.join(cmd)
-        procs[fname] = subprocess.Popen(cmd)
-
-sums = {fname:cksum for (fname,cksum) in sums.iteritems() if not fname in procs or procs[fname].wait() == 0}
-#print sums
-
-with open('sums','wb') as hdl:
-    pickle.dump(sums, hdl, -1)
-
-if not all([proc.wait() == 0 for (_,proc) in procs.iteritems()]):
+def build(extraflags, executable, objdir, sumsfile):
+    if not os.path.isfile(sumsfile):
+        with open(sumsfile,'wb') as hdl:
+            pickle.dump({}, hdl, -1)
+
+    with open(sumsfile,'rb') as hdl:
+        oldsums = pickle.load(hdl)
+
+    sums = {}
+    procs = {}
+    sources = [src for dirname in sourcedirs for src in makedir(dirname)]
+    for fname in sources:
+        sums[fname] = hashlib.md5(subprocess.check_output(command(fname) + extraflags + ['-E'])).hexdigest()
+        if not fname in oldsums or not oldsums[fname] == sums[fname]:
+            if not os.path.isdir(os.path.dirname(obj(fname, objdir))):
+                os.makedirs(os.path.dirname(obj(fname, objdir)))
+            cmd = command(fname) + extraflags + ['-c', '-o', obj(fname, objdir)]
+            print ' '.join(cmd)
+            procs[fname] = subprocess.Popen(cmd)
+
+    sums = {fname:cksum for (fname,cksum) in sums.iteritems() if not fname in procs or procs[fname].wait() == 0}
+    #print sums
+
+    with open(sumsfile,'wb') as hdl:
+        pickle.dump(sums, hdl, -1)
+
+    if not all([proc.wait() == 0 for (_,proc) in procs.iteritems()]):
+        return False
+
+    cmd = [cxx(''), '-o', executable] + [obj(src, objdir) for src in sources] + cflags + extraflags + libs
+    print ' '.join(cmd)
+    return subprocess.Popen(cmd).wait() == 0
+
+if len(sys.argv) > 1 and sys.argv[1] == 'check':
+    failed = []
+    for name, checkflags in sorted(checks.iteritems()):
+        exe = 'check_' + name + '.o'
+        if not build(checkflags, exe, 'obj_' + name, 'sums_' + name) or subprocess.call(['./' + exe]) != 0:
+            failed.append(name)
+    if failed:
+        print 'failed: ' + ', '.join(failed)
+        exit(-1)
+    print 'all checks passed'
+elif not build([], executable, 'obj', 'sums'):
     exit(-1)
-
-cmd = [cxx(''), '-o', executable] + [obj(src) for src in sources] + cflags + libs
-print ' '.join(cmd)
-subprocess.Popen(cmd).wait()